@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <exception>
 #include <stdexcept>
 
@@ -17,12 +18,10 @@
 
 #include "SimpleShape.h"
 
-#define WM_PAINT 1
-
 constexpr float fov = 60;
 
 
-VulkanInstance inst;
+VulkanInstance &inst = VulkanInstance::instance();
 
 struct {
   tg::mat4 prj;
@@ -46,15 +45,10 @@ struct alignas(16){
 	aligned_vec3 albedo;
 } material_ubo;
 
-class Test {
+class Test : public VulkanView {
 public:
-  Test(const std::shared_ptr<VulkanDevice> &dev) : _device(dev)
+  Test(const std::shared_ptr<VulkanDevice> &dev) : VulkanView(dev, false)
   {
-    _manip.set_home(vec3(0, -30, 0), vec3(0), vec3(0, 0, 1));
-
-    _swapchain = std::make_shared<VulkanSwapChain>(dev);
-    _queue = dev->graphic_queue(0);
-
     create_sphere();
     create_pipe_layout();
   }
@@ -63,24 +57,6 @@ public:
   {
     vkDeviceWaitIdle(*_device);
 
-    free_resource();
-    for (auto fence : _fences)
-      vkDestroyFence(*_device, fence, nullptr);
-
-    _device->destroy_command_buffers(_cmd_bufs);
-
-    vkDestroyRenderPass(*_device, _render_pass, nullptr);
-
-    vkDestroySemaphore(*_device, _presentSemaphore, nullptr);
-    vkDestroySemaphore(*_device, _renderSemaphore, nullptr);
-
-    auto surface = _swapchain->surface();
-    _swapchain.reset();
-
-    if (surface) {
-      vkDestroySurfaceKHR(inst, surface, nullptr);
-    }
-
     if (_vert_buf) {
       vkDestroyBuffer(*_device, _vert_buf, nullptr);
       _vert_buf = VK_NULL_HANDLE;
@@ -119,238 +95,50 @@ public:
 
   void set_window(SDL_Window *win)
   {
-    SDL_GetWindowSize(win, &_w, &_h);
+    int w = 0, h = 0;
+    SDL_GetWindowSize(win, &w, &h);
 
     VkSurfaceKHR surface;
     if (!SDL_Vulkan_CreateSurface(win, inst, &surface))
       throw std::runtime_error("could not create vk surface.");
 
-    _swapchain->set_surface(surface);
-    _swapchain->realize(_w, _h, true);
-
-    create_sync_object();
-
-    int count = _swapchain->image_count();
-
-    _render_pass = _swapchain->create_render_pass();
-
-    _cmd_bufs = _device->create_command_buffers(count);
+    set_surface(surface, w, h);
 
     create_pipeline();
 
-    apply_resource();
-
-    update_ubo();
+    update_frame();
   }
 
-  void apply_resource()
+  void set_headless(int w, int h)
   {
-    int count = _swapchain->image_count();
-    _depth = _swapchain->create_depth_image(_w, _h);
-    _frame_bufs = _swapchain->create_frame_buffer(_render_pass, _depth);
+    set_offscreen(w, h);
 
-    build_command_buffers(_frame_bufs, _render_pass);
-
-    if (_fences.size() != _cmd_bufs.size()) {
-      for (auto fence : _fences)
-        vkDestroyFence(*_device, fence, nullptr);
-      _fences = _device->create_fences(_cmd_bufs.size());
-    }
-  }
-
-  void free_resource()
-  {
-    for (auto &framebuf : _frame_bufs)
-      vkDestroyFramebuffer(*_device, framebuf, nullptr);
-    _frame_bufs.clear();
-
-    vkDestroyImageView(*_device, _depth.view, nullptr);
-    vkDestroyImage(*_device, _depth.image, nullptr);
-    vkFreeMemory(*_device, _depth.mem, nullptr);
-    _depth = {VK_NULL_HANDLE};
+    create_pipeline();
   }
 
-  void create_sync_object()
-  {
-    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    semaphoreCreateInfo.pNext = nullptr;
+  void wheel(int delta) { update_ubo(); }
+  void left_drag(int x, int y, int, int) { update_ubo(); }
+  void right_drag(int x, int y, int, int) { update_ubo(); }
+  void key_up(int) { update_ubo(); }
 
-    // Semaphore used to ensure that image presentation is complete before starting to submit again
-    VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &_presentSemaphore));
+  void resize(int, int) { update_ubo(); }
 
-    // Semaphore used to ensure that all commands submitted have been finished before submitting the image to the queue
-    VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &_renderSemaphore));
-  }
-
-  void update()
-  {
-    SDL_Event ev;
-    ev.type = SDL_USEREVENT;
-    ev.user.code = WM_PAINT;
-    SDL_PushEvent(&ev);
-  }
-
-  void draw()
+  // the view begins the render pass and sets the viewport and scissor
+  void build_command_buffer(VkCommandBuffer cmd_buf)
   {
-    // vkWaitForFences(*_device, 1, _fences[]);
-    auto [result, index] = _swapchain->acquire_image(_presentSemaphore);
-    if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
-      VK_CHECK_RESULT(result);
-    }
-
-    VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &_fences[index], VK_TRUE, UINT64_MAX));
-    VK_CHECK_RESULT(vkResetFences(*_device, 1, &_fences[index]));
-
-    VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pWaitDstStageMask = &waitStageMask;   // Pointer to the list of pipeline stages that the semaphore waits will occur at
-    submitInfo.waitSemaphoreCount = 1;               // One wait semaphore
-    submitInfo.signalSemaphoreCount = 1;             // One signal semaphore
-    submitInfo.pCommandBuffers = &_cmd_bufs[index];  // Command buffers(s) to execute in this batch (submission)
-    submitInfo.commandBufferCount = 1;               // One command buffer
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
 
-    submitInfo.pWaitSemaphores = &_presentSemaphore;   // Semaphore(s) to wait upon before the submitted command buffer starts executing
-    submitInfo.pSignalSemaphores = &_renderSemaphore;  // Semaphore(s) to be signaled when command buffers have completed
-
-    // Submit to the graphics queue passing a wait fence
-    VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo, _fences[index]));
+    VkDescriptorSet dessets[2] = {_matrix_set, _material_set};
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipe_layout, 0, 2, dessets, 0, nullptr);
 
     {
-      _frame = index;
-      auto present = _swapchain->queue_present(_queue, _frame, _renderSemaphore);
-      if (!((present == VK_SUCCESS) || (present == VK_SUBOPTIMAL_KHR))) {
-        VK_CHECK_RESULT(present);
-      }
-    }
-  }
-
-  void loop()
-  {
-    bool running = true;
-    while (running) {
-      SDL_Event event;
-      while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-          case SDL_QUIT:
-            running = false;
-            break;
-          case SDL_WINDOWEVENT:
-            if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-              vkDeviceWaitIdle(*_device);
-              _w = event.window.data1;
-              _h = event.window.data2;
-              _swapchain->realize(_w, _h, true);
-              free_resource();
-              apply_resource();
-              update_ubo();
-              update();
-            }
-            break;
-          case SDL_USEREVENT:
-            if (event.user.code == WM_PAINT)
-              draw();
-            break;
-          case SDL_MOUSEMOTION:
-            if (event.motion.state & SDL_BUTTON_LMASK) {
-              _manip.rotate(event.motion.xrel, event.motion.yrel);
-              update_ubo();
-            } else if (event.motion.state & SDL_BUTTON_MMASK) {
-            } else if (event.motion.state & SDL_BUTTON_RMASK) {
-              _manip.translate(event.motion.xrel, -event.motion.yrel);
-              update_ubo();
-            }
-            update();
-            break;
-          case SDL_MOUSEWHEEL: {
-            _manip.zoom(event.wheel.y);
-            update_ubo();
-            update();
-            break;
-          }
-          case SDL_KEYUP: {
-            if (event.key.keysym.scancode == SDL_SCANCODE_SPACE)
-              _manip.home();
-            update_ubo();
-            update();
-          } break;
-          default:
-            break;
-        }
-      }
-    }
-  }
-
-  void build_command_buffers(std::vector<VkFramebuffer> &framebuffers, VkRenderPass renderPass)
-  {
-    assert(framebuffers.size() == _cmd_bufs.size());
-
-    VkCommandBufferBeginInfo buf_info = {};
-    buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    buf_info.pNext = nullptr;
-
-    VkClearValue clearValues[2];
-    clearValues[0].color = {{0.0, 0.0, 0.2, 1.0}};
-    clearValues[1].depthStencil = {1, 0};
-
-    VkRenderPassBeginInfo renderPassBeginInfo = {};
-    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.pNext = nullptr;
-    renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.renderArea.offset.x = 0;
-    renderPassBeginInfo.renderArea.offset.y = 0;
-    renderPassBeginInfo.renderArea.extent.width = _w;
-    renderPassBeginInfo.renderArea.extent.height = _h;
-    renderPassBeginInfo.clearValueCount = 2;
-    renderPassBeginInfo.pClearValues = clearValues;
-
-    for (int i = 0; i < _cmd_bufs.size(); i++) {
-      renderPassBeginInfo.framebuffer = framebuffers[i];
-      auto &cmd_buf = _cmd_bufs[i];
-      VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
-
-      vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-      {
-        VkViewport viewport = {};
-        viewport.y = _h;
-        viewport.width = _w;
-        viewport.height = -_h;
-        viewport.minDepth = 0;
-        viewport.maxDepth = 1;
-        vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-      }
-
-      {
-        VkRect2D scissor = {};
-        scissor.extent.width = _w;
-        scissor.extent.height = _h;
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-        vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-      }
-
-      {
-        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
-      }
-
-      VkDescriptorSet dessets[2] = {_matrix_set, _material_set};
-      vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipe_layout, 0, 2, dessets, 0, nullptr);
-
-      {
-        VkDeviceSize offset[2] = {0, _vert_count * sizeof(vec3)};
-        VkBuffer bufs[2] = {};
-        bufs[0] = _vert_buf;
-        bufs[1] = _vert_buf;
-        vkCmdBindVertexBuffers(cmd_buf, 0, 2, bufs, offset);
-        vkCmdBindIndexBuffer(cmd_buf, _index_buf, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdDrawIndexed(cmd_buf, _index_count, 49, 0, 0, 0);
-      }
-
-      vkCmdEndRenderPass(cmd_buf);
-
-      VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
+      VkDeviceSize offset[2] = {0, _vert_count * sizeof(vec3)};
+      VkBuffer bufs[2] = {};
+      bufs[0] = _vert_buf;
+      bufs[1] = _vert_buf;
+      vkCmdBindVertexBuffers(cmd_buf, 0, 2, bufs, offset);
+      vkCmdBindIndexBuffer(cmd_buf, _index_buf, 0, VK_INDEX_TYPE_UINT16);
+      vkCmdDrawIndexed(cmd_buf, _index_count, 49, 0, 0, 0);
     }
   }
 
@@ -515,7 +303,7 @@ public:
     VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
     pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineCreateInfo.layout = _pipe_layout;
-    pipelineCreateInfo.renderPass = _render_pass;
+    pipelineCreateInfo.renderPass = *render_pass();
 
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
     inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -619,7 +407,7 @@ public:
     pipelineCreateInfo.pDepthStencilState = &depthStencilState;
     pipelineCreateInfo.pDynamicState = &dynamicState;
 
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
+    _pipeline = _device->create_graphics_pipeline(pipelineCreateInfo);
 
     vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
     vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
@@ -627,10 +415,11 @@ public:
 
   void update_ubo()
   {
-    matrix_ubo.cam = _manip.eye();
-    matrix_ubo.view = _manip.view_matrix();
-    matrix_ubo.model = tg::mat4::identity();
-    matrix_ubo.prj = tg::perspective<float>(fov, float(_w) / _h, 0.1, 1000);
+    auto &manip = manipulator();
+    matrix_ubo.cam = manip.eye();
+    matrix_ubo.view = manip.view_matrix();
+    matrix_ubo.model.identity();
+    matrix_ubo.prj = tg::perspective<float>(fov, float(width()) / height(), 0.1, 1000);
     // tg::near_clip(matrix_ubo.prj, tg::vec4(0, 0, -1, 0.5));
     uint8_t *data = 0;
     VK_CHECK_RESULT(vkMapMemory(*_device, _ubo_buf->memory(), 0, sizeof(matrix_ubo), 0, (void **)&data));
@@ -748,7 +537,7 @@ public:
       VkFence fence;
       VK_CHECK_RESULT(vkCreateFence(*_device, &fenceCreateInfo, nullptr, &fence));
 
-      VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo, fence));
+      VK_CHECK_RESULT(vkQueueSubmit(_device->graphic_queue(0), 1, &submitInfo, fence));
       VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
       vkDestroyFence(*_device, fence, nullptr);
       vkFreeCommandBuffers(*_device, _device->command_pool(), 1, &cmdBuffer);
@@ -761,24 +550,6 @@ public:
   }
 
 private:
-  std::shared_ptr<VulkanDevice> _device;
-  std::shared_ptr<VulkanSwapChain> _swapchain;
-
-  int _w, _h;
-  uint32_t _frame = 0;
-
-  VkRenderPass _render_pass = VK_NULL_HANDLE;
-  VulkanSwapChain::ImageUnit _depth;
-
-  VkSemaphore _presentSemaphore;
-  VkSemaphore _renderSemaphore;
-
-  VkQueue _queue;
-
-  std::vector<VkCommandBuffer> _cmd_bufs;
-  std::vector<VkFramebuffer> _frame_bufs;
-  std::vector<VkFence> _fences;
-
   VkBuffer _vert_buf;
   VkDeviceMemory _vert_mem;
   VkBuffer _index_buf;
@@ -798,34 +569,59 @@ private:
 
   uint32_t _vert_count = 0;
   uint32_t _index_count = 0;
-
-  Manipulator _manip;
 };
 
 
-int main(int argc, char** argv)
+int main(int argc, char **argv)
 {
-  SDL_Window* win = 0;
+  SDL_Window *win = 0;
   std::shared_ptr<Test> test;
-  try {
-    inst.initialize();
 
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
-      throw std::runtime_error("sdl init error.");
-    win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
-    if (win == nullptr)
-      throw std::runtime_error("could not create sdl window.");
+  // --headless WxH renders offscreen without SDL, e.g. on lavapipe
+  auto headless = VulkanView::arg_value(argc, argv, "--headless");
+  // --capture file.png|file.ppm keeps the last frame, only offscreen ones: a presented
+  // image belongs to the presentation engine
+  auto capture = VulkanView::arg_value(argc, argv, "--capture");
+  auto device = VulkanView::arg_value(argc, argv, "--device");
+  try {
+    if (capture && !headless)
+      throw std::runtime_error("--capture needs --headless.");
+    int w = 800, h = 600;
+    if (headless) {
+      if (sscanf(headless, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+        throw std::runtime_error("headless size must be WxH.");
+    } else {
+      if (SDL_Init(SDL_INIT_VIDEO) != 0)
+        throw std::runtime_error("sdl init error.");
+      win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, w, h, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+      if (win == nullptr)
+        throw std::runtime_error("could not create sdl window.");
+    }
 
     inst.enable_debug();
-    auto dev = inst.create_device();
+    auto dev = inst.create_device(device ? device : "");
 
     test = std::make_shared<Test>(dev);
-    test->set_window(win);
+    if (headless)
+      test->set_headless(w, h);
+    else
+      test->set_window(win);
 
-  } catch (std::runtime_error& e) {
+  } catch (std::runtime_error &e) {
     printf("%s", e.what());
     return -1;
   }
-  test->loop();
-  return 0;
-}
\ No newline at end of file
+
+  int result = 0;
+  VulkanView::Benchmark bench;
+  if (VulkanView::benchmark_args(argc, argv, bench))
+    result = test->benchmark(bench);
+  else if (headless)
+    test->render_frames(1);
+  else
+    test->frame(VulkanView::has_arg(argc, argv, "--continuous"));
+
+  if (capture && !test->save_image(capture))
+    result = 1;
+  return result;
+}
@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <exception>
 #include <stdexcept>
 
@@ -74,6 +75,18 @@ public:
 
     set_surface(surface, w, h);
 
+    create_pipeline();
+  }
+
+  void set_headless(int w, int h)
+  {
+    set_offscreen(w, h);
+
+    create_pipeline();
+  }
+
+  void create_pipeline()
+  {
     if(_mesh)
       _mesh->create_pipeline(render_pass());
 
@@ -111,23 +124,52 @@ int main(int argc, char **argv)
 {
   SDL_Window *win = 0;
   std::shared_ptr<Test> test;
+
+  // --headless WxH renders offscreen without SDL, e.g. on lavapipe
+  auto headless = VulkanView::arg_value(argc, argv, "--headless");
+  // --capture file.png|file.ppm keeps the last frame, only offscreen ones: a presented
+  // image belongs to the presentation engine
+  auto capture = VulkanView::arg_value(argc, argv, "--capture");
+  auto device = VulkanView::arg_value(argc, argv, "--device");
   try {
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
-      throw std::runtime_error("sdl init error.");
-    win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
-    if (win == nullptr)
-      throw std::runtime_error("could not create sdl window.");
+    if (capture && !headless)
+      throw std::runtime_error("--capture needs --headless.");
+    int w = 800, h = 600;
+    if (headless) {
+      if (sscanf(headless, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+        throw std::runtime_error("headless size must be WxH.");
+    } else {
+      if (SDL_Init(SDL_INIT_VIDEO) != 0)
+        throw std::runtime_error("sdl init error.");
+      win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, w, h, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+      if (win == nullptr)
+        throw std::runtime_error("could not create sdl window.");
+    }
 
     inst.enable_debug();
-    auto dev = inst.create_device();
+    auto dev = inst.create_device(device ? device : "");
 
     test = std::make_shared<Test>(dev);
-    test->set_window(win);
+    if (headless)
+      test->set_headless(w, h);
+    else
+      test->set_window(win);
 
   } catch (std::runtime_error &e) {
     printf("%s", e.what());
     return -1;
   }
-  test->frame();
-  return 0;
+
+  int result = 0;
+  VulkanView::Benchmark bench;
+  if (VulkanView::benchmark_args(argc, argv, bench))
+    result = test->benchmark(bench);
+  else if (headless)
+    test->render_frames(1);
+  else
+    test->frame(VulkanView::has_arg(argc, argv, "--continuous"));
+
+  if (capture && !test->save_image(capture))
+    result = 1;
+  return result;
 }
\ No newline at end of file
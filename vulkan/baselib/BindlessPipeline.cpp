@@ -0,0 +1,188 @@
+#include "BindlessPipeline.h"
+#include "VulkanMaterialTable.h"
+#include "VulkanPass.h"
+#include "VulkanTools.h"
+#include "VulkanPipelineLibrary.h"
+
+#include "tvec.h"
+#include "config.h"
+#include "RenderData.h"
+
+using tg::vec2;
+using tg::vec3;
+using tg::vec4;
+
+#define SHADER_DIR ROOT_DIR##"/vulkan/baselib/shaders"
+
+BindlessPipeline::BindlessPipeline(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<VulkanMaterialTable> &materials,
+                                   bool pull_vertices)
+  : PBRPipeline(dev)
+  , _materials(materials)
+  , _pull_vertices(pull_vertices && pull_supported(dev.get()))
+{
+  if (!_materials)
+    _materials = std::make_shared<VulkanMaterialTable>(dev);
+}
+
+BindlessPipeline::~BindlessPipeline()
+{
+}
+
+bool BindlessPipeline::pull_supported(VulkanDevice *dev)
+{
+  return dev->features12().bufferDeviceAddress;
+}
+
+void BindlessPipeline::realize(VulkanPass *render_pass, int subpass)
+{
+  auto pipe_lay = pipe_layout();
+
+  VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+  pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineCreateInfo.layout = pipe_lay;
+  pipelineCreateInfo.renderPass = render_pass ? VkRenderPass(*render_pass) : VK_NULL_HANDLE;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
+  inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+  rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
+  rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rasterizationState.depthClampEnable = VK_FALSE;
+  rasterizationState.rasterizerDiscardEnable = VK_FALSE;
+  rasterizationState.depthBiasEnable = VK_FALSE;
+  rasterizationState.lineWidth = 1.0f;
+
+  VkPipelineColorBlendAttachmentState blendAttachmentState[1] = {};
+  blendAttachmentState[0].colorWriteMask = 0xf;
+  blendAttachmentState[0].blendEnable = VK_FALSE;
+  VkPipelineColorBlendStateCreateInfo colorBlendState = {};
+  colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlendState.attachmentCount = 1;
+  colorBlendState.pAttachments = blendAttachmentState;
+
+  VkPipelineViewportStateCreateInfo viewportState = {};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  std::vector<VkDynamicState> dynamicStateEnables;
+  dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);
+  dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);
+  VkPipelineDynamicStateCreateInfo dynamicState = {};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.pDynamicStates = dynamicStateEnables.data();
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+
+  VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
+  depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencilState.depthTestEnable = VK_TRUE;
+  depthStencilState.depthWriteEnable = VK_TRUE;
+  depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+  depthStencilState.depthBoundsTestEnable = VK_FALSE;
+  depthStencilState.back.failOp = VK_STENCIL_OP_KEEP;
+  depthStencilState.back.passOp = VK_STENCIL_OP_KEEP;
+  depthStencilState.back.compareOp = VK_COMPARE_OP_ALWAYS;
+  depthStencilState.stencilTestEnable = VK_FALSE;
+  depthStencilState.front = depthStencilState.back;
+
+  VkPipelineMultisampleStateCreateInfo multisampleState = {};
+  multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+  multisampleState.pSampleMask = nullptr;
+
+  VkVertexInputBindingDescription vertexInputBindings[3] = {};
+  vertexInputBindings[0].binding = 0;  // vkCmdBindVertexBuffers
+  vertexInputBindings[0].stride = sizeof(vec3);
+  vertexInputBindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  vertexInputBindings[1].binding = 1;  // vkCmdBindVertexBuffers
+  vertexInputBindings[1].stride = sizeof(vec3);
+  vertexInputBindings[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  vertexInputBindings[2].binding = 2;
+  vertexInputBindings[2].stride = sizeof(vec2);
+  vertexInputBindings[2].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  VkVertexInputAttributeDescription vertexInputAttributs[3] = {};
+  vertexInputAttributs[0].binding = 0;
+  vertexInputAttributs[0].location = 0;
+  vertexInputAttributs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+  vertexInputAttributs[0].offset = 0;
+  vertexInputAttributs[1].binding = 1;
+  vertexInputAttributs[1].location = 1;
+  vertexInputAttributs[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+  vertexInputAttributs[1].offset = 0;
+  vertexInputAttributs[2].binding = 2;
+  vertexInputAttributs[2].location = 2;
+  vertexInputAttributs[2].format = VK_FORMAT_R32G32_SFLOAT; 
+  vertexInputAttributs[2].offset = 0;
+
+  VkPipelineVertexInputStateCreateInfo vertexInputState = {};
+  vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputState.vertexBindingDescriptionCount = 3;
+  vertexInputState.pVertexBindingDescriptions = vertexInputBindings;
+  vertexInputState.vertexAttributeDescriptionCount = 3;
+  vertexInputState.pVertexAttributeDescriptions = vertexInputAttributs;
+  if (_pull_vertices) {
+    vertexInputState.vertexBindingDescriptionCount = 0;
+    vertexInputState.vertexAttributeDescriptionCount = 0;
+  }
+
+  VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+  shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStages[0].module = _device->pipelines()->shader(vertex_shader());
+  shaderStages[0].pName = "main";
+  assert(shaderStages[0].module != VK_NULL_HANDLE);
+
+  shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStages[1].module = _device->pipelines()->shader(SHADER_DIR "/pbr_bindless.frag.spv");
+  shaderStages[1].pName = "main";
+  assert(shaderStages[1].module != VK_NULL_HANDLE);
+
+  pipelineCreateInfo.stageCount = 2;
+  pipelineCreateInfo.pStages = shaderStages;
+
+  pipelineCreateInfo.pVertexInputState = &vertexInputState;
+  pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+  pipelineCreateInfo.pRasterizationState = &rasterizationState;
+  pipelineCreateInfo.pColorBlendState = &colorBlendState;
+  pipelineCreateInfo.pMultisampleState = &multisampleState;
+  pipelineCreateInfo.pViewportState = &viewportState;
+  pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+  pipelineCreateInfo.pDynamicState = &dynamicState;
+  pipelineCreateInfo.subpass = subpass;
+
+  compile(pipelineCreateInfo);
+}
+
+const char *BindlessPipeline::vertex_shader()
+{
+  return _pull_vertices ? SHADER_DIR "/pbr_pulled.vert.spv" : SHADER_DIR "/pbr_bindless.vert.spv";
+}
+
+VkPipelineLayout BindlessPipeline::create_pipe_layout()
+{
+  VkDescriptorSetLayout layouts[3] = {matrix_layout(), light_layout(), _materials->layout()};
+
+  VkPushConstantRange transformConstants;
+  transformConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  transformConstants.offset = 0;
+  transformConstants.size = _pull_vertices ? sizeof(PulledTransform) : sizeof(BindlessTransform);
+
+  VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
+  pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pPipelineLayoutCreateInfo.pNext = nullptr;
+  pPipelineLayoutCreateInfo.setLayoutCount = 3;
+  pPipelineLayoutCreateInfo.pSetLayouts = layouts;
+  pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+  pPipelineLayoutCreateInfo.pPushConstantRanges = &transformConstants;
+
+  VkPipelineLayout pipe_layout = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(*_device, &pPipelineLayoutCreateInfo, nullptr, &pipe_layout));
+
+  return pipe_layout;
+}
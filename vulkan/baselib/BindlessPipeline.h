@@ -0,0 +1,37 @@
+#pragma once
+
+#include "PBRPipeline.h"
+
+class VulkanMaterialTable;
+
+// Textured PBR without per-draw descriptor updates: set 2 is the material table and
+// each draw pushes a BindlessTransform carrying its material index.
+// Only usable when VulkanMaterialTable::supported(), TexturePipeline is the fallback.
+// With pull_vertices there is no vertex input state, the shader reads the attributes
+// through the buffer addresses in a PulledTransform, so any mesh layout fits.
+class BindlessPipeline : public PBRPipeline {
+public:
+  BindlessPipeline(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<VulkanMaterialTable> &materials = nullptr,
+                   bool pull_vertices = false);
+  ~BindlessPipeline();
+
+  static bool pull_supported(VulkanDevice *dev);
+
+  void realize(VulkanPass *render_pass, int subpass = 0);
+
+  const std::shared_ptr<VulkanMaterialTable> &materials() { return _materials; }
+
+  bool pulls_vertices() { return _pull_vertices; }
+
+protected:
+
+  VkPipelineLayout create_pipe_layout();
+
+  virtual const char *vertex_shader();
+
+protected:
+
+  std::shared_ptr<VulkanMaterialTable> _materials;
+
+  bool _pull_vertices = false;
+};
@@ -1,6 +1,7 @@
 #include "DepthPersPipeline.h"
 #include "VulkanPass.h"
 #include "VulkanTools.h"
+#include "VulkanPipelineLibrary.h"
 
 #include "config.h"
 #include "tvec.h"
@@ -20,7 +21,7 @@ DepthPersPipeline::~DepthPersPipeline()
 {
   if (_texture_layout)
   {
-    vkDestroyDescriptorSetLayout(*_device, _texture_layout, 0);
+    destroy_layout(_texture_layout);
     _texture_layout = VK_NULL_HANDLE;
   }
 }
@@ -30,7 +31,7 @@ void DepthPersPipeline::realize(VulkanPass *render_pass, int subpass)
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipe_layout();
-  pipelineCreateInfo.renderPass = *render_pass;
+  pipelineCreateInfo.renderPass = render_pass ? VkRenderPass(*render_pass) : VK_NULL_HANDLE;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
   inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -111,13 +112,13 @@ void DepthPersPipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/depth_pers.vert.spv");
+  shaderStages[0].module = _device->pipelines()->shader(SHADER_DIR "/depth_pers.vert.spv");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/depth_pers.frag.spv");
+  shaderStages[1].module = _device->pipelines()->shader(SHADER_DIR "/depth_pers.frag.spv");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -134,10 +135,7 @@ void DepthPersPipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pDynamicState = 0;
   pipelineCreateInfo.subpass = subpass;
 
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
-
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  compile(pipelineCreateInfo);
 }
 
 VkPipelineLayout DepthPersPipeline::pipe_layout()
@@ -0,0 +1,61 @@
+#include "Frustum.h"
+
+#include "tmath.h"
+
+#include <algorithm>
+
+Frustum::Frustum()
+{
+  // no planes that cull anything
+  for (int i = 0; i < 6; i++) {
+    _x[i] = _y[i] = _z[i] = 0;
+    _w[i] = 1;
+  }
+}
+
+Frustum::Frustum(const tg::mat4 &view_proj)
+{
+  tg::vec4 p[6];
+  tg::view_planes(view_proj, p[0], p[1], p[2], p[3], p[4], p[5]);
+
+  // normalized, so the distance of a center compares with the radius
+  for (int i = 0; i < 6; i++) {
+    float len = tg::length(tg::vec3(p[i][0], p[i][1], p[i][2]));
+    if (len <= 0)
+      len = 1;
+    _x[i] = p[i][0] / len;
+    _y[i] = p[i][1] / len;
+    _z[i] = p[i][2] / len;
+    _w[i] = p[i][3] / len;
+  }
+}
+
+CullFrustum Frustum::planes() const
+{
+  CullFrustum frustum;
+  for (int i = 0; i < 6; i++)
+    frustum.planes[i] = tg::vec4(_x[i], _y[i], _z[i], _w[i]);
+  return frustum;
+}
+
+void Frustum::test(const float *x, const float *y, const float *z, const float *r, uint32_t count, uint8_t *visible) const
+{
+  // plane by plane over the batch without branches, the inner loop vectorizes
+  for (uint32_t i = 0; i < count; i++)
+    visible[i] = 1;
+
+  for (int p = 0; p < 6; p++) {
+    const float px = _x[p], py = _y[p], pz = _z[p], pw = _w[p];
+    for (uint32_t i = 0; i < count; i++)
+      visible[i] &= uint8_t(px * x[i] + py * y[i] + pz * z[i] + pw + r[i] >= 0);
+  }
+}
+
+tg::vec4 Frustum::transform(const tg::vec4 &sphere, const tg::mat4 &m)
+{
+  // the largest axis scale keeps the sphere around the primitive under any scaling
+  auto center = m * tg::vec4(sphere[0], sphere[1], sphere[2], 1.f);
+  float scale = std::max({tg::length(tg::vec3(m[0][0], m[0][1], m[0][2])), tg::length(tg::vec3(m[1][0], m[1][1], m[1][2])),
+                          tg::length(tg::vec3(m[2][0], m[2][1], m[2][2]))});
+  return tg::vec4(center[0], center[1], center[2], sphere[3] * scale);
+}
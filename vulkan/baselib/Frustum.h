@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include "tvec.h"
+#include "RenderData.h"
+
+// The 6 planes of a clip space in world space, normalized with inward normals. They are
+// kept as one array per component, so test() runs the same few multiply adds over a whole
+// batch of spheres, which the compiler turns into SIMD code. For the perspective shadow map
+// the planes of mvp * pers hold for everything in front of the perspective's eye.
+class Frustum {
+public:
+  Frustum();
+  explicit Frustum(const tg::mat4 &view_proj);
+
+  // the planes as the cull shader of VulkanIndirectScene reads them
+  CullFrustum planes() const;
+
+  // visible[i] is whether the sphere (x[i], y[i], z[i]) of radius r[i] is not entirely
+  // behind a plane; may keep spheres just outside a corner
+  void test(const float *x, const float *y, const float *z, const float *r, uint32_t count, uint8_t *visible) const;
+
+  // a sphere of the space of m in the space m maps to, grown by the largest axis scale
+  static tg::vec4 transform(const tg::vec4 &sphere, const tg::mat4 &m);
+
+private:
+  float _x[6], _y[6], _z[6], _w[6];
+};
@@ -1,6 +1,7 @@
 #include "HUDPipeline.h"
 #include "VulkanPass.h"
 #include "VulkanTools.h"
+#include "VulkanPipelineLibrary.h"
 
 #include "config.h"
 #include "tvec.h"
@@ -19,7 +20,7 @@ HUDPipeline::~HUDPipeline()
 {
   if (_hud_tex_layout)
   {
-    vkDestroyDescriptorSetLayout(*_device, _hud_tex_layout, 0);
+    destroy_layout(_hud_tex_layout);
     _hud_tex_layout = VK_NULL_HANDLE;
   }
 }
@@ -29,7 +30,7 @@ void HUDPipeline::realize(VulkanPass *render_pass, int subpass)
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipe_layout();
-  pipelineCreateInfo.renderPass = *render_pass;
+  pipelineCreateInfo.renderPass = render_pass ? VkRenderPass(*render_pass) : VK_NULL_HANDLE;
 
   std::vector<VkDynamicState> dynamicStateEnables;
   dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);
@@ -112,13 +113,13 @@ void HUDPipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/hud.vert.spv");
+  shaderStages[0].module = _device->pipelines()->shader(SHADER_DIR "/hud.vert.spv");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/hud.frag.spv");
+  shaderStages[1].module = _device->pipelines()->shader(SHADER_DIR "/hud.frag.spv");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -135,10 +136,7 @@ void HUDPipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pViewportState = &viewportState;
   pipelineCreateInfo.subpass = 0;
 
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
-
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  compile(pipelineCreateInfo);
 }
 
 VkDescriptorSetLayout HUDPipeline::texture_layout()
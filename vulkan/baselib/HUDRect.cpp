@@ -4,6 +4,8 @@
 #include "VulkanTools.h"
 #include "VulkanTexture.h"
 #include "VulkanBuffer.h"
+#include "VulkanTransfer.h"
+#include "VulkanDescriptorAllocator.h"
 
 HUDRect::HUDRect(const std::shared_ptr<VulkanDevice>& dev) : _device(dev)
 {
@@ -11,6 +13,10 @@ HUDRect::HUDRect(const std::shared_ptr<VulkanDevice>& dev) : _device(dev)
 
 HUDRect::~HUDRect()
 {
+  if (_set) {
+    _device->descriptors()->release(_layout, _set);
+    _set = VK_NULL_HANDLE;
+  }
 }
 
 void HUDRect::setGeometry(float x, float y, float w, float h)
@@ -33,22 +39,17 @@ void HUDRect::setGeometry(float x, float y, float w, float h)
   int n = vs.size() * sizeof(tg::vec2);
 
   auto dst = _device->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, n, 0);
-  auto ori = _device->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, n, vs.data());
-  _device->copy_buffer(ori.get(), dst.get(), _device->transfer_queue());
+  _device->transfer()->upload_buffer(dst.get(), vs.data(), n, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 
   _buffer = dst;
 }
 
-void HUDRect::setTexture(HUDPipeline *pipeline, VulkanTexture *tex, VkDescriptorPool pool)
+void HUDRect::setTexture(HUDPipeline *pipeline, VulkanTexture *tex)
 {
-  auto des_layout = pipeline->texture_layout();
-  VkDescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.descriptorPool = pool;
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &des_layout;
-
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*_device, &allocInfo, &_set));
+  if (_set)
+    _device->descriptors()->release(_layout, _set);
+  _layout = pipeline->texture_layout();
+  _set = _device->descriptors()->allocate(_layout);
 
   auto descriptor = tex->descriptor();
 
@@ -12,7 +12,7 @@ public:
 
   void setGeometry(float x, float y, float w, float h);
 
-  void setTexture(HUDPipeline *pipeline, VulkanTexture *tex, VkDescriptorPool pool);
+  void setTexture(HUDPipeline *pipeline, VulkanTexture *tex);
 
   void fill_command(VkCommandBuffer cmdbuf, HUDPipeline *pipeline);
 
@@ -21,5 +21,6 @@ private:
 
   std::shared_ptr<VulkanBuffer> _buffer;
 
-  VkDescriptorSet _set;
+  VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+  VkDescriptorSet _set = VK_NULL_HANDLE;
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include "IndirectPipeline.h"
+#include "VulkanIndirectScene.h"
+#include "VulkanMaterialTable.h"
+#include "VulkanTools.h"
+
+#include "config.h"
+
+#define SHADER_DIR ROOT_DIR##"/vulkan/baselib/shaders"
+
+IndirectPipeline::IndirectPipeline(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<VulkanIndirectScene> &scene,
+                                   const std::shared_ptr<VulkanMaterialTable> &materials)
+  : BindlessPipeline(dev, materials)
+  , _scene(scene)
+{
+}
+
+IndirectPipeline::~IndirectPipeline()
+{
+}
+
+const char *IndirectPipeline::vertex_shader()
+{
+  return SHADER_DIR "/pbr_indirect.vert.spv";
+}
+
+VkPipelineLayout IndirectPipeline::create_pipe_layout()
+{
+  VkDescriptorSetLayout layouts[4] = {matrix_layout(), light_layout(), _materials->layout(), _scene->draw_layout()};
+
+  VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
+  pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pPipelineLayoutCreateInfo.pNext = nullptr;
+  pPipelineLayoutCreateInfo.setLayoutCount = 4;
+  pPipelineLayoutCreateInfo.pSetLayouts = layouts;
+
+  VkPipelineLayout pipe_layout = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(*_device, &pPipelineLayoutCreateInfo, nullptr, &pipe_layout));
+
+  return pipe_layout;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "BindlessPipeline.h"
+
+class VulkanIndirectScene;
+
+// BindlessPipeline for the draws of a VulkanIndirectScene: set 3 holds the scene's draw
+// records, and the vertex shader takes the transform and material of a draw from the
+// record its first instance points at, so nothing is pushed or bound per draw.
+class IndirectPipeline : public BindlessPipeline {
+public:
+  IndirectPipeline(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<VulkanIndirectScene> &scene,
+                   const std::shared_ptr<VulkanMaterialTable> &materials = nullptr);
+  ~IndirectPipeline();
+
+  const std::shared_ptr<VulkanIndirectScene> &scene() { return _scene; }
+
+protected:
+
+  VkPipelineLayout create_pipe_layout();
+
+  const char *vertex_shader();
+
+protected:
+
+  std::shared_ptr<VulkanIndirectScene> _scene;
+};
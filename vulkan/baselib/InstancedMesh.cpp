@@ -0,0 +1,180 @@
+#include "InstancedMesh.h"
+#include "InstancedPipeline.h"
+#include "MeshInstance.h"
+#include "MeshPrimitive.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTexture.h"
+#include "VulkanProfiler.h"
+#include "VulkanMaterialTable.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+InstancedMesh::InstancedMesh(uint32_t max_instances) : _max_instances(max_instances)
+{
+}
+
+InstancedMesh::~InstancedMesh()
+{
+  if (_set)
+    _device->descriptors()->release(_layout, _set);
+  if (_data)
+    _buf->unmap();
+}
+
+void InstancedMesh::add_primitive(std::shared_ptr<MeshPrimitive> &pri)
+{
+  _pris.push_back(pri);
+  _transforms.push_back(pri->transform());
+}
+
+void InstancedMesh::add_primitives(const std::shared_ptr<MeshInstance> &mesh)
+{
+  for (auto &pri : mesh->primitives()) {
+    _pris.push_back(pri);
+    _transforms.push_back(mesh->transform() * pri->transform());
+  }
+}
+
+uint32_t InstancedMesh::add_instance(const tg::mat4 &m, uint32_t material)
+{
+  if (_instances.size() >= _max_instances)
+    throw std::runtime_error("too many instances in the instanced mesh.");
+
+  InstanceData instance = {};
+  instance.m = m;
+  instance.material = material;
+  _instances.push_back(instance);
+
+  uint32_t i = static_cast<uint32_t>(_instances.size() - 1);
+  changed(i, i + 1);
+  return i;
+}
+
+void InstancedMesh::set_instances(const std::vector<tg::mat4> &transforms, const std::vector<uint32_t> &materials)
+{
+  if (transforms.size() > _max_instances)
+    throw std::runtime_error("too many instances in the instanced mesh.");
+
+  _instances.resize(transforms.size());
+  for (size_t i = 0; i < transforms.size(); i++) {
+    _instances[i].m = transforms[i];
+    _instances[i].material = i < materials.size() ? materials[i] : no_material;
+  }
+  changed(0, static_cast<uint32_t>(_instances.size()));
+}
+
+void InstancedMesh::set_transform(uint32_t instance, const tg::mat4 &m)
+{
+  assert(instance < _instances.size());
+  _instances[instance].m = m;
+  changed(instance, instance + 1);
+}
+
+void InstancedMesh::set_material(uint32_t instance, uint32_t material)
+{
+  assert(instance < _instances.size());
+  _instances[instance].material = material;
+  changed(instance, instance + 1);
+}
+
+void InstancedMesh::changed(uint32_t begin, uint32_t end)
+{
+  // one range per region, scattered changes copy the records between them as well
+  for (auto &range : _dirty) {
+    if (range.begin >= range.end) {
+      range = {begin, end};
+    } else {
+      range.begin = std::min(range.begin, begin);
+      range.end = std::max(range.end, end);
+    }
+  }
+}
+
+void InstancedMesh::realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<InstancedPipeline> &pipeline, uint32_t frames)
+{
+  _device = dev;
+
+  auto &materials = pipeline->materials();
+  _material_ids.resize(_pris.size());
+  for (int i = 0; i < _pris.size(); i++) {
+    auto &pri = _pris[i];
+    pri->realize(dev);
+    auto &tex = pri->material().albedo_tex;
+    if (tex)
+      tex->realize(dev);
+    _material_ids[i] = materials->add(pri->material());
+  }
+
+  // regions start at offsets a dynamic storage buffer can be bound at
+  VkDeviceSize alignment = std::max<VkDeviceSize>(dev->limits().minStorageBufferOffsetAlignment, 1);
+  _region_size = (_max_instances * sizeof(InstanceData) + alignment - 1) & ~(alignment - 1);
+
+  _buf = dev->create_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            _region_size * frames);
+  _data = _buf->map();
+
+  _dirty.assign(frames, Range{0, static_cast<uint32_t>(_instances.size())});
+  for (uint32_t frame = 0; frame < frames; frame++)
+    update(frame);
+
+  _layout = pipeline->instance_layout();
+  _set = dev->descriptors()->allocate(_layout);
+
+  VkDescriptorBufferInfo descriptor = {*_buf, 0, _max_instances * sizeof(InstanceData)};
+  auto write = vks::initializers::writeDescriptorSet(_set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0, &descriptor);
+  vkUpdateDescriptorSets(*dev, 1, &write, 0, nullptr);
+}
+
+void InstancedMesh::update(uint32_t frame)
+{
+  assert(frame < _dirty.size());
+
+  auto &range = _dirty[frame];
+  if (range.begin < range.end) {
+    uint32_t end = std::min(range.end, static_cast<uint32_t>(_instances.size()));
+    if (range.begin < end)
+      memcpy(_data + frame * _region_size + range.begin * sizeof(InstanceData), _instances.data() + range.begin,
+             (end - range.begin) * sizeof(InstanceData));
+  }
+  range = {};
+}
+
+void InstancedMesh::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<InstancedPipeline> &pipeline, uint32_t frame)
+{
+  if (!pipeline || !pipeline->valid() || _instances.empty())
+    return;
+
+  auto profiler = _device->profiler();
+  profiler->begin(cmd_buf, "mesh instanced");
+
+  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
+
+  VkDescriptorSet sets[2] = {pipeline->materials()->descriptor_set(), _set};
+  uint32_t offset = static_cast<uint32_t>(frame * _region_size);
+  vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipe_layout(), 2, 2, sets, 1, &offset);
+
+  uint32_t count = static_cast<uint32_t>(_instances.size());
+  for (uint32_t i = 0; i < _pris.size(); i++) {
+    auto &pri = _pris[i];
+
+    BindlessTransform pc;
+    pc.m = _transforms[i];
+    pc.material = _material_ids[i];
+    vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pc), &pc);
+
+    VkBuffer bufs[3] = {*pri->_vertex_buf, *pri->_normal_buf, *pri->_uv_buf};
+    VkDeviceSize offsets[3] = {0, 0, 0};
+    vkCmdBindVertexBuffers(cmd_buf, 0, 3, bufs, offsets);
+    vkCmdBindIndexBuffer(cmd_buf, *pri->_index_buf, 0, VK_INDEX_TYPE_UINT16);
+    vkCmdDrawIndexed(cmd_buf, pri->index_count(), count, 0, 0, 0);
+  }
+
+  profiler->end(cmd_buf);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <vector>
+
+#include "tvec.h"
+#include "RenderData.h"
+
+class VulkanDevice;
+class VulkanBuffer;
+class MeshPrimitive;
+class MeshInstance;
+class InstancedPipeline;
+
+// Many copies of the same primitives, each primitive drawn once for all of them with an
+// instanced draw. The InstanceData records live in one persistently mapped buffer with a
+// region per frame in flight, update() copies only the records changed since the region
+// of a frame was last written, so moving a few instances costs a few copies and never
+// touches memory a pending frame reads. Adding instances changes the recorded instance
+// count, moving them or changing their materials does not.
+class InstancedMesh {
+public:
+  // keeps the material of the primitive
+  static constexpr uint32_t no_material = ~0u;
+
+  InstancedMesh(uint32_t max_instances = 4096);
+  ~InstancedMesh();
+
+  void add_primitive(std::shared_ptr<MeshPrimitive> &pri);
+
+  // the primitives of a loaded mesh, its transform goes in front of the primitives'
+  void add_primitives(const std::shared_ptr<MeshInstance> &mesh);
+
+  uint32_t add_instance(const tg::mat4 &m, uint32_t material = no_material);
+
+  // replaces the instances, those without a material keep the ones of the primitives
+  void set_instances(const std::vector<tg::mat4> &transforms, const std::vector<uint32_t> &materials = {});
+
+  void set_transform(uint32_t instance, const tg::mat4 &m);
+
+  // an index into the material table of the pipeline, e.g. from materials()->add()
+  void set_material(uint32_t instance, uint32_t material);
+
+  uint32_t instance_count() { return static_cast<uint32_t>(_instances.size()); }
+
+  // the table index the material of a primitive got in realize
+  uint32_t material_id(uint32_t primitive) { return _material_ids[primitive]; }
+
+  // frames is the number of frames recorded and in flight, e.g. the swapchain images
+  void realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<InstancedPipeline> &pipeline, uint32_t frames);
+
+  // call once the fence of the frame has signaled, before it is submitted again
+  void update(uint32_t frame);
+
+  // sets 0 and 1 are bound by the caller; reads the region of the frame
+  void build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<InstancedPipeline> &pipeline, uint32_t frame);
+
+private:
+  void changed(uint32_t begin, uint32_t end);
+
+private:
+  std::shared_ptr<VulkanDevice> _device;
+
+  uint32_t _max_instances = 0;
+
+  std::vector<std::shared_ptr<MeshPrimitive>> _pris;
+  // of the primitives, pushed for all instances
+  std::vector<tg::mat4> _transforms;
+  std::vector<uint32_t> _material_ids;
+
+  std::vector<InstanceData> _instances;
+
+  // the records each region is missing, one range per frame
+  struct Range {
+    uint32_t begin = 0, end = 0;
+  };
+  std::vector<Range> _dirty;
+
+  std::shared_ptr<VulkanBuffer> _buf;
+  uint8_t *_data = nullptr;
+  VkDeviceSize _region_size = 0;
+
+  VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+  VkDescriptorSet _set = VK_NULL_HANDLE;
+};
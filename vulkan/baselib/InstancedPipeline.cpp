@@ -0,0 +1,53 @@
+#include "InstancedPipeline.h"
+#include "VulkanDevice.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanMaterialTable.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+#include "config.h"
+#include "RenderData.h"
+
+#define SHADER_DIR ROOT_DIR##"/vulkan/baselib/shaders"
+
+InstancedPipeline::InstancedPipeline(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<VulkanMaterialTable> &materials)
+  : BindlessPipeline(dev, materials)
+{
+  auto binding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0);
+  auto layoutInfo = vks::initializers::descriptorSetLayoutCreateInfo(&binding, 1);
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*dev, &layoutInfo, nullptr, &_instance_layout));
+}
+
+InstancedPipeline::~InstancedPipeline()
+{
+  _device->descriptors()->forget(_instance_layout);
+  vkDestroyDescriptorSetLayout(*_device, _instance_layout, nullptr);
+}
+
+const char *InstancedPipeline::vertex_shader()
+{
+  return SHADER_DIR "/pbr_instanced.vert.spv";
+}
+
+VkPipelineLayout InstancedPipeline::create_pipe_layout()
+{
+  VkDescriptorSetLayout layouts[4] = {matrix_layout(), light_layout(), _materials->layout(), _instance_layout};
+
+  VkPushConstantRange transformConstants;
+  transformConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  transformConstants.offset = 0;
+  transformConstants.size = sizeof(BindlessTransform);
+
+  VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
+  pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pPipelineLayoutCreateInfo.pNext = nullptr;
+  pPipelineLayoutCreateInfo.setLayoutCount = 4;
+  pPipelineLayoutCreateInfo.pSetLayouts = layouts;
+  pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+  pPipelineLayoutCreateInfo.pPushConstantRanges = &transformConstants;
+
+  VkPipelineLayout pipe_layout = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(*_device, &pPipelineLayoutCreateInfo, nullptr, &pipe_layout));
+
+  return pipe_layout;
+}
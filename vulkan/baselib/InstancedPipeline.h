@@ -0,0 +1,25 @@
+#pragma once
+
+#include "BindlessPipeline.h"
+
+// BindlessPipeline for the instanced draws of an InstancedMesh: set 3 holds the mesh's
+// InstanceData records, bound with a dynamic offset selecting the copy of a frame. The
+// pushed BindlessTransform is the primitive's, the record's transform goes in front of it
+// and its material replaces the pushed one unless it is InstancedMesh::no_material.
+class InstancedPipeline : public BindlessPipeline {
+public:
+  InstancedPipeline(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<VulkanMaterialTable> &materials = nullptr);
+  ~InstancedPipeline();
+
+  VkDescriptorSetLayout instance_layout() { return _instance_layout; }
+
+protected:
+
+  VkPipelineLayout create_pipe_layout();
+
+  const char *vertex_shader();
+
+protected:
+
+  VkDescriptorSetLayout _instance_layout = VK_NULL_HANDLE;
+};
@@ -3,11 +3,20 @@
 #include "VulkanTools.h"
 #include "VulkanDevice.h"
 #include "VulkanBuffer.h"
+#include "VulkanTransfer.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanProfiler.h"
+#include "VulkanCommandPools.h"
 #include "MeshPrimitive.h"
 #include "VulkanTexture.h"
 #include "VulkanInitializers.hpp"
 #include "TexturePipeline.h"
 #include "DepthPersPipeline.h"
+#include "BindlessPipeline.h"
+#include "IndirectPipeline.h"
+#include "VulkanIndirectScene.h"
+#include "VulkanMaterialTable.h"
+#include "Frustum.h"
 
 #include "tvec.h"
 #include "config.h"
@@ -23,7 +32,7 @@ MeshInstance::MeshInstance()
 MeshInstance::~MeshInstance()
 {
   if(_pbr_set) {
-    vkFreeDescriptorSets(*_device, _device->get_or_create_descriptor_pool(), 1, &_pbr_set);
+    _device->descriptors()->release(_pbr_layout, _pbr_set);
     _pbr_set = VK_NULL_HANDLE;
   }
 }
@@ -31,10 +40,22 @@ MeshInstance::~MeshInstance()
 void MeshInstance::set_transform(const tg::mat4 &transform)
 {
   _transform = transform;
+  update_bounds();
+
+  for (uint32_t i = 0; i < _draw_ids.size(); i++)
+    _scene->set_transform(_draw_ids[i], _transform * _pris[i]->transform());
 }
 
 void MeshInstance::add_primitive(std::shared_ptr<MeshPrimitive>& pri) {
   _pris.emplace_back(pri);
+  for (auto &visible : _visible)
+    visible.push_back(1);
+
+  auto sphere = Frustum::transform(pri->sphere(), _transform * pri->transform());
+  _bound_x.push_back(sphere[0]);
+  _bound_y.push_back(sphere[1]);
+  _bound_z.push_back(sphere[2]);
+  _bound_r.push_back(sphere[3]);
 
   auto &m = pri->material();
   //if (m.tex) {
@@ -61,6 +82,36 @@ void MeshInstance::add_primitive(std::shared_ptr<MeshPrimitive>& pri) {
   //}
 }
 
+void MeshInstance::update_bounds()
+{
+  // the bounds of the primitives are fixed once loaded, only the transforms move them
+  for (size_t i = 0; i < _pris.size(); i++) {
+    auto sphere = Frustum::transform(_pris[i]->sphere(), _transform * _pris[i]->transform());
+    _bound_x[i] = sphere[0];
+    _bound_y[i] = sphere[1];
+    _bound_z[i] = sphere[2];
+    _bound_r[i] = sphere[3];
+  }
+}
+
+bool MeshInstance::cull(const Frustum &frustum, View view)
+{
+  auto &visible = _visible[view];
+  std::vector<uint8_t> culled(visible.size());
+  frustum.test(_bound_x.data(), _bound_y.data(), _bound_z.data(), _bound_r.data(), static_cast<uint32_t>(culled.size()),
+               culled.data());
+  if (culled == visible)
+    return false;
+
+  visible.swap(culled);
+  return true;
+}
+
+void MeshInstance::uncull(View view)
+{
+  _visible[view].assign(_pris.size(), 1);
+}
+
 void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev)
 {
   _device = dev;
@@ -86,19 +137,14 @@ void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev, const std::
     memcpy(&pbr, &m.pbrdata, sizeof(PBRBase));
   }
   uint32_t sz = pbrdata.size() * sizeof(PBRBase);
-  auto ori_buf = dev->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, sz, pbrdata.data());
   auto dst_buf = dev->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sz, 0);
-  dev->copy_buffer(ori_buf.get(), dst_buf.get(), dev->transfer_queue());
+  dev->transfer()->upload_buffer(dst_buf.get(), pbrdata.data(), sz, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_UNIFORM_READ_BIT);
   _pbr_buf = dst_buf;
 
-  auto layout = pipeline->pbr_layout();
-  VkDescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.descriptorPool = _device->get_or_create_descriptor_pool();
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &layout;
-
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*_device, &allocInfo, &_pbr_set));
+  if (_pbr_set)
+    _device->descriptors()->release(_pbr_layout, _pbr_set);
+  _pbr_layout = pipeline->pbr_layout();
+  _pbr_set = _device->descriptors()->allocate(_pbr_layout);
 
   VkDescriptorBufferInfo descriptor = {};
   descriptor.buffer = *_pbr_buf;
@@ -115,14 +161,139 @@ void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev, const std::
   vkUpdateDescriptorSets(*_device, 1, &writeDescriptorSet, 0, nullptr);
 }
 
+void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<BindlessPipeline> &pipeline)
+{
+  realize(dev);
+
+  auto &materials = pipeline->materials();
+  _material_ids.resize(_pris.size());
+  for (int i = 0; i < _pris.size(); i++)
+    _material_ids[i] = materials->add(_pris[i]->material());
+}
+
+void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<IndirectPipeline> &pipeline)
+{
+  // the scene keeps its own copy of the geometry, only the textures are needed here
+  _device = dev;
+  for (auto &pri : _pris) {
+    auto &tex = pri->material().albedo_tex;
+    if (tex)
+      tex->realize(dev);
+  }
+
+  auto &materials = pipeline->materials();
+  _scene = pipeline->scene();
+  _material_ids.resize(_pris.size());
+  _draw_ids.resize(_pris.size());
+  for (int i = 0; i < _pris.size(); i++) {
+    _material_ids[i] = materials->add(_pris[i]->material());
+    _draw_ids[i] = _scene->add(_pris[i], _material_ids[i], _transform * _pris[i]->transform());
+  }
+}
+
+template <typename Pipeline>
+void MeshInstance::record_parallel(VkCommandBuffer cmd_buf, uint32_t frame, const std::shared_ptr<Pipeline> &pipeline,
+                                   const VkCommandBufferInheritanceInfo &inheritance, const std::function<void(VkCommandBuffer)> &setup)
+{
+  if (!pipeline || !pipeline->valid())
+    return;
+
+  // no timestamps here, a subpass of secondary buffers only takes vkCmdExecuteCommands
+  auto cmds = _device->commands()->record_secondary(frame, inheritance, static_cast<uint32_t>(_pris.size()),
+    [&](VkCommandBuffer cmd, uint32_t begin, uint32_t end) {
+      if (setup)
+        setup(cmd);
+      bind(cmd, pipeline);
+      draw(cmd, pipeline, begin, end);
+    });
+  if (!cmds.empty())
+    vkCmdExecuteCommands(cmd_buf, static_cast<uint32_t>(cmds.size()), cmds.data());
+}
+
+template void MeshInstance::record_parallel(VkCommandBuffer, uint32_t, const std::shared_ptr<VulkanPipeline> &,
+                                            const VkCommandBufferInheritanceInfo &, const std::function<void(VkCommandBuffer)> &);
+template void MeshInstance::record_parallel(VkCommandBuffer, uint32_t, const std::shared_ptr<TexturePipeline> &,
+                                            const VkCommandBufferInheritanceInfo &, const std::function<void(VkCommandBuffer)> &);
+template void MeshInstance::record_parallel(VkCommandBuffer, uint32_t, const std::shared_ptr<DepthPersPipeline> &,
+                                            const VkCommandBufferInheritanceInfo &, const std::function<void(VkCommandBuffer)> &);
+template void MeshInstance::record_parallel(VkCommandBuffer, uint32_t, const std::shared_ptr<BindlessPipeline> &,
+                                            const VkCommandBufferInheritanceInfo &, const std::function<void(VkCommandBuffer)> &);
+
 void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<VulkanPipeline> &pipeline)
 {
   if (!pipeline || !pipeline->valid())
     return;
 
+  auto profiler = _device->profiler();
+  profiler->begin(cmd_buf, "mesh");
+
+  bind(cmd_buf, pipeline);
+  draw(cmd_buf, pipeline, 0, static_cast<uint32_t>(_pris.size()));
+
+  profiler->end(cmd_buf);
+}
+
+void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<TexturePipeline> &pipeline)
+{
+  if (!pipeline || !pipeline->valid())
+    return;
+
+  auto profiler = _device->profiler();
+  profiler->begin(cmd_buf, "mesh textured");
+
+  bind(cmd_buf, pipeline);
+  draw(cmd_buf, pipeline, 0, static_cast<uint32_t>(_pris.size()));
+
+  profiler->end(cmd_buf);
+}
+
+void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<DepthPersPipeline> &pipeline)
+{
+  if (!pipeline || !pipeline->valid())
+    return;
+
+  auto profiler = _device->profiler();
+  profiler->begin(cmd_buf, "mesh depth");
+
+  bind(cmd_buf, pipeline);
+  draw(cmd_buf, pipeline, 0, static_cast<uint32_t>(_pris.size()));
+
+  profiler->end(cmd_buf);
+}
+
+void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<BindlessPipeline> &pipeline)
+{
+  if (!pipeline || !pipeline->valid())
+    return;
+
+  auto profiler = _device->profiler();
+  profiler->begin(cmd_buf, "mesh bindless");
+
+  bind(cmd_buf, pipeline);
+  draw(cmd_buf, pipeline, 0, static_cast<uint32_t>(_pris.size()));
+
+  profiler->end(cmd_buf);
+}
+
+void MeshInstance::bind(VkCommandBuffer cmd_buf, const std::shared_ptr<VulkanPipeline> &pipeline)
+{
   vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
+}
+
+void MeshInstance::bind(VkCommandBuffer cmd_buf, const std::shared_ptr<BindlessPipeline> &pipeline)
+{
+  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
+
+  VkDescriptorSet material_set = pipeline->materials()->descriptor_set();
+  vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipe_layout(), 2, 1, &material_set, 0, nullptr);
+}
+
+void MeshInstance::draw(VkCommandBuffer cmd_buf, const std::shared_ptr<VulkanPipeline> &pipeline, uint32_t begin, uint32_t end)
+{
+  for (uint32_t i = begin; i < end; i++) {
+    if (!visible(camera_view, i))
+      continue;
 
-  for (int i = 0; i < _pris.size(); i++) {
     auto &pri = _pris[i];
     auto m = _transform * pri->transform();
     vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(m), &m);
@@ -137,15 +308,12 @@ void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shar
   }
 }
 
-void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<TexturePipeline> &pipeline)
+void MeshInstance::draw(VkCommandBuffer cmd_buf, const std::shared_ptr<TexturePipeline> &pipeline, uint32_t begin, uint32_t end)
 {
-  if (!pipeline || !pipeline->valid())
-    return;
-
-
-  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
+  for (uint32_t i = begin; i < end; i++) {
+    if (!visible(camera_view, i))
+      continue;
 
-  for (int i = 0; i < _pris.size(); i++) {
     auto &pri = _pris[i];
     auto m = _transform * pri->transform();
     vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(m), &m);
@@ -174,14 +342,12 @@ void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shar
   }
 }
 
-void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<DepthPersPipeline> &pipeline)
+void MeshInstance::draw(VkCommandBuffer cmd_buf, const std::shared_ptr<DepthPersPipeline> &pipeline, uint32_t begin, uint32_t end)
 {
-  if (!pipeline || !pipeline->valid())
-    return;
-
-  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
+  for (uint32_t i = begin; i < end; i++) {
+    if (!visible(shadow_view, i))
+      continue;
 
-  for (int i = 0; i < _pris.size(); i++) {
     auto &pri = _pris[i];
     auto m = _transform * pri->transform();
     vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(m), &m);
@@ -207,3 +373,35 @@ void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shar
   }
 }
 
+void MeshInstance::draw(VkCommandBuffer cmd_buf, const std::shared_ptr<BindlessPipeline> &pipeline, uint32_t begin, uint32_t end)
+{
+  for (uint32_t i = begin; i < end; i++) {
+    if (!visible(camera_view, i))
+      continue;
+
+    auto &pri = _pris[i];
+    if (pipeline->pulls_vertices()) {
+      PulledTransform pc = {};
+      pc.m = _transform * pri->transform();
+      pc.material = _material_ids[i];
+      pc.position = pri->_vertex_buf->device_address();
+      pc.normal = pri->_normal_buf->device_address();
+      pc.uv = pri->_uv_buf->device_address();
+      vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pc), &pc);
+    } else {
+      BindlessTransform pc;
+      pc.m = _transform * pri->transform();
+      pc.material = _material_ids[i];
+      vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pc), &pc);
+
+      std::vector<VkBuffer> bufs(3);
+      bufs[0] = *pri->_vertex_buf;
+      bufs[1] = *pri->_normal_buf;
+      bufs[2] = *pri->_uv_buf;
+      std::vector<VkDeviceSize> offset(bufs.size(), 0);
+      vkCmdBindVertexBuffers(cmd_buf, 0, bufs.size(), bufs.data(), offset.data());
+    }
+    vkCmdBindIndexBuffer(cmd_buf, *pri->_index_buf, 0, VK_INDEX_TYPE_UINT16);
+    vkCmdDrawIndexed(cmd_buf, pri->index_count(), 1, 0, 0, 0);
+  }
+}
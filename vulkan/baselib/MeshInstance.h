@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vulkan/vulkan_core.h>
+#include <functional>
 #include <vector>
 #include <memory>
 
@@ -13,9 +14,20 @@ class VulkanBuffer;
 class VulkanPipeline;
 class TexturePipeline;
 class DepthPersPipeline;
+class BindlessPipeline;
+class IndirectPipeline;
+class VulkanIndirectScene;
+class Frustum;
 
 class MeshInstance{
 public:
+  // the frusta a primitive is culled against, the depth pipeline draws for the shadow view
+  enum View {
+    camera_view,
+    shadow_view,
+    view_count,
+  };
+
   MeshInstance();
   ~MeshInstance();
 
@@ -23,17 +35,56 @@ public:
 
   void add_primitive(std::shared_ptr<MeshPrimitive> &pri);
 
+  const std::vector<std::shared_ptr<MeshPrimitive>> &primitives() { return _pris; }
+
+  const tg::mat4 &transform() { return _transform; }
+
+  // tests the world bounds of the primitives against the frustum, the draws of the view skip
+  // the ones outside until the next cull. Returns whether that set changed, i.e. whether
+  // recorded command buffers are stale
+  bool cull(const Frustum &frustum, View view = camera_view);
+
+  // draws every primitive in the view again
+  void uncull(View view = camera_view);
+
   void realize(const std::shared_ptr<VulkanDevice> &dev);
 
   void realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<TexturePipeline> &pipeline);
 
+  void realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<BindlessPipeline> &pipeline);
+
+  // adds the primitives as draws of the pipeline's scene, which draws them from then on;
+  // set_transform moves them there
+  void realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<IndirectPipeline> &pipeline);
+
   void build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<VulkanPipeline> &pipeline);
 
   void build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<TexturePipeline> &pipeline);
 
   void build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<DepthPersPipeline> &pipeline);
 
+  void build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<BindlessPipeline> &pipeline);
+
+  // records contiguous primitive ranges into secondary command buffers on the device workers
+  // and executes them from cmd_buf, the primary of frame, whose subpass has to be begun with
+  // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Secondary buffers inherit no state, setup
+  // sets viewport, scissor and the descriptor sets the primitives do not bind themselves
+  template <typename Pipeline>
+  void record_parallel(VkCommandBuffer cmd_buf, uint32_t frame, const std::shared_ptr<Pipeline> &pipeline,
+                       const VkCommandBufferInheritanceInfo &inheritance, const std::function<void(VkCommandBuffer)> &setup = {});
+
 private:
+  void update_bounds();
+
+  bool visible(View view, uint32_t i) { return _visible[view][i]; }
+
+  void bind(VkCommandBuffer cmd_buf, const std::shared_ptr<VulkanPipeline> &pipeline);
+  void bind(VkCommandBuffer cmd_buf, const std::shared_ptr<BindlessPipeline> &pipeline);
+
+  void draw(VkCommandBuffer cmd_buf, const std::shared_ptr<VulkanPipeline> &pipeline, uint32_t begin, uint32_t end);
+  void draw(VkCommandBuffer cmd_buf, const std::shared_ptr<TexturePipeline> &pipeline, uint32_t begin, uint32_t end);
+  void draw(VkCommandBuffer cmd_buf, const std::shared_ptr<DepthPersPipeline> &pipeline, uint32_t begin, uint32_t end);
+  void draw(VkCommandBuffer cmd_buf, const std::shared_ptr<BindlessPipeline> &pipeline, uint32_t begin, uint32_t end);
 
 private:
   std::shared_ptr<VulkanDevice> _device;
@@ -46,5 +97,15 @@ private:
 
   std::shared_ptr<VulkanBuffer> _pbr_buf;
 
+  VkDescriptorSetLayout _pbr_layout = VK_NULL_HANDLE;
   VkDescriptorSet _pbr_set = VK_NULL_HANDLE;
+
+  std::vector<uint32_t> _material_ids;
+
+  // world bounding spheres of the primitives, an array per component for Frustum::test
+  std::vector<float> _bound_x, _bound_y, _bound_z, _bound_r;
+  std::vector<uint8_t> _visible[view_count];
+
+  std::shared_ptr<VulkanIndirectScene> _scene;
+  std::vector<uint32_t> _draw_ids;
 };
\ No newline at end of file
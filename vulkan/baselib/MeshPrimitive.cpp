@@ -2,6 +2,7 @@
 #include "VulkanDevice.h"
 #include "VulkanTools.h"
 #include "VulkanBuffer.h"
+#include "VulkanTransfer.h"
 
 #include "config.h"
 #include "RenderData.h"
@@ -29,6 +30,17 @@ void MeshPrimitive::set_vertex(uint8_t* data, int n)
   int sz = n / sizeof(tg::vec3);
   _vertexs.resize(sz);
   memcpy(_vertexs.data(), data, n);
+
+  _bound = tg::boundingbox();
+  for (auto &v : _vertexs)
+    _bound.expand(v);
+
+  // flat primitives have an empty extent along an axis but still a sphere
+  _sphere = tg::vec4(0, 0, 0, 0);
+  if (!_vertexs.empty()) {
+    auto center = _bound.center();
+    _sphere = tg::vec4(center.x(), center.y(), center.z(), _bound.radius());
+  }
 }
 
 void MeshPrimitive::set_normal(uint8_t* data, int n)
@@ -64,10 +76,25 @@ void MeshPrimitive::set_material(const Material& m)
 
 void MeshPrimitive::realize(const std::shared_ptr<VulkanDevice>& dev)
 {
-  auto fun = [dev](uint8_t* data, int n) -> std::shared_ptr<VulkanBuffer> {
-    auto ori_buf = dev->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, n, data);
-    auto dst_buf = dev->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, n, 0);
-    dev->copy_buffer(ori_buf.get(), dst_buf.get(), dev->transfer_queue());
+  // a mesh realized for several pipelines shares the buffers between them
+  if (_index_buf)
+    return;
+
+  auto transfer = dev->transfer();
+
+  // with device addresses the attributes can also be pulled by the vertex shader
+  VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  VkPipelineStageFlags stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+  VkAccessFlags access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  if (dev->features12().bufferDeviceAddress) {
+    usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    stages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+    access |= VK_ACCESS_SHADER_READ_BIT;
+  }
+
+  auto fun = [=](uint8_t* data, int n) -> std::shared_ptr<VulkanBuffer> {
+    auto dst_buf = dev->create_buffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, n, 0);
+    transfer->upload_buffer(dst_buf.get(), data, n, stages, access);
     return dst_buf;
   };
   _vertex_buf = fun((uint8_t *)_vertexs.data(), _vertexs.size() * sizeof(vec3));
@@ -75,8 +102,7 @@ void MeshPrimitive::realize(const std::shared_ptr<VulkanDevice>& dev)
   _uv_buf = fun((uint8_t *)_uvs.data(), _uvs.size() * sizeof(vec2));
 
   auto index_sz = _indexs.size() * sizeof(uint16_t);
-  auto index_ori_buf = dev->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, index_sz, (uint8_t *)_indexs.data());
   auto index_buf = dev->create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_sz, 0);
-  dev->copy_buffer(index_ori_buf.get(), index_buf.get(), dev->transfer_queue());
+  transfer->upload_buffer(index_buf.get(), _indexs.data(), index_sz, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
   _index_buf = index_buf;
 }
@@ -5,6 +5,7 @@
 #include <memory>
 
 #include "tvec.h"
+#include "tmath.h"
 #include "RenderData.h"
 
 class VulkanBuffer;
@@ -13,6 +14,8 @@ class VulkanDevice;
 class MeshPrimitive {
   friend class GLTFLoader;
   friend class MeshInstance;
+  friend class VulkanIndirectScene;
+  friend class InstancedMesh;
 
 public:
   MeshPrimitive();
@@ -32,6 +35,12 @@ public:
 
   uint32_t index_count();
 
+  // of the vertices, in the primitive's space
+  const tg::boundingbox &bound() { return _bound; }
+
+  // around the bound, center and radius
+  const tg::vec4 &sphere() { return _sphere; }
+
   const Material &material() { return _material; }
 
   void set_material(const Material &m);
@@ -51,6 +60,9 @@ private:
 
   std::vector<uint16_t> _indexs;
 
+  tg::boundingbox _bound;
+  tg::vec4 _sphere = tg::vec4(0, 0, 0, 0);
+
   std::shared_ptr<VulkanBuffer> _vertex_buf, _normal_buf, _uv_buf, _index_buf;
 
 
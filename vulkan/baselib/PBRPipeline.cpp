@@ -1,6 +1,7 @@
 #include "PBRPipeline.h"
 #include "VulkanPass.h"
 #include "VulkanTools.h"
+#include "VulkanPipelineLibrary.h"
 
 #include "config.h"
 #include "tvec.h"
@@ -18,12 +19,12 @@ PBRPipeline::PBRPipeline(const std::shared_ptr<VulkanDevice>& dev) : VulkanPipel
 PBRPipeline::~PBRPipeline()
 {
   if(_light_layout) {
-    vkDestroyDescriptorSetLayout(*_device, _light_layout, nullptr);
+    destroy_layout(_light_layout);
     _light_layout = VK_NULL_HANDLE;
   }
 
   if (_pbr_layout) {
-    vkDestroyDescriptorSetLayout(*_device, _pbr_layout, nullptr);
+    destroy_layout(_pbr_layout);
     _pbr_layout = VK_NULL_HANDLE;
   }
 }
@@ -35,7 +36,7 @@ void PBRPipeline::realize(VulkanPass *render_pass, int subpass)
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipelay;
-  pipelineCreateInfo.renderPass = *render_pass;
+  pipelineCreateInfo.renderPass = render_pass ? VkRenderPass(*render_pass) : VK_NULL_HANDLE;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
   inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -117,13 +118,13 @@ void PBRPipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/pbr_clr.vert.spv");
+  shaderStages[0].module = _device->pipelines()->shader(SHADER_DIR "/pbr_clr.vert.spv");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/pbr_clr.frag.spv");
+  shaderStages[1].module = _device->pipelines()->shader(SHADER_DIR "/pbr_clr.frag.spv");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -140,10 +141,7 @@ void PBRPipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pDynamicState = &dynamicState;
   pipelineCreateInfo.subpass = subpass;
 
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
-
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  compile(pipelineCreateInfo);
 
 }
 
@@ -151,7 +149,7 @@ VkDescriptorSetLayout PBRPipeline::light_layout()
 {
   if (!_light_layout) {
     VkDescriptorSetLayoutBinding layoutBinding = {};
-    layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layoutBinding.descriptorType = uniform_type();
     layoutBinding.descriptorCount = 1;
     layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     layoutBinding.pImmutableSamplers = nullptr;
@@ -13,6 +13,44 @@ struct Transform{
   tg::mat4 m;
 };
 
+struct BindlessTransform{
+  tg::mat4 m;
+  uint32_t material;
+};
+
+// push constant of the vertex pulling path, attributes are read through the addresses
+struct PulledTransform{
+  tg::mat4 m;
+  uint32_t material;
+  uint32_t pad;
+  VkDeviceAddress position;
+  VkDeviceAddress normal;
+  VkDeviceAddress uv;
+};
+
+// draw record of VulkanIndirectScene, std430 as read by the cull and vertex shaders
+struct IndirectDraw{
+  tg::mat4 m;
+  // world space bounding sphere, center and radius
+  tg::vec4 sphere;
+  uint32_t material;
+  uint32_t index_count;
+  uint32_t first_index;
+  int32_t vertex_offset;
+};
+
+// per instance record of InstancedMesh, std430 as read by pbr_instanced.vert
+struct InstanceData{
+  tg::mat4 m;
+  uint32_t material;
+  uint32_t pad[3];
+};
+
+// normalized planes with inward normals, a sphere is culled once it is behind any
+struct CullFrustum{
+  tg::vec4 planes[6];
+};
+
 struct ParallelLight{
   tg::vec4 light_dir;
   tg::vec4 light_color;
@@ -31,6 +69,15 @@ struct alignas(64) PBRBase {
   tg::vec4 albedo;
 };
 
+// std430 entry of the bindless material table, tex is -1 when untextured
+struct BindlessMaterial {
+  float   ao;
+  float   metallic;
+  float   roughness;
+  int     tex;
+  tg::vec4 albedo;
+};
+
 struct Material{
   bool          cull; 
   PBRBase       pbrdata;
@@ -1,6 +1,7 @@
 #include "TexturePipeline.h"
 #include "VulkanPass.h"
 #include "VulkanTools.h"
+#include "VulkanPipelineLibrary.h"
 
 #include "tvec.h"
 #include "config.h"
@@ -19,7 +20,7 @@ TexturePipeline::TexturePipeline(const std::shared_ptr<VulkanDevice> &dev) : PBR
 TexturePipeline::~TexturePipeline()
 {
   if(_texture_layout) {
-    vkDestroyDescriptorSetLayout(*_device, _texture_layout, nullptr);
+    destroy_layout(_texture_layout);
     _texture_layout = VK_NULL_HANDLE;
   }
 }
@@ -53,7 +54,7 @@ void TexturePipeline::realize(VulkanPass *render_pass, int subpass)
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipe_lay;
-  pipelineCreateInfo.renderPass = *render_pass;
+  pipelineCreateInfo.renderPass = render_pass ? VkRenderPass(*render_pass) : VK_NULL_HANDLE;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
   inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -142,13 +143,13 @@ void TexturePipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/pbr_tex.vert.spv");
+  shaderStages[0].module = _device->pipelines()->shader(SHADER_DIR "/pbr_tex.vert.spv");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/pbr_tex.frag.spv");
+  shaderStages[1].module = _device->pipelines()->shader(SHADER_DIR "/pbr_tex.frag.spv");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -165,10 +166,7 @@ void TexturePipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pDynamicState = &dynamicState;
   pipelineCreateInfo.subpass = subpass;
 
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
-
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  compile(pipelineCreateInfo);
 }
 
 VkDescriptorSetLayout TexturePipeline::pbr_layout()
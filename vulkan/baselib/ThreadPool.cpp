@@ -0,0 +1,43 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t count)
+{
+  if (count == 0) {
+    uint32_t hw = std::thread::hardware_concurrency();
+    count = std::max(hw, 2u) - 1;
+  }
+
+  _threads.reserve(count);
+  for (uint32_t i = 0; i < count; i++)
+    _threads.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cond.notify_all();
+
+  for (auto &thread : _threads)
+    thread.join();
+}
+
+void ThreadPool::run()
+{
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cond.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+      if (_tasks.empty())
+        return;
+      task = std::move(_tasks.front());
+      _tasks.pop_front();
+    }
+    task();
+  }
+}
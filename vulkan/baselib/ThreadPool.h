@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+  // 0 picks one thread less than the hardware concurrency, at least one
+  explicit ThreadPool(uint32_t count = 0);
+  ~ThreadPool();
+
+  uint32_t size() const { return static_cast<uint32_t>(_threads.size()); }
+
+  template <typename F>
+  auto submit(F &&f) -> std::future<decltype(f())>
+  {
+    using R = decltype(f());
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _tasks.emplace_back([task]() { (*task)(); });
+    }
+    _cond.notify_one();
+    return future;
+  }
+
+private:
+  void run();
+
+private:
+  std::vector<std::thread> _threads;
+  std::deque<std::function<void()>> _tasks;
+
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  bool _stop = false;
+};
@@ -23,6 +23,17 @@ void VulkanBuffer::unmap()
   vkUnmapMemory(*_device, _memory);
 }
 
+/**
+ * Get the address shaders use to reach the _buffer through buffer references
+ */
+VkDeviceAddress VulkanBuffer::device_address()
+{
+  VkBufferDeviceAddressInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+  info.buffer = _buffer;
+  return vkGetBufferDeviceAddress(*_device, &info);
+}
+
 /**
  * Flush a _memory range of the _buffer to make it visible to the _device
  *
@@ -75,7 +86,7 @@ void VulkanBuffer::destroy()
     _buffer = VK_NULL_HANDLE;
   }
   if (_memory) {
-    vkFreeMemory(*_device, _memory, nullptr);
+    _device->free_memory(_memory);
     _memory = VK_NULL_HANDLE;
   }
 }
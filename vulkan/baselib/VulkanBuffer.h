@@ -15,6 +15,9 @@ public:
   VkDeviceSize size() { return _size; }
   VkDeviceSize memsize() { return _memsize; }
 
+  // needs VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT and the bufferDeviceAddress feature
+  VkDeviceAddress device_address();
+
   uint8_t* map();
   void unmap();
 
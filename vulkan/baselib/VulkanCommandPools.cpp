@@ -0,0 +1,206 @@
+#include "VulkanCommandPools.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+VulkanCommandPools::VulkanCommandPools(VulkanDevice *dev) : _device(dev)
+{
+}
+
+VulkanCommandPools::~VulkanCommandPools()
+{
+  // secondary buffers go with their pools
+  _workers.reset();
+
+  for (auto &[id, pools] : _threads) {
+    if (pools.pool)
+      vkDestroyCommandPool(*_device, pools.pool, nullptr);
+    for (auto &frame : pools.frames)
+      vkDestroyCommandPool(*_device, frame.pool, nullptr);
+    for (auto &frame : pools.secondaries)
+      vkDestroyCommandPool(*_device, frame.pool, nullptr);
+  }
+  _threads.clear();
+
+  for (auto fence : _all_fences)
+    vkDestroyFence(*_device, fence, nullptr);
+  for (auto semaphore : _all_semaphores)
+    vkDestroySemaphore(*_device, semaphore, nullptr);
+  _all_fences.clear();
+  _all_semaphores.clear();
+}
+
+VulkanCommandPools::ThreadPools &VulkanCommandPools::thread_pools()
+{
+  // nodes of the map stay put, the reference outlives the lock of the caller
+  return _threads[std::this_thread::get_id()];
+}
+
+VkCommandPool VulkanCommandPools::thread_pool()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto &pools = thread_pools();
+  if (!pools.pool)
+    pools.pool = _device->create_command_pool(_device->graphic_family());
+  return pools.pool;
+}
+
+void VulkanCommandPools::reset(VkDevice device, FramePool &slot)
+{
+  if (slot.used[0] + slot.used[1] == 0)
+    return;
+
+  VK_CHECK_RESULT(vkResetCommandPool(device, slot.pool, 0));
+  slot.used[0] = slot.used[1] = 0;
+}
+
+void VulkanCommandPools::begin_frame(uint32_t frame)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  bool released = frame < _released.size() && _released[frame];
+  for (auto &[id, pools] : _threads) {
+    if (frame < pools.frames.size())
+      reset(*_device, pools.frames[frame]);
+    if (released && frame < pools.secondaries.size())
+      reset(*_device, pools.secondaries[frame]);
+  }
+  if (released)
+    _released[frame] = false;
+}
+
+VkCommandBuffer VulkanCommandPools::allocate(uint32_t frame, VkCommandBufferLevel level)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return next_buffer(thread_pools().frames, frame, level, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+}
+
+VkCommandBuffer VulkanCommandPools::next_buffer(std::vector<FramePool> &pools, uint32_t frame, VkCommandBufferLevel level,
+                                                VkCommandPoolCreateFlags flags)
+{
+  if (frame >= pools.size())
+    pools.resize(frame + 1);
+
+  auto &slot = pools[frame];
+  if (!slot.pool)
+    slot.pool = _device->create_command_pool(_device->graphic_family(), flags);
+
+  // buffers of a reset pool are back in the initial state and get handed out again
+  int kind = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? 0 : 1;
+  auto &buffers = slot.buffers[kind];
+  auto &used = slot.used[kind];
+  if (used == buffers.size()) {
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    VkCommandBufferAllocateInfo allocInfo = vks::initializers::commandBufferAllocateInfo(slot.pool, level, 1);
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(*_device, &allocInfo, &cmd));
+    buffers.push_back(cmd);
+  }
+  return buffers[used++];
+}
+
+VkFence VulkanCommandPools::acquire_fence()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_fences.empty()) {
+    auto fence = _fences.back();
+    _fences.pop_back();
+    return fence;
+  }
+
+  VkFence fence = VK_NULL_HANDLE;
+  VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+  VK_CHECK_RESULT(vkCreateFence(*_device, &fenceInfo, nullptr, &fence));
+  _all_fences.push_back(fence);
+  return fence;
+}
+
+void VulkanCommandPools::release_fence(VkFence fence)
+{
+  if (!fence)
+    return;
+
+  VK_CHECK_RESULT(vkResetFences(*_device, 1, &fence));
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _fences.push_back(fence);
+}
+
+VkSemaphore VulkanCommandPools::acquire_semaphore()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_semaphores.empty()) {
+    auto semaphore = _semaphores.back();
+    _semaphores.pop_back();
+    return semaphore;
+  }
+
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+  VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, &semaphore));
+  _all_semaphores.push_back(semaphore);
+  return semaphore;
+}
+
+void VulkanCommandPools::release_semaphore(VkSemaphore semaphore)
+{
+  if (!semaphore)
+    return;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _semaphores.push_back(semaphore);
+}
+
+std::vector<VkCommandBuffer> VulkanCommandPools::record_secondary(uint32_t frame, const VkCommandBufferInheritanceInfo &inheritance,
+                                                                  uint32_t count, const RecordRange &record, uint32_t min_batch)
+{
+  if (count == 0)
+    return {};
+
+  if (!_workers)
+    _workers = std::make_unique<ThreadPool>();
+
+  uint32_t ranges = std::clamp((count + min_batch - 1) / std::max(min_batch, 1u), 1u, _workers->size());
+  uint32_t batch = (count + ranges - 1) / ranges;
+
+  auto record_range = [this, frame, &inheritance, &record](uint32_t begin, uint32_t end) {
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      cmd = next_buffer(thread_pools().secondaries, frame, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 0);
+    }
+
+    VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd, &beginInfo));
+    record(cmd, begin, end);
+    VK_CHECK_RESULT(vkEndCommandBuffer(cmd));
+    return cmd;
+  };
+
+  // a single range is not worth the hand over to a worker
+  std::vector<VkCommandBuffer> cmds;
+  if (ranges == 1) {
+    cmds.push_back(record_range(0, count));
+  } else {
+    std::vector<std::future<VkCommandBuffer>> futures;
+    for (uint32_t begin = 0; begin < count; begin += batch) {
+      uint32_t end = std::min(begin + batch, count);
+      futures.push_back(_workers->submit([&record_range, begin, end]() { return record_range(begin, end); }));
+    }
+    for (auto &future : futures)
+      cmds.push_back(future.get());
+  }
+  return cmds;
+}
+
+void VulkanCommandPools::release_secondary(uint32_t frame)
+{
+  // the workers are idle between record_secondary calls, begin_frame can reset their pools
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (frame >= _released.size())
+    _released.resize(frame + 1, false);
+  _released[frame] = true;
+}
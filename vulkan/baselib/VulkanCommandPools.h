@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class VulkanDevice;
+class ThreadPool;
+
+// Graphics command pools owned per thread, so recording never shares a pool across
+// threads. Frame pools hand out transient command buffers that are reset together with
+// vkResetCommandPool by begin_frame once the fence of that frame slot has signaled;
+// begin_frame has to run before any thread records for the slot again. Fences and
+// binary semaphores are recycled through free lists instead of created per submission.
+// Secondary command buffers for pre-recorded primaries are recorded on worker threads
+// into per-thread, per-frame pools of their own; they live as long as the primary of the
+// frame and are reset, and their handles reused, once the primary is recorded again.
+class VulkanCommandPools {
+public:
+  VulkanCommandPools(VulkanDevice *dev);
+  ~VulkanCommandPools();
+
+  // pool of the calling thread for one-off command buffers that are freed individually
+  VkCommandPool thread_pool();
+
+  // resets the transient buffers of frame, and its secondaries after release_secondary(frame)
+  void begin_frame(uint32_t frame);
+
+  // transient command buffer of the calling thread, valid until begin_frame(frame)
+  VkCommandBuffer allocate(uint32_t frame, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+  // unsignaled, hand back with release_fence once no submission uses it
+  VkFence acquire_fence();
+  void release_fence(VkFence fence);
+
+  VkSemaphore acquire_semaphore();
+  void release_semaphore(VkSemaphore semaphore);
+
+  // splits [0, count) into contiguous ranges of at least min_batch items and records each
+  // range into a secondary command buffer on the workers, in order of the ranges. The
+  // buffers belong to the primary of frame and stay valid until the begin_frame(frame)
+  // after release_secondary(frame)
+  using RecordRange = std::function<void(VkCommandBuffer cmd_buf, uint32_t begin, uint32_t end)>;
+  std::vector<VkCommandBuffer> record_secondary(uint32_t frame, const VkCommandBufferInheritanceInfo &inheritance,
+                                                uint32_t count, const RecordRange &record, uint32_t min_batch = 256);
+
+  // the primary of frame is recorded again after the next begin_frame(frame)
+  void release_secondary(uint32_t frame);
+
+private:
+  struct FramePool {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> buffers[2];
+    size_t used[2] = {};
+  };
+
+  struct ThreadPools {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector<FramePool> frames;
+    // secondaries of the pre-recorded primaries, outlive begin_frame
+    std::vector<FramePool> secondaries;
+  };
+
+  ThreadPools &thread_pools();
+
+  // the next buffer of a frame pool, reset ones are handed out again
+  VkCommandBuffer next_buffer(std::vector<FramePool> &pools, uint32_t frame, VkCommandBufferLevel level, VkCommandPoolCreateFlags flags);
+
+  static void reset(VkDevice device, FramePool &slot);
+
+private:
+  VulkanDevice *_device = nullptr;
+
+  std::mutex _mutex;
+  std::unordered_map<std::thread::id, ThreadPools> _threads;
+
+  std::vector<VkFence> _fences;
+  std::vector<VkSemaphore> _semaphores;
+  std::vector<VkFence> _all_fences;
+  std::vector<VkSemaphore> _all_semaphores;
+
+  std::unique_ptr<ThreadPool> _workers;
+  // frames whose secondaries begin_frame resets
+  std::vector<bool> _released;
+};
@@ -1,3 +1,15 @@
 #pragma once
 #include <vulkan/vulkan.h>
 
+// what a device memory allocation is used for, drives the memory statistics
+enum class MemoryCategory {
+  vertex,
+  index,
+  uniform,
+  storage,
+  texture,
+  render_target,
+  staging,
+  other,
+  count
+};
@@ -0,0 +1,198 @@
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+#include <algorithm>
+
+namespace {
+
+// descriptors per set of each type, scaled by the set count of a pool
+const std::pair<VkDescriptorType, float> pool_ratios[] = {{VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f},
+                                                          {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f},
+                                                          {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.f},
+                                                          {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f},
+                                                          {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1.f},
+                                                          {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1.f},
+                                                          {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f},
+                                                          {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f},
+                                                          {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f},
+                                                          {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.f},
+                                                          {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f}};
+
+const uint32_t min_pool_sets = 64;
+const uint32_t max_pool_sets = 4096;
+
+} // namespace
+
+VulkanDescriptorAllocator::VulkanDescriptorAllocator(VulkanDevice *dev) : _device(dev)
+{
+}
+
+VulkanDescriptorAllocator::~VulkanDescriptorAllocator()
+{
+  destroy(_static);
+  for (auto &pools : _frame_pools)
+    destroy(pools);
+  _frame_pools.clear();
+  _retired.clear();
+  _cache.clear();
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto it = _cache.find(layout);
+  if (it != _cache.end() && !it->second.empty()) {
+    auto set = it->second.back();
+    it->second.pop_back();
+    return set;
+  }
+
+  return allocate(_static, layout);
+}
+
+void VulkanDescriptorAllocator::release(VkDescriptorSetLayout layout, VkDescriptorSet set)
+{
+  if (!set)
+    return;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _retired.push_back({layout, set, _serial});
+}
+
+void VulkanDescriptorAllocator::forget(VkDescriptorSetLayout layout)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _cache.erase(layout);
+  _retired.erase(std::remove_if(_retired.begin(), _retired.end(), [layout](const Retired &r) { return r.layout == layout; }),
+                 _retired.end());
+}
+
+void VulkanDescriptorAllocator::set_frames(uint32_t frames)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  // new slots have nothing pending yet
+  _frames.resize(frames, _serial);
+}
+
+void VulkanDescriptorAllocator::begin_frame(uint32_t frame)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (frame >= _frames.size())
+    _frames.resize(frame + 1, _serial);
+  _frames[frame] = ++_serial;
+
+  if (frame >= _frame_pools.size())
+    _frame_pools.resize(frame + 1);
+  if (frame < _released.size() && _released[frame]) {
+    reset(_frame_pools[frame]);
+    _released[frame] = false;
+  }
+  _frame = frame;
+
+  // a slot begins after waiting for the last frame rendered with it, once every slot has
+  // begun after a release the last frame submitted before it is done, and with it all
+  // earlier ones
+  uint64_t oldest = *std::min_element(_frames.begin(), _frames.end());
+  while (!_retired.empty() && _retired.front().serial < oldest) {
+    auto &retired = _retired.front();
+    _cache[retired.layout].push_back(retired.set);
+    _retired.pop_front();
+  }
+}
+
+void VulkanDescriptorAllocator::release_frame(uint32_t frame)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (frame >= _released.size())
+    _released.resize(frame + 1, false);
+  _released[frame] = true;
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::allocate_frame(VkDescriptorSetLayout layout)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (_frame >= _frame_pools.size())
+    _frame_pools.resize(_frame + 1);
+
+  return allocate(_frame_pools[_frame], layout);
+}
+
+VkDescriptorPool VulkanDescriptorAllocator::grab_pool(Pools &pools)
+{
+  if (!pools.free.empty()) {
+    auto pool = pools.free.back();
+    pools.free.pop_back();
+    return pool;
+  }
+
+  // every new pool of a chain is twice the size of the last one
+  pools.sets = pools.sets ? std::min(pools.sets * 2, max_pool_sets) : min_pool_sets;
+
+  std::vector<VkDescriptorPoolSize> sizes;
+  for (auto &[type, ratio] : pool_ratios)
+    sizes.push_back({type, std::max(1u, uint32_t(ratio * pools.sets))});
+
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.maxSets = pools.sets;
+  pool_info.poolSizeCount = static_cast<uint32_t>(sizes.size());
+  pool_info.pPoolSizes = sizes.data();
+
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateDescriptorPool(*_device, &pool_info, nullptr, &pool));
+  return pool;
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::allocate(Pools &pools, VkDescriptorSetLayout layout)
+{
+  if (!pools.current) {
+    pools.current = grab_pool(pools);
+    pools.used.push_back(pools.current);
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = pools.current;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VkResult result = vkAllocateDescriptorSets(*_device, &allocInfo, &set);
+  if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+    pools.current = grab_pool(pools);
+    pools.used.push_back(pools.current);
+
+    allocInfo.descriptorPool = pools.current;
+    result = vkAllocateDescriptorSets(*_device, &allocInfo, &set);
+  }
+  VK_CHECK_RESULT(result);
+
+  return set;
+}
+
+void VulkanDescriptorAllocator::reset(Pools &pools)
+{
+  for (auto pool : pools.used) {
+    vkResetDescriptorPool(*_device, pool, 0);
+    pools.free.push_back(pool);
+  }
+  pools.used.clear();
+  pools.current = VK_NULL_HANDLE;
+}
+
+void VulkanDescriptorAllocator::destroy(Pools &pools)
+{
+  for (auto pool : pools.used)
+    vkDestroyDescriptorPool(*_device, pool, nullptr);
+  for (auto pool : pools.free)
+    vkDestroyDescriptorPool(*_device, pool, nullptr);
+  pools.used.clear();
+  pools.free.clear();
+  pools.current = VK_NULL_HANDLE;
+}
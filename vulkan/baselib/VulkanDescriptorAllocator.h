@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class VulkanDevice;
+
+// Hands out descriptor sets from chained pools instead of one fixed pool.
+// Long-lived sets come from persistent pools. Released ones are recycled per layout, but
+// only once every frame slot has begun again after the release, i.e. once the fences of
+// the frames that may still use them have signaled; begin_frame drains them.
+// Frame sets come from the pools of a frame slot, which begin_frame resets wholesale once
+// the commands of the slot are about to be recorded again.
+class VulkanDescriptorAllocator {
+public:
+  VulkanDescriptorAllocator(VulkanDevice *dev);
+  ~VulkanDescriptorAllocator();
+
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+  // recorded command buffers may still use the set, they have to be recorded again
+  // before their slots begin
+  void release(VkDescriptorSetLayout layout, VkDescriptorSet set);
+
+  // drops the recycled sets of a layout that is about to be destroyed
+  void forget(VkDescriptorSetLayout layout);
+
+  // the number of frame slots, e.g. swapchain images after a (re)create; slots beyond it
+  // no longer hold back released sets
+  void set_frames(uint32_t frames);
+
+  // the commands of the slot are recorded again after its next begin_frame, which then
+  // resets the pools of its frame sets
+  void release_frame(uint32_t frame);
+
+  // once the fence of the slot has signaled
+  void begin_frame(uint32_t frame);
+
+  // for the commands of the slot begun last, valid until it is released and begun again
+  VkDescriptorSet allocate_frame(VkDescriptorSetLayout layout);
+
+private:
+  struct Pools {
+    std::vector<VkDescriptorPool> used, free;
+    VkDescriptorPool current = VK_NULL_HANDLE;
+    uint32_t sets = 0;
+  };
+
+  struct Retired {
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    // begin_frame calls before the release
+    uint64_t serial = 0;
+  };
+
+  VkDescriptorPool grab_pool(Pools &pools);
+
+  VkDescriptorSet allocate(Pools &pools, VkDescriptorSetLayout layout);
+
+  void reset(Pools &pools);
+
+  void destroy(Pools &pools);
+
+private:
+  VulkanDevice *_device = nullptr;
+
+  std::mutex _mutex;
+
+  Pools _static;
+  std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> _cache;
+
+  // in release order, so the serials only grow
+  std::deque<Retired> _retired;
+  uint64_t _serial = 0;
+  // the serial each slot last began at
+  std::vector<uint64_t> _frames;
+
+  std::vector<Pools> _frame_pools;
+  std::vector<bool> _released;
+  uint32_t _frame = 0;
+};
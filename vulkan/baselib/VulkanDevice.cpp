@@ -17,12 +17,24 @@
 #include "VulkanTools.h"
 #include "VulkanBuffer.h"
 #include "VulkanImage.h"
+#include "VulkanTransfer.h"
+#include "VulkanPipelineLibrary.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanProfiler.h"
+#include "VulkanMemoryTracker.h"
+#include "VulkanCommandPools.h"
 #include "VulkanInitializers.hpp"
 
+#include "config.h"
+
 #include <array>
 #include <unordered_set>
 #include <iostream>
 #include <stdexcept>
+#include <filesystem>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
 
 /**
  * Default constructor
@@ -39,6 +51,29 @@ VulkanDevice::VulkanDevice(VkPhysicalDevice _physical_device)
   vkGetPhysicalDeviceProperties(_physical_device, &properties);
   // Features should be checked by the examples before using them
   vkGetPhysicalDeviceFeatures(_physical_device, &features);
+  // Core 1.2 features (timeline semaphores, descriptor indexing, ...) have to be queried through the features2 chain
+  _features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  if (properties.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &_features12;
+    _features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    if (properties.apiVersion >= VK_API_VERSION_1_3)
+      _features12.pNext = &_features13;
+    vkGetPhysicalDeviceFeatures2(_physical_device, &features2);
+    _features12.pNext = nullptr;
+    _features13.pNext = nullptr;
+
+    // the update after bind limits of descriptor indexing
+    _properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &_properties12;
+    vkGetPhysicalDeviceProperties2(_physical_device, &properties2);
+    _properties12.pNext = nullptr;
+  }
+  _enabled_features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  _enabled_features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
   // Memory properties are used regularly for creating all kinds of buffers
   vkGetPhysicalDeviceMemoryProperties(_physical_device, &memoryProperties);
   // Queue family properties, used for setting up requested queues upon device creation
@@ -59,6 +94,23 @@ VulkanDevice::VulkanDevice(VkPhysicalDevice _physical_device)
       }
     }
   }
+
+  // Present id and present wait are extension features, queried once the extension list is known
+  _enabled_present_id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  _enabled_present_wait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  if (properties.apiVersion >= VK_API_VERSION_1_1 && extension_supported(VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+      extension_supported(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+    VkPhysicalDevicePresentIdFeaturesKHR presentId{};
+    presentId.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWait{};
+    presentWait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentId.pNext = &presentWait;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &presentId;
+    vkGetPhysicalDeviceFeatures2(_physical_device, &features2);
+    _present_wait_supported = presentId.presentId && presentWait.presentWait;
+  }
 }
 
 /**
@@ -68,20 +120,29 @@ VulkanDevice::VulkanDevice(VkPhysicalDevice _physical_device)
  */
 VulkanDevice::~VulkanDevice()
 {
+  if (_transfer) {
+    vkDeviceWaitIdle(_logical_device);
+    _transfer.reset();
+  }
+
+  _pipelines.reset();
+
   if (_pipe_cache) {
+    save_pipecache();
     vkDestroyPipelineCache(_logical_device, _pipe_cache, nullptr);
     _pipe_cache = VK_NULL_HANDLE;
   }
 
+  _commands.reset();
+
   if (_command_pool) {
     vkDestroyCommandPool(_logical_device, _command_pool, nullptr);
     _command_pool = VK_NULL_HANDLE;
   }
 
-  if(_descriptor_pool) {
-    vkDestroyDescriptorPool(_logical_device, _descriptor_pool, nullptr);
-    _descriptor_pool = VK_NULL_HANDLE;
-  }
+  _descriptors.reset();
+  _profiler.reset();
+  _memory.reset();
 
   if (_logical_device) {
     vkDestroyDevice(_logical_device, nullptr);
@@ -172,8 +233,44 @@ VkResult VulkanDevice::realize(VkPhysicalDeviceFeatures enabledFeatures, std::ve
   deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
+  // indirect draws of the GPU culled scene
+  enabledFeatures.multiDrawIndirect = features.multiDrawIndirect;
+  enabledFeatures.drawIndirectFirstInstance = features.drawIndirectFirstInstance;
   deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
+  // Without a chain from the caller, enable the 1.2 features baselib relies on
+  if (!pNextChain && properties.apiVersion >= VK_API_VERSION_1_2) {
+    _enabled_features12.timelineSemaphore = _features12.timelineSemaphore;
+    _enabled_features12.descriptorIndexing = _features12.descriptorIndexing;
+    _enabled_features12.runtimeDescriptorArray = _features12.runtimeDescriptorArray;
+    _enabled_features12.descriptorBindingPartiallyBound = _features12.descriptorBindingPartiallyBound;
+    _enabled_features12.descriptorBindingSampledImageUpdateAfterBind = _features12.descriptorBindingSampledImageUpdateAfterBind;
+    _enabled_features12.descriptorBindingUpdateUnusedWhilePending = _features12.descriptorBindingUpdateUnusedWhilePending;
+    _enabled_features12.shaderSampledImageArrayNonUniformIndexing = _features12.shaderSampledImageArrayNonUniformIndexing;
+    _enabled_features12.bufferDeviceAddress = _features12.bufferDeviceAddress;
+    _enabled_features12.drawIndirectCount = _features12.drawIndirectCount;
+    pNextChain = &_enabled_features12;
+
+    // dynamic rendering and synchronization2 for the render pass free path
+    if (properties.apiVersion >= VK_API_VERSION_1_3) {
+      _enabled_features13.dynamicRendering = _features13.dynamicRendering;
+      _enabled_features13.synchronization2 = _features13.synchronization2;
+      _enabled_features12.pNext = &_enabled_features13;
+    }
+
+    // present ids and vkWaitForPresentKHR for frame pacing, only with a swapchain
+    if (useSwapChain && _present_wait_supported) {
+      _enabled_present_id.presentId = VK_TRUE;
+      _enabled_present_wait.presentWait = VK_TRUE;
+      _enabled_present_id.pNext = &_enabled_present_wait;
+      _enabled_present_wait.pNext = _enabled_features12.pNext;
+      _enabled_features12.pNext = &_enabled_present_id;
+      deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+      deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+      _present_wait = true;
+    }
+  }
+
   // If a pNext(Chain) has been passed, we need to add it to the device creation info
   VkPhysicalDeviceFeatures2 physicalDeviceFeatures2{};
   if (pNextChain) {
@@ -193,6 +290,12 @@ VkResult VulkanDevice::realize(VkPhysicalDeviceFeatures enabledFeatures, std::ve
 
   deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
 
+  // Per-heap budget and usage for the memory statistics, tracked sizes are used without it
+  if (extension_supported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+    deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    _memory_budget = true;
+  }
+
   if (deviceExtensions.size() > 0) {
     for (const char *enabledExtension : deviceExtensions) {
       if (!extension_supported(enabledExtension)) {
@@ -220,6 +323,8 @@ VkResult VulkanDevice::realize(VkPhysicalDeviceFeatures enabledFeatures, std::ve
 
 
   vkCmdPushDescriptorSetKHR = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(_logical_device, "vkCmdPushDescriptorSetKHR");
+  if (_present_wait)
+    vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(_logical_device, "vkWaitForPresentKHR");
 
   return result;
 }
@@ -311,7 +416,7 @@ void VulkanDevice::destroy_render_pass(VkRenderPass rdpass)
 }
 
 std::tuple<VkImage, VkDeviceMemory> 
-VulkanDevice::create_image(int w, int h, VkFormat format)
+VulkanDevice::create_image(int w, int h, VkFormat format, MemoryCategory category)
 {
   VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -328,7 +433,7 @@ VulkanDevice::create_image(int w, int h, VkFormat format)
   VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
   memAllocInfo.allocationSize = memReqs.size;
   memAllocInfo.memoryTypeIndex = *memory_type_index(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  VK_CHECK_RESULT(vkAllocateMemory(_logical_device, &memAllocInfo, nullptr, &mem));
+  VK_CHECK_RESULT(allocate_memory(memAllocInfo, category, &mem));
   VK_CHECK_RESULT(vkBindImageMemory(_logical_device, img, mem, 0));
 
   return std::make_tuple(img, mem);
@@ -357,7 +462,7 @@ VkImageView VulkanDevice::create_image_view(VkImage img, VkFormat format)
 
 std::shared_ptr<VulkanImage> VulkanDevice::create_color_image(uint32_t width, uint32_t height, VkFormat format)
 {
-  auto [img, imgmem] = create_image(width, height, format);
+  auto [img, imgmem] = create_image(width, height, format, MemoryCategory::render_target);
   auto imgview = create_image_view(img, format);
 
   auto vkimg = std::make_shared<VulkanImage>(shared_from_this());
@@ -397,7 +502,7 @@ std::shared_ptr<VulkanImage> VulkanDevice::create_depth_image(uint32_t width, ui
   if (!memIndex)
     throw std::runtime_error("No proper memory type!");
   memAlloc.memoryTypeIndex = *memIndex;
-  VK_CHECK_RESULT(vkAllocateMemory(_logical_device, &memAlloc, nullptr, &imgmem));
+  VK_CHECK_RESULT(allocate_memory(memAlloc, MemoryCategory::render_target, &imgmem));
   VK_CHECK_RESULT(vkBindImageMemory(_logical_device, img, imgmem, 0));
 
   // Create a view for the depth stencil image
@@ -447,40 +552,144 @@ VkShaderModule VulkanDevice::create_shader(const char *shader_source, int n)
   return shader_module;
 }
 
+/**
+ * Get the pipeline cache, on first use it is seeded from the cache file of this device and driver
+ *
+ * @note The file content is only used when its header matches the physical device, otherwise an empty cache is created
+ */
 VkPipelineCache VulkanDevice::get_or_create_pipecache()
 {
   if (!_pipe_cache) {
+    std::string data;
+    {
+      std::ifstream is(pipecache_file(), std::ios::binary);
+      if (is.is_open())
+        data.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    }
+
+    // Layout of VkPipelineCacheHeaderVersionOne, the driver rejects mismatching data only on some implementations
+    bool valid = data.size() >= sizeof(VkPipelineCacheHeaderVersionOne);
+    if (valid) {
+      VkPipelineCacheHeaderVersionOne header;
+      memcpy(&header, data.data(), sizeof(header));
+      valid = header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+              header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+              header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+              memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+    if (!valid)
+      data.clear();
+
     VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
     pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-    VK_CHECK_RESULT(vkCreatePipelineCache(_logical_device, &pipelineCacheCreateInfo, nullptr, &_pipe_cache));
+    pipelineCacheCreateInfo.initialDataSize = data.size();
+    pipelineCacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(_logical_device, &pipelineCacheCreateInfo, nullptr, &_pipe_cache) != VK_SUCCESS) {
+      pipelineCacheCreateInfo.initialDataSize = 0;
+      pipelineCacheCreateInfo.pInitialData = nullptr;
+      VK_CHECK_RESULT(vkCreatePipelineCache(_logical_device, &pipelineCacheCreateInfo, nullptr, &_pipe_cache));
+      data.clear();
+    }
+    _pipe_cache_loaded = data.size();
   }
   return _pipe_cache;
 }
 
-VkDescriptorPool VulkanDevice::get_or_create_descriptor_pool()
-{
-  if (!_descriptor_pool) {
-    VkDescriptorPoolSize pool_sizes[] = {{VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000},
-                                         {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000}};
-    uint32_t sz = sizeof(pool_sizes) / sizeof(VkDescriptorPoolSize);
-    VkDescriptorPoolCreateInfo pool_info = {};
-    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    pool_info.maxSets = 1000 * sz;
-    pool_info.poolSizeCount = sz;
-    pool_info.pPoolSizes = pool_sizes;
-    VK_CHECK_RESULT(vkCreateDescriptorPool(_logical_device, &pool_info, nullptr, &_descriptor_pool));
-  }
-  return _descriptor_pool;
+/**
+ * Print the time spent creating pipelines so far and whether the cache was warm
+ *
+ * @note Waits for the pipelines still compiling in the background, meant to be called once startup is done
+ */
+void VulkanDevice::log_pipeline_stats()
+{
+  if (_pipelines)
+    _pipelines->wait();
+
+  std::lock_guard<std::mutex> lock(_pipe_mutex);
+  if (_pipe_count == 0)
+    return;
+
+  // formatted locally, the manipulators would otherwise stick to std::cout
+  std::ostringstream os;
+  os << "Pipeline creation: " << _pipe_count << " pipelines in " << std::fixed << std::setprecision(2) << _pipe_time << " ms, "
+     << (_pipe_cache_loaded ? "warm cache (" + std::to_string(_pipe_cache_loaded) + " bytes)" : std::string("cold cache"));
+  std::cout << os.str() << "\n";
+}
+
+/**
+ * Write the pipeline cache to its file
+ *
+ * @note The data goes to a temporary file first and is renamed over the old one, so an interrupted write never leaves a truncated cache
+ */
+void VulkanDevice::save_pipecache()
+{
+  if (!_pipe_cache)
+    return;
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(_logical_device, _pipe_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+    return;
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(_logical_device, _pipe_cache, &size, data.data()) != VK_SUCCESS)
+    return;
+
+  std::filesystem::path file = pipecache_file();
+  std::filesystem::path tmp = file;
+  tmp += ".tmp";
+
+  std::error_code ec;
+  std::filesystem::create_directories(file.parent_path(), ec);
+  {
+    std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+    if (!os.is_open())
+      return;
+    os.write(data.data(), size);
+    if (!os.good()) {
+      os.close();
+      std::filesystem::remove(tmp, ec);
+      return;
+    }
+  }
+
+  std::filesystem::rename(tmp, file, ec);
+  if (ec) {
+    std::cerr << "Could not write pipeline cache \"" << file.string() << "\": " << ec.message() << "\n";
+    std::filesystem::remove(tmp, ec);
+  }
+}
+
+std::string VulkanDevice::pipecache_file() const
+{
+  std::ostringstream os;
+  os << CACHE_DIR << "/pipeline_" << std::hex << std::setfill('0') << std::setw(4) << properties.vendorID << "_" << std::setw(4) << properties.deviceID << "_"
+     << std::setw(8) << properties.driverVersion << "_";
+  for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+    os << std::setw(2) << (uint32_t)properties.pipelineCacheUUID[i];
+  os << ".bin";
+  return os.str();
+}
+
+/**
+ * Create a graphics pipeline through the device pipeline cache
+ *
+ * @param info Pipeline create info, the cache handle is supplied by the device
+ *
+ * @return Handle of the created pipeline
+ */
+VkPipeline VulkanDevice::create_graphics_pipeline(const VkGraphicsPipelineCreateInfo &info)
+{
+  auto cache = get_or_create_pipecache();
+
+  auto start = std::chrono::steady_clock::now();
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateGraphicsPipelines(_logical_device, cache, 1, &info, nullptr, &pipeline));
+  auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  std::lock_guard<std::mutex> lock(_pipe_mutex);
+  _pipe_time += elapsed;
+  _pipe_count++;
+
+  return pipeline;
 }
 
 /**
@@ -551,6 +760,35 @@ std::optional<uint32_t> VulkanDevice::memory_type_index(uint32_t typeBits, VkMem
   return std::nullopt;
 }
 
+/**
+ * Allocate device memory and account it in the memory statistics
+ *
+ * @param info Allocation info, the size and memory type are recorded
+ * @param category What the memory is used for
+ * @param memory Pointer to the memory handle acquired by the function
+ *
+ * @return Result of vkAllocateMemory, nothing is tracked on failure
+ */
+VkResult VulkanDevice::allocate_memory(const VkMemoryAllocateInfo &info, MemoryCategory category, VkDeviceMemory *memory)
+{
+  VkResult result = vkAllocateMemory(_logical_device, &info, nullptr, memory);
+  if (result == VK_SUCCESS)
+    this->memory()->track(*memory, info.memoryTypeIndex, info.allocationSize, category);
+  return result;
+}
+
+/**
+ * Free memory from allocate_memory and drop it from the memory statistics
+ */
+void VulkanDevice::free_memory(VkDeviceMemory memory)
+{
+  if (!memory)
+    return;
+
+  this->memory()->untrack(memory);
+  vkFreeMemory(_logical_device, memory, nullptr);
+}
+
 /**
  * Create a buffer on the device
  *
@@ -589,8 +827,20 @@ std::shared_ptr<VulkanBuffer> VulkanDevice::create_buffer(VkBufferUsageFlags usa
     memAlloc.pNext = &allocFlagsInfo;
   }
 
+  MemoryCategory category = MemoryCategory::other;
+  if (usageFlags & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+    category = MemoryCategory::vertex;
+  else if (usageFlags & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+    category = MemoryCategory::index;
+  else if (usageFlags & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+    category = MemoryCategory::uniform;
+  else if (usageFlags & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+    category = MemoryCategory::storage;
+  else if (usageFlags == VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
+    category = MemoryCategory::staging;
+
   VkDeviceMemory memory;
-  VK_CHECK_RESULT(vkAllocateMemory(_logical_device, &memAlloc, nullptr, &memory));
+  VK_CHECK_RESULT(allocate_memory(memAlloc, category, &memory));
   buffer->_memory = memory;
 
   if (data != nullptr) {
@@ -687,7 +937,7 @@ VkCommandBuffer VulkanDevice::create_command_buffer(VkCommandBufferLevel level,
 
 VkCommandBuffer VulkanDevice::create_command_buffer(VkCommandBufferLevel level, bool begin)
 {
-  return create_command_buffer(level, _command_pool, begin);
+  return create_command_buffer(level, commands()->thread_pool(), begin);
 }
 
 /**
@@ -712,15 +962,13 @@ void VulkanDevice::flush_command_buffer(VkCommandBuffer commandBuffer, VkQueue q
   VkSubmitInfo submitInfo = vks::initializers::submitInfo();
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
-  // Create fence to ensure that the command buffer has finished executing
-  VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-  VkFence fence;
-  VK_CHECK_RESULT(vkCreateFence(_logical_device, &fenceInfo, nullptr, &fence));
+  // Take a recycled fence to ensure that the command buffer has finished executing
+  VkFence fence = commands()->acquire_fence();
   // Submit to the queue
   VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
   // Wait for the fence to signal that command buffer has finished executing
   VK_CHECK_RESULT(vkWaitForFences(_logical_device, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
-  vkDestroyFence(_logical_device, fence, nullptr);
+  commands()->release_fence(fence);
   if (free) {
     vkFreeCommandBuffers(_logical_device, pool, 1, &commandBuffer);
   }
@@ -728,7 +976,7 @@ void VulkanDevice::flush_command_buffer(VkCommandBuffer commandBuffer, VkQueue q
 
 void VulkanDevice::flush_command_buffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free)
 {
-  return flush_command_buffer(commandBuffer, queue, _command_pool, free);
+  return flush_command_buffer(commandBuffer, queue, commands()->thread_pool(), free);
 }
 
 std::vector<VkCommandBuffer> VulkanDevice::create_command_buffers(uint32_t n)
@@ -772,6 +1020,74 @@ VkQueue VulkanDevice::transfer_queue(uint32_t idx)
   return queue;
 }
 
+/**
+ * Get the uploader that stages data through the transfer queue
+ *
+ * @note Created on first use, uploads are tracked with a timeline semaphore when the device supports it
+ */
+VulkanTransfer *VulkanDevice::transfer()
+{
+  if (!_transfer)
+    _transfer = std::make_unique<VulkanTransfer>(this);
+  return _transfer.get();
+}
+
+/**
+ * Get the library that shares pipelines with identical state and compiles them on worker threads
+ */
+VulkanPipelineLibrary *VulkanDevice::pipelines()
+{
+  if (!_pipelines)
+    _pipelines = std::make_unique<VulkanPipelineLibrary>(this);
+  return _pipelines.get();
+}
+
+/**
+ * Get the allocator that hands out descriptor sets from chained per-frame and persistent pools
+ */
+VulkanDescriptorAllocator *VulkanDevice::descriptors()
+{
+  if (!_descriptors)
+    _descriptors = std::make_unique<VulkanDescriptorAllocator>(this);
+  return _descriptors.get();
+}
+
+/**
+ * Get the GPU timestamp profiler shared by the views of the device
+ *
+ * @note Disabled when the graphics queue family reports no valid timestamp bits
+ */
+VulkanProfiler *VulkanDevice::profiler()
+{
+  if (!_profiler)
+    _profiler = std::make_unique<VulkanProfiler>(this);
+  return _profiler.get();
+}
+
+/**
+ * Get the accounting of device memory by heap and category
+ *
+ * @note Reports heap budget and usage through VK_EXT_memory_budget when the device supports it
+ */
+VulkanMemoryTracker *VulkanDevice::memory()
+{
+  if (!_memory)
+    _memory = std::make_unique<VulkanMemoryTracker>(this, _memory_budget);
+  return _memory.get();
+}
+
+/**
+ * Get the per-thread command pools and the fence and semaphore free lists
+ *
+ * @note One-off command buffers from create_command_buffer without a pool come from the pool of the calling thread
+ */
+VulkanCommandPools *VulkanDevice::commands()
+{
+  if (!_commands)
+    _commands = std::make_unique<VulkanCommandPools>(this);
+  return _commands.get();
+}
+
 /**
  * Check if an extension is supported by the (physical device)
  *
@@ -19,9 +19,16 @@
 #include <exception>
 #include <optional>
 #include <memory>
+#include <mutex>
 
 class VulkanBuffer;
 class VulkanImage;
+class VulkanTransfer;
+class VulkanPipelineLibrary;
+class VulkanDescriptorAllocator;
+class VulkanProfiler;
+class VulkanMemoryTracker;
+class VulkanCommandPools;
 
 class VulkanDevice : public std::enable_shared_from_this<VulkanDevice>{
 public:
@@ -33,12 +40,13 @@ public:
   VkCommandPool command_pool() { return _command_pool; }
 
   VkResult realize(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char *> enabledExtensions, void *pNextChain,
-                               bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+                               bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
 
   VkRenderPass create_render_pass(VkFormat color, VkFormat depth = VK_FORMAT_D24_UNORM_S8_UINT);
   void destroy_render_pass(VkRenderPass rdpass);
   
-  std::tuple<VkImage, VkDeviceMemory> create_image(int w, int h, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+  std::tuple<VkImage, VkDeviceMemory> create_image(int w, int h, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM,
+                                                   MemoryCategory category = MemoryCategory::texture);
   VkImageView create_image_view(VkImage img, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
 
   std::shared_ptr<VulkanImage> create_color_image(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
@@ -49,13 +57,18 @@ public:
   VkShaderModule create_shader(const char *source, int n);
 
   VkPipelineCache get_or_create_pipecache();
+  void save_pipecache();
+  void log_pipeline_stats();
 
-  VkDescriptorPool get_or_create_descriptor_pool();
+  VkPipeline create_graphics_pipeline(const VkGraphicsPipelineCreateInfo &info);
 
   uint32_t queue_family_index(VkQueueFlags queueFlags) const;
 
   std::optional<uint32_t> memory_type_index(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
 
+  VkResult allocate_memory(const VkMemoryAllocateInfo &info, MemoryCategory category, VkDeviceMemory *memory);
+  void free_memory(VkDeviceMemory memory);
+
   std::shared_ptr<VulkanBuffer> create_buffer(VkBufferUsageFlags usageFlags, 
     VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, void *data = nullptr);
   void copy_buffer(VulkanBuffer *src, VulkanBuffer *dst, VkQueue queue, VkBufferCopy *copyRegion = nullptr);
@@ -74,6 +87,21 @@ public:
   VkQueue graphic_queue(uint32_t idx = 0);
   VkQueue transfer_queue(uint32_t idx = 0);
 
+  uint32_t graphic_family() const { return _queue_family.graphics; }
+  uint32_t transfer_family() const { return _queue_family.transfer; }
+
+  VulkanTransfer *transfer();
+
+  VulkanPipelineLibrary *pipelines();
+
+  VulkanDescriptorAllocator *descriptors();
+
+  VulkanProfiler *profiler();
+
+  VulkanMemoryTracker *memory();
+
+  VulkanCommandPools *commands();
+
   bool extension_supported(std::string extension);
   VkFormat supported_depth_format(bool checkSamplingSupport);
 
@@ -81,9 +109,33 @@ public:
 
   const std::vector<VkQueueFamilyProperties> &queue_family_properties() { return _queue_family_properties; }
 
+  const VkPhysicalDeviceVulkan12Features &features12() const { return _enabled_features12; }
+
+  const VkPhysicalDeviceVulkan13Features &features13() const { return _enabled_features13; }
+
+  // vkCmdBeginRendering and vkCmdPipelineBarrier2 are usable
+  bool dynamic_rendering() const { return _enabled_features13.dynamicRendering && _enabled_features13.synchronization2; }
+
+  // VkPresentIdKHR and vkWaitForPresentKHR are usable
+  bool present_wait() const { return _present_wait; }
+
+  // vkCmdDrawIndexedIndirectCount with many draws that select their data by first instance
+  bool indirect_count() const
+  {
+    return _enabled_features12.drawIndirectCount && enabledFeatures.multiDrawIndirect && enabledFeatures.drawIndirectFirstInstance;
+  }
+
+  const VkPhysicalDeviceLimits &limits() const { return properties.limits; }
+
+  const VkPhysicalDeviceMemoryProperties &memory_properties() const { return memoryProperties; }
+
+  // zero on devices older than Vulkan 1.2
+  const VkPhysicalDeviceVulkan12Properties &properties12() const { return _properties12; }
+
 public:
 
   PFN_vkCmdPushDescriptorSetKHR vkCmdPushDescriptorSetKHR = nullptr;
+  PFN_vkWaitForPresentKHR vkWaitForPresentKHR = nullptr;
 
 private:
   /** @brief Physical device representation */
@@ -96,6 +148,22 @@ private:
   VkPhysicalDeviceFeatures features;
   /** @brief Features that have been enabled for use on the physical device */
   VkPhysicalDeviceFeatures enabledFeatures;
+  /** @brief Vulkan 1.2 properties of the physical device, descriptor indexing limits among them */
+  VkPhysicalDeviceVulkan12Properties _properties12 = {};
+  /** @brief Vulkan 1.2 features supported by the physical device */
+  VkPhysicalDeviceVulkan12Features _features12 = {};
+  /** @brief Vulkan 1.2 features that have been enabled, only filled when baselib builds the feature chain */
+  VkPhysicalDeviceVulkan12Features _enabled_features12 = {};
+  /** @brief Vulkan 1.3 features supported by the physical device */
+  VkPhysicalDeviceVulkan13Features _features13 = {};
+  /** @brief Vulkan 1.3 features that have been enabled, only filled when baselib builds the feature chain */
+  VkPhysicalDeviceVulkan13Features _enabled_features13 = {};
+  /** @brief VK_KHR_present_id and VK_KHR_present_wait are both supported by the physical device */
+  bool _present_wait_supported = false;
+  /** @brief Present id and present wait features, enabled together with a swapchain */
+  VkPhysicalDevicePresentIdFeaturesKHR _enabled_present_id = {};
+  VkPhysicalDevicePresentWaitFeaturesKHR _enabled_present_wait = {};
+  bool _present_wait = false;
   /** @brief Memory types and heaps of the physical device */
   VkPhysicalDeviceMemoryProperties memoryProperties;
   /** @brief Queue family properties of the physical device */
@@ -111,6 +179,20 @@ private:
     uint32_t transfer;
   } _queue_family;
 
+  std::string pipecache_file() const;
+
   VkPipelineCache _pipe_cache = VK_NULL_HANDLE;
-  VkDescriptorPool _descriptor_pool = VK_NULL_HANDLE;
+  size_t _pipe_cache_loaded = 0;
+  uint32_t _pipe_count = 0;
+  double _pipe_time = 0;
+  std::mutex _pipe_mutex;
+
+  std::unique_ptr<VulkanTransfer> _transfer;
+  std::unique_ptr<VulkanPipelineLibrary> _pipelines;
+  std::unique_ptr<VulkanDescriptorAllocator> _descriptors;
+  std::unique_ptr<VulkanProfiler> _profiler;
+
+  bool _memory_budget = false;
+  std::unique_ptr<VulkanMemoryTracker> _memory;
+  std::unique_ptr<VulkanCommandPools> _commands;
 };
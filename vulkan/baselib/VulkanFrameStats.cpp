@@ -0,0 +1,159 @@
+#include "VulkanFrameStats.h"
+
+#include "imgui/imgui.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+VulkanFrameStats::VulkanFrameStats(uint32_t capacity)
+{
+  _frames.resize(std::max(capacity, 1u));
+}
+
+const char *VulkanFrameStats::metric_name(Metric metric)
+{
+  switch (metric) {
+    case interval:
+      return "frame interval";
+    case fence_wait:
+      return "fence wait";
+    case acquire_wait:
+      return "acquire wait";
+    case cpu_record:
+      return "cpu record";
+    case gpu_frame:
+      return "gpu frame";
+    default:
+      return "unknown";
+  }
+}
+
+void VulkanFrameStats::push(const Frame &frame)
+{
+  _frames[frame.serial % _frames.size()] = frame;
+  _last = std::max(_last, frame.serial);
+}
+
+void VulkanFrameStats::set(uint64_t serial, Metric metric, float ms)
+{
+  auto &frame = _frames[serial % _frames.size()];
+  if (frame.serial == serial)
+    frame.ms[metric] = ms;
+}
+
+std::vector<float> VulkanFrameStats::values(Metric metric)
+{
+  std::vector<float> values;
+  values.reserve(_frames.size());
+
+  uint64_t first = _last >= _frames.size() ? _last - _frames.size() + 1 : 1;
+  for (uint64_t serial = first; serial <= _last; serial++) {
+    auto &frame = _frames[serial % _frames.size()];
+    if (frame.serial == serial && frame.ms[metric] >= 0)
+      values.push_back(frame.ms[metric]);
+  }
+  return values;
+}
+
+float VulkanFrameStats::percentile(Metric metric, float p)
+{
+  auto sorted = values(metric);
+  if (sorted.empty())
+    return 0;
+
+  // nearest rank, the same as the benchmark summary
+  std::sort(sorted.begin(), sorted.end());
+  size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+void VulkanFrameStats::draw_imgui()
+{
+  ImGui::SetNextWindowSize(ImVec2(420, 340), ImGuiCond_Once);
+  ImGui::Begin("frame pacing");
+
+  if (ImGui::BeginCombo("metric", metric_name(Metric(_metric)))) {
+    for (int i = 0; i < metric_count; i++) {
+      if (ImGui::Selectable(metric_name(Metric(i)), i == _metric))
+        _metric = i;
+    }
+    ImGui::EndCombo();
+  }
+
+  // the frames in the ring over time, with the percentiles of the whole ring as lines
+  auto metric = Metric(_metric);
+  auto history = values(metric);
+  float p50 = percentile(metric, 0.50f);
+  float p95 = percentile(metric, 0.95f);
+  float p99 = percentile(metric, 0.99f);
+  float scale = std::max(p99 * 1.5f, 1.f);
+
+  ImGui::PlotHistogram("##frames", history.data(), static_cast<int>(history.size()), 0, nullptr, 0, scale, ImVec2(-1, 120));
+  auto min = ImGui::GetItemRectMin();
+  auto max = ImGui::GetItemRectMax();
+  auto draw = ImGui::GetWindowDrawList();
+  std::pair<float, ImU32> lines[] = {{p50, IM_COL32(80, 220, 80, 255)}, {p95, IM_COL32(230, 200, 60, 255)}, {p99, IM_COL32(230, 70, 70, 255)}};
+  for (auto &[ms, color] : lines) {
+    float y = max.y - (max.y - min.y) * std::min(ms / scale, 1.f);
+    draw->AddLine(ImVec2(min.x, y), ImVec2(max.x, y), color);
+  }
+
+  if (ImGui::BeginTable("percentiles", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    ImGui::TableSetupColumn("ms");
+    ImGui::TableSetupColumn("p50");
+    ImGui::TableSetupColumn("p95");
+    ImGui::TableSetupColumn("p99");
+    ImGui::TableSetupColumn("max");
+    ImGui::TableHeadersRow();
+
+    for (int i = 0; i < metric_count; i++) {
+      ImGui::TableNextRow();
+      ImGui::TableSetColumnIndex(0);
+      ImGui::TextUnformatted(metric_name(Metric(i)));
+      float ps[] = {0.50f, 0.95f, 0.99f, 1.f};
+      for (int j = 0; j < 4; j++) {
+        ImGui::TableSetColumnIndex(j + 1);
+        ImGui::Text("%.2f", percentile(Metric(i), ps[j]));
+      }
+    }
+    ImGui::EndTable();
+  }
+
+  if (ImGui::Button("dump csv"))
+    dump("frame_stats.csv");
+
+  ImGui::End();
+}
+
+bool VulkanFrameStats::dump(const std::string &file)
+{
+  std::ofstream out(file);
+  if (!out) {
+    std::cerr << "could not write frame stats to " << file << "\n";
+    return false;
+  }
+
+  out << "frame";
+  for (int i = 0; i < metric_count; i++)
+    out << "," << metric_name(Metric(i)) << " ms";
+  out << "\n";
+
+  // frames without a metric leave its column empty
+  uint64_t first = _last >= _frames.size() ? _last - _frames.size() + 1 : 1;
+  for (uint64_t serial = first; serial <= _last; serial++) {
+    auto &frame = _frames[serial % _frames.size()];
+    if (frame.serial != serial)
+      continue;
+
+    out << serial;
+    for (int i = 0; i < metric_count; i++) {
+      out << ",";
+      if (frame.ms[i] >= 0)
+        out << frame.ms[i];
+    }
+    out << "\n";
+  }
+  return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Frame pacing of a view: the interval between frames, the time spent waiting for the frame
+// slot's fence (and the present wait when pacing), for the swapchain image, the time from
+// there to the submit, and the GPU time of the submission from timestamps around it. The
+// last frames are kept in a ring indexed by frame serial; the GPU time of a frame arrives
+// after it was pushed, once its fence has signaled.
+class VulkanFrameStats {
+public:
+  enum Metric {
+    interval,
+    fence_wait,
+    acquire_wait,
+    cpu_record,
+    gpu_frame,
+    metric_count,
+  };
+
+  struct Frame {
+    uint64_t serial = 0;
+    // negative until known
+    float ms[metric_count] = {-1, -1, -1, -1, -1};
+  };
+
+  VulkanFrameStats(uint32_t capacity = 1024);
+
+  static const char *metric_name(Metric metric);
+
+  void push(const Frame &frame);
+
+  // fills in a metric of a frame that is still in the ring
+  void set(uint64_t serial, Metric metric, float ms);
+
+  // over the frames in the ring that have the metric, p in [0, 1]
+  float percentile(Metric metric, float p);
+
+  void draw_imgui();
+
+  // every frame in the ring as csv, oldest first
+  bool dump(const std::string &file);
+
+private:
+  // values of the frames in the ring that have the metric, oldest first
+  std::vector<float> values(Metric metric);
+
+private:
+  std::vector<Frame> _frames;
+  uint64_t _last = 0;
+
+  int _metric = interval;
+};
@@ -3,6 +3,9 @@
 #include "VulkanView.h"
 #include "VulkanDevice.h"
 #include "VulkanBuffer.h"
+#include "VulkanTransfer.h"
+#include "VulkanPipelineLibrary.h"
+#include "VulkanProfiler.h"
 #include "VulkanTools.h"
 #include "VulkanInitializers.hpp"
 #include "VulkanSwapChain.h"
@@ -39,32 +42,14 @@ VulkanImGUI::VulkanImGUI(VulkanView* view) : _view(view)
   _font_view = device->create_image_view(_font_img);
 
   uint32_t sz = texWidth * texHeight * 4;
-  auto buf = device->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz, data);
-  auto cmd = device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-  vks::tools::setImageLayout(cmd, _font_img, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                             VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-
-  VkBufferImageCopy copy_region = {};
-  copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  copy_region.imageSubresource.layerCount = 1;
-  copy_region.imageExtent.width = texWidth;
-  copy_region.imageExtent.height = texHeight;
-  copy_region.imageExtent.depth = 1;
-
-  vkCmdCopyBufferToImage(cmd, *buf, _font_img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-
-  vks::tools::setImageLayout(cmd, _font_img, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-
-  device->flush_command_buffer(cmd, device->transfer_queue(0));
-  buf->destroy();
+  device->transfer()->upload_image(_font_img, texWidth, texHeight, data, sz);
 }
 
 VulkanImGUI::~VulkanImGUI()
 {
   auto device = _view->device();
   if (_pipeline)
-    vkDestroyPipeline(*device, _pipeline, nullptr);
+    device->pipelines()->release(_pipeline);
   if (_pipe_layout)
     vkDestroyPipelineLayout(*device, _pipe_layout, nullptr);
   if (_descriptor_pool)
@@ -85,7 +70,7 @@ VulkanImGUI::~VulkanImGUI()
   if (_font_img)
     vkDestroyImage(*device, _font_img, nullptr);
   if (_font_memory)
-    vkFreeMemory(*device, _font_memory, nullptr);
+    device->free_memory(_font_memory);
 }
 
 void VulkanImGUI::resize(int w, int h)
@@ -145,9 +130,6 @@ void VulkanImGUI::create_pipeline(VkFormat clrformat)
 
   //-----------------------------------------------------------------------------------------------------------
 
-  // Push constants for UI rendering parameters
-  VkPipelineCache pipe_cache = device->get_or_create_pipecache();
-
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
       vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 
@@ -180,13 +162,13 @@ void VulkanImGUI::create_pipeline(VkFormat clrformat)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = device->create_shader((char *)imgui_vert, sizeof(imgui_vert));
+  shaderStages[0].module = device->pipelines()->shader("imgui.vert", (char *)imgui_vert, sizeof(imgui_vert));
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = device->create_shader((char *)imgui_frag, sizeof(imgui_frag));
+  shaderStages[1].module = device->pipelines()->shader("imgui.frag", (char *)imgui_frag, sizeof(imgui_frag));
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -229,22 +211,25 @@ void VulkanImGUI::create_pipeline(VkFormat clrformat)
 
   pipelineCreateInfo.pVertexInputState = &vertexInputState;
 
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*device, pipe_cache, 1, &pipelineCreateInfo, nullptr, &_pipeline));
-
-  vkDestroyShaderModule(*device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*device, shaderStages[1].module, nullptr);
+  if (_pipeline)
+    device->pipelines()->release(_pipeline);
+  _pipeline = device->pipelines()->create(pipelineCreateInfo);
 }
 
 void VulkanImGUI::check_frame(int count, VkFormat clrformat)
 {
-  auto device = _view->device();
-
-  for (auto& framebuf : _frame_bufs)
-    vkDestroyFramebuffer(*device, framebuf, nullptr);
+  // the old framebuffers and the buffers of the other images may still be in flight
+  _view->defer_destroy([device = _view->device(), frame_bufs = _frame_bufs]() {
+    for (auto &framebuf : frame_bufs)
+      vkDestroyFramebuffer(*device, framebuf, nullptr);
+  });
 
   _frame_bufs = _view->swapchain()->create_frame_buffer(_render_pass, VK_NULL_HANDLE);
-  if (count != _cmd_bufs.size())
-    _cmd_bufs = _view->device()->create_command_buffers(count);
+  if (count > _cmd_bufs.size()) {
+    auto more = _view->device()->create_command_buffers(count - _cmd_bufs.size());
+    _cmd_bufs.insert(_cmd_bufs.end(), more.begin(), more.end());
+    _frames.resize(count);
+  }
 
   build_command_buffers();
 }
@@ -252,38 +237,51 @@ void VulkanImGUI::check_frame(int count, VkFormat clrformat)
 bool VulkanImGUI::update_frame()
 {
   ImDrawData* imDrawData = ImGui::GetDrawData();
-  bool updateCmdBuffers = false;
-
-  if (!imDrawData) {
+  if (!imDrawData)
     return false;
-  };
+
+  // every image records the new draw data the next time it comes around
+  _generation++;
+  return true;
+}
+
+VkCommandBuffer VulkanImGUI::command_buffer(uint32_t index)
+{
+  auto &frame = _frames[index];
+  if (frame.generation != _generation) {
+    upload(frame);
+    record(index);
+    frame.generation = _generation;
+  }
+  return _cmd_bufs[index];
+}
+
+void VulkanImGUI::upload(FrameData &frame)
+{
+  ImDrawData* imDrawData = ImGui::GetDrawData();
+  frame.vertex_count = 0;
+  if (!imDrawData)
+    return;
 
   VkDeviceSize vertex_buf_size = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
   VkDeviceSize index_buf_size = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
 
   if (vertex_buf_size == 0 || index_buf_size == 0) {
-    return false;
+    return;
   }
   vertex_buf_size = (vertex_buf_size / 0x40 + 1) * 0x40;
   index_buf_size = (index_buf_size / 0x40 + 1) * 0x40;
 
+  // the buffers of an image are only read by its own submissions, which are done by now
   auto device = _view->device();
+  if (frame.vert_buf == 0 || frame.vert_buf->size() < vertex_buf_size)
+    frame.vert_buf = device->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertex_buf_size, 0);
 
-  auto vbuf = _vert_buf, ibuf = _index_buf;
-  if (_vert_buf == 0 || _vert_buf->size() < vertex_buf_size) {
-    _vert_buf_bak = device->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertex_buf_size, 0);
-    vbuf = _vert_buf_bak;
-    updateCmdBuffers = true;
-  }
-
-  if (_index_buf == 0 || _index_buf->size() < index_buf_size) {
-    _index_buf_bak = device->create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, index_buf_size, 0);
-    ibuf = _index_buf_bak;
-    updateCmdBuffers = true;
-  }
+  if (frame.index_buf == 0 || frame.index_buf->size() < index_buf_size)
+    frame.index_buf = device->create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, index_buf_size, 0);
 
-  uint8_t* vtxDst = vbuf->map();
-  uint8_t* idxDst = ibuf->map();
+  auto vtxDst = reinterpret_cast<ImDrawVert *>(frame.vert_buf->map());
+  auto idxDst = reinterpret_cast<ImDrawIdx *>(frame.index_buf->map());
   for (int n = 0; n < imDrawData->CmdListsCount; n++) {
     const ImDrawList* cmd_list = imDrawData->CmdLists[n];
     memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
@@ -291,21 +289,20 @@ bool VulkanImGUI::update_frame()
     vtxDst += cmd_list->VtxBuffer.Size;
     idxDst += cmd_list->IdxBuffer.Size;
   }
-  vbuf->flush();
-  ibuf->flush();
-  vbuf->unmap();
-  ibuf->unmap();
+  frame.vert_buf->flush();
+  frame.index_buf->flush();
+  frame.vert_buf->unmap();
+  frame.index_buf->unmap();
 
-  return updateCmdBuffers || _force_update;
+  frame.vertex_count = imDrawData->TotalVtxCount;
 }
 
-void VulkanImGUI::draw(const VkCommandBuffer cmdbuf)
+void VulkanImGUI::draw(const VkCommandBuffer cmdbuf, const FrameData &frame)
 {
   ImDrawData* imdata = ImGui::GetDrawData();
-  if (!imdata || imdata->CmdListsCount == 0)
+  if (!imdata || imdata->CmdListsCount == 0 || frame.vertex_count == 0)
     return;
 
-  _force_update = false;
   auto& io = ImGui::GetIO();
 
   vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
@@ -316,14 +313,10 @@ void VulkanImGUI::draw(const VkCommandBuffer cmdbuf)
 
   vkCmdPushConstants(cmdbuf, _pipe_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &const_block);
 
-  if (_vert_buf_bak)
-    _vert_buf = std::move(_vert_buf_bak);
-  if (_index_buf_bak)
-    _index_buf = std::move(_index_buf_bak);
-
   VkDeviceSize offsets[1] = {};
-  vkCmdBindVertexBuffers(cmdbuf, 0, 1, *_vert_buf, offsets);
-  vkCmdBindIndexBuffer(cmdbuf, *_index_buf, 0, VK_INDEX_TYPE_UINT16);
+  VkBuffer vert_buf = *frame.vert_buf;
+  vkCmdBindVertexBuffers(cmdbuf, 0, 1, &vert_buf, offsets);
+  vkCmdBindIndexBuffer(cmdbuf, *frame.index_buf, 0, VK_INDEX_TYPE_UINT16);
 
   uint32_t indexOffset = 0, vertexOffset = 0;
   for (int32_t i = 0; i < imdata->CmdListsCount; i++) {
@@ -374,7 +367,7 @@ bool VulkanImGUI::mouse_move(SDL_MouseMotionEvent& ev)
 
 void VulkanImGUI::dirty()
 {
-  _force_update = true;
+  _generation++;
 }
 
 void VulkanImGUI::create_canvas()
@@ -434,11 +427,12 @@ void VulkanImGUI::create_renderpass(VkFormat color)
 
 void VulkanImGUI::build_command_buffers()
 {
-  auto& framebuffers = _frame_bufs;
-  auto& renderPass = _render_pass;
-  auto device = _view->device();
+  _generation++;
+}
 
-  assert(framebuffers.size() == _cmd_bufs.size());
+void VulkanImGUI::record(uint32_t index)
+{
+  assert(index < _frame_bufs.size());
 
   VkCommandBufferBeginInfo buf_info = {};
   buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -447,7 +441,8 @@ void VulkanImGUI::build_command_buffers()
   VkRenderPassBeginInfo renderPassBeginInfo = {};
   renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassBeginInfo.pNext = nullptr;
-  renderPassBeginInfo.renderPass = renderPass;
+  renderPassBeginInfo.renderPass = _render_pass;
+  renderPassBeginInfo.framebuffer = _frame_bufs[index];
   renderPassBeginInfo.renderArea.offset.x = 0;
   renderPassBeginInfo.renderArea.offset.y = 0;
   renderPassBeginInfo.renderArea.extent.width = _view->width();
@@ -455,36 +450,37 @@ void VulkanImGUI::build_command_buffers()
   renderPassBeginInfo.clearValueCount = 0;
   renderPassBeginInfo.pClearValues = nullptr;
 
-  for (int i = 0; i < _cmd_bufs.size(); i++) {
-    renderPassBeginInfo.framebuffer = framebuffers[i];
-    auto& cmd_buf = _cmd_bufs[i];
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
-
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    {
-      VkViewport viewport = {};
-      viewport.y = _view->height();
-      viewport.width = _view->width();
-      viewport.height = -_view->height();
-      viewport.minDepth = 0;
-      viewport.maxDepth = 1;
-      vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-    }
+  auto profiler = _view->device()->profiler();
+  auto& cmd_buf = _cmd_bufs[index];
+  VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
+
+  profiler->record(cmd_buf, index, VulkanProfiler::overlay_pass);
+  profiler->begin(cmd_buf, "imgui");
+  vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+  {
+    VkViewport viewport = {};
+    viewport.y = _view->height();
+    viewport.width = _view->width();
+    viewport.height = -_view->height();
+    viewport.minDepth = 0;
+    viewport.maxDepth = 1;
+    vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+  }
 
-    {
-      VkRect2D scissor = {};
-      scissor.extent.width = _view->width();
-      scissor.extent.height = _view->height();
-      scissor.offset.x = 0;
-      scissor.offset.y = 0;
-      vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-    }
+  {
+    VkRect2D scissor = {};
+    scissor.extent.width = _view->width();
+    scissor.extent.height = _view->height();
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+  }
 
-    draw(cmd_buf);
+  draw(cmd_buf, _frames[index]);
 
-    vkCmdEndRenderPass(cmd_buf);
+  vkCmdEndRenderPass(cmd_buf);
+  profiler->end(cmd_buf);
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
-  }
+  VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
 }
@@ -21,9 +21,12 @@ public:
 
   void check_frame(int n, VkFormat clrformat);
 
+  // takes the draw data of the last ImGui::Render, false without any
   bool update_frame();
 
-  void draw(const VkCommandBuffer cmdbuf);
+  // overlay of one swapchain image, uploaded and recorded again only if the draw data changed
+  // since the image was last used; its previous submission has to be done
+  VkCommandBuffer command_buffer(uint32_t index);
 
   bool mouse_down(SDL_MouseButtonEvent &ev);
 
@@ -32,17 +35,30 @@ public:
   bool mouse_move(SDL_MouseMotionEvent &ev);
 
 private:
+  struct FrameData {
+    std::shared_ptr<VulkanBuffer> vert_buf;
+    std::shared_ptr<VulkanBuffer> index_buf;
+    uint32_t vertex_count = 0;
+    uint64_t generation = 0;
+  };
+
   void dirty();
 
+  void upload(FrameData &frame);
+
+  void record(uint32_t index);
+
+  void draw(const VkCommandBuffer cmdbuf, const FrameData &frame);
+
   void create_canvas();
 
   void create_renderpass(VkFormat color);
 
+  // marks the overlay of every image as stale
   void build_command_buffers();
 
 private:
   bool _initialized = false;
-  bool _force_update = false;
   VulkanView *_view = 0;
 
   VkRenderPass _render_pass = VK_NULL_HANDLE;
@@ -58,8 +74,9 @@ private:
   VkPipelineLayout _pipe_layout = VK_NULL_HANDLE;
   VkPipeline _pipeline = VK_NULL_HANDLE;
 
-  std::shared_ptr<VulkanBuffer> _vert_buf, _vert_buf_bak;
-  std::shared_ptr<VulkanBuffer> _index_buf, _index_buf_bak;
+  // vertex and index data per swapchain image, so an update never waits for the GPU
+  std::vector<FrameData> _frames;
+  uint64_t _generation = 1;
 
   VkImage _font_img;
   VkDeviceMemory _font_memory;
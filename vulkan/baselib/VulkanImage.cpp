@@ -16,7 +16,7 @@ VulkanImage::~VulkanImage()
     _image = VK_NULL_HANDLE;
   }
   if (_image_mem) {
-    vkFreeMemory(*_device, _image_mem, nullptr);
+    _device->free_memory(_image_mem);
     _image_mem = VK_NULL_HANDLE;
   }
 
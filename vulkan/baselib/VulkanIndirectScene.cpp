@@ -0,0 +1,293 @@
+#include "VulkanIndirectScene.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTransfer.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanPipelineLibrary.h"
+#include "VulkanMaterialTable.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+#include "IndirectPipeline.h"
+#include "MeshPrimitive.h"
+#include "Frustum.h"
+
+#include "tmath.h"
+#include "config.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#define SHADER_DIR ROOT_DIR##"/vulkan/baselib/shaders"
+
+namespace {
+
+struct CullParams {
+  uint32_t draw_count;
+  uint32_t view;
+  uint32_t max_draws;
+};
+
+} // namespace
+
+VulkanIndirectScene::VulkanIndirectScene(const std::shared_ptr<VulkanDevice> &dev, uint32_t max_draws, uint32_t views)
+  : _device(dev)
+  , _max_draws(max_draws)
+  , _views(std::max(views, 1u))
+{
+  _commands = dev->create_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 _max_draws * _views * sizeof(VkDrawIndexedIndirectCommand));
+  _counts = dev->create_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _views * sizeof(uint32_t));
+
+  {
+    auto binding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0);
+    auto layoutInfo = vks::initializers::descriptorSetLayoutCreateInfo(&binding, 1);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*dev, &layoutInfo, nullptr, &_draw_layout));
+    _draw_set = dev->descriptors()->allocate(_draw_layout);
+  }
+
+  {
+    VkDescriptorSetLayoutBinding bindings[] = {
+        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+    };
+    auto layoutInfo = vks::initializers::descriptorSetLayoutCreateInfo(bindings, 4);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*dev, &layoutInfo, nullptr, &_cull_layout));
+    _cull_set = dev->descriptors()->allocate(_cull_layout);
+  }
+
+  // the draw records are written by realize once the number of frames is known
+  VkDescriptorBufferInfo commands = {*_commands, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo counts = {*_counts, 0, VK_WHOLE_SIZE};
+  VkWriteDescriptorSet writes[] = {
+      vks::initializers::writeDescriptorSet(_cull_set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &commands),
+      vks::initializers::writeDescriptorSet(_cull_set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &counts),
+  };
+  vkUpdateDescriptorSets(*dev, 2, writes, 0, nullptr);
+
+  create_cull_pipeline();
+}
+
+VulkanIndirectScene::~VulkanIndirectScene()
+{
+  auto descriptors = _device->descriptors();
+  descriptors->release(_draw_layout, _draw_set);
+  descriptors->release(_cull_layout, _cull_set);
+  descriptors->forget(_draw_layout);
+  descriptors->forget(_cull_layout);
+  if (_data)
+    _draws->unmap();
+
+  vkDestroyPipeline(*_device, _cull_pipeline, nullptr);
+  vkDestroyPipelineLayout(*_device, _cull_pipe_layout, nullptr);
+  vkDestroyDescriptorSetLayout(*_device, _cull_layout, nullptr);
+  vkDestroyDescriptorSetLayout(*_device, _draw_layout, nullptr);
+}
+
+bool VulkanIndirectScene::supported(VulkanDevice *dev)
+{
+  return dev->indirect_count();
+}
+
+void VulkanIndirectScene::create_cull_pipeline()
+{
+  VkPushConstantRange range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullParams)};
+  auto pipeLayoutInfo = vks::initializers::pipelineLayoutCreateInfo(&_cull_layout, 1);
+  pipeLayoutInfo.pushConstantRangeCount = 1;
+  pipeLayoutInfo.pPushConstantRanges = &range;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(*_device, &pipeLayoutInfo, nullptr, &_cull_pipe_layout));
+
+  // the pipeline library only keeps graphics pipelines
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.layout = _cull_pipe_layout;
+  pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = _device->pipelines()->shader(SHADER_DIR "/cull.comp.spv");
+  pipelineInfo.stage.pName = "main";
+  VK_CHECK_RESULT(vkCreateComputePipelines(*_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_cull_pipeline));
+}
+
+uint32_t VulkanIndirectScene::add(const std::shared_ptr<MeshPrimitive> &pri, uint32_t material, const tg::mat4 &m)
+{
+  if (_count >= _max_draws)
+    throw std::runtime_error("too many draws in the indirect scene.");
+
+  Geometry geometry;
+  geometry.pri = pri;
+  geometry.sphere = pri->sphere();
+  _geometry.push_back(geometry);
+
+  IndirectDraw record = {};
+  record.material = material;
+  record.index_count = pri->index_count();
+  record.first_index = _index_count;
+  record.vertex_offset = static_cast<int32_t>(_vertex_count);
+  _records.push_back(record);
+  _index_count += pri->index_count();
+  _vertex_count += static_cast<uint32_t>(pri->_vertexs.size());
+
+  set_transform(_count, m);
+  return _count++;
+}
+
+void VulkanIndirectScene::set_transform(uint32_t draw, const tg::mat4 &m)
+{
+  assert(draw < _geometry.size());
+
+  auto &record = _records[draw];
+  record.m = m;
+  record.sphere = Frustum::transform(_geometry[draw].sphere, m);
+  changed(draw, draw + 1);
+}
+
+void VulkanIndirectScene::changed(uint32_t begin, uint32_t end)
+{
+  // one range per region, scattered changes copy the records between them as well
+  for (auto &range : _dirty) {
+    if (range.begin >= range.end) {
+      range = {begin, end};
+    } else {
+      range.begin = std::min(range.begin, begin);
+      range.end = std::max(range.end, end);
+    }
+  }
+}
+
+void VulkanIndirectScene::realize(uint32_t frames)
+{
+  if (_geometry.empty())
+    return;
+
+  // regions start at offsets a dynamic storage buffer can be bound at
+  VkDeviceSize alignment = std::max<VkDeviceSize>(_device->limits().minStorageBufferOffsetAlignment, 1);
+  _region_size = (_max_draws * sizeof(IndirectDraw) + alignment - 1) & ~(alignment - 1);
+
+  // host visible so transforms can be changed without a transfer
+  if (_data)
+    _draws->unmap();
+  _draws = _device->create_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                  _region_size * frames);
+  _data = _draws->map();
+
+  _dirty.assign(frames, Range{0, _count});
+  for (uint32_t frame = 0; frame < frames; frame++)
+    update(frame);
+
+  VkDescriptorBufferInfo draws = {*_draws, 0, _max_draws * sizeof(IndirectDraw)};
+  VkWriteDescriptorSet writes[] = {
+      vks::initializers::writeDescriptorSet(_draw_set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0, &draws),
+      vks::initializers::writeDescriptorSet(_cull_set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, &draws),
+  };
+  vkUpdateDescriptorSets(*_device, 2, writes, 0, nullptr);
+
+  std::vector<tg::vec3> positions, normals;
+  std::vector<tg::vec2> uvs;
+  std::vector<uint16_t> indices;
+  positions.reserve(_vertex_count);
+  normals.reserve(_vertex_count);
+  uvs.reserve(_vertex_count);
+  indices.reserve(_index_count);
+
+  // missing attributes are padded, the vertex offsets of the records count positions
+  for (auto &geometry : _geometry) {
+    auto &pri = *geometry.pri;
+    positions.insert(positions.end(), pri._vertexs.begin(), pri._vertexs.end());
+    normals.insert(normals.end(), pri._normals.begin(), pri._normals.end());
+    normals.resize(positions.size(), tg::vec3(0, 0, 1));
+    uvs.insert(uvs.end(), pri._uvs.begin(), pri._uvs.end());
+    uvs.resize(positions.size(), tg::vec2(0, 0));
+    indices.insert(indices.end(), pri._indexs.begin(), pri._indexs.end());
+  }
+
+  auto transfer = _device->transfer();
+  auto upload = [&](const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkAccessFlags access) {
+    auto buf = _device->create_buffer(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size, 0);
+    transfer->upload_buffer(buf.get(), data, size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, access);
+    return buf;
+  };
+  _positions = upload(positions.data(), positions.size() * sizeof(tg::vec3), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+  _normals = upload(normals.data(), normals.size() * sizeof(tg::vec3), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+  _uvs = upload(uvs.data(), uvs.size() * sizeof(tg::vec2), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+  _indices = upload(indices.data(), indices.size() * sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_ACCESS_INDEX_READ_BIT);
+}
+
+void VulkanIndirectScene::update(uint32_t frame)
+{
+  // an empty scene has no regions
+  if (!_data)
+    return;
+  assert(frame < _dirty.size());
+
+  auto &range = _dirty[frame];
+  if (range.begin < range.end)
+    memcpy(_data + frame * _region_size + range.begin * sizeof(IndirectDraw), _records.data() + range.begin,
+           (range.end - range.begin) * sizeof(IndirectDraw));
+  range = {};
+}
+
+void VulkanIndirectScene::set_frustum_buffer(const VkDescriptorBufferInfo &descriptor)
+{
+  auto write = vks::initializers::writeDescriptorSet(_cull_set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+                                                     const_cast<VkDescriptorBufferInfo *>(&descriptor));
+  vkUpdateDescriptorSets(*_device, 1, &write, 0, nullptr);
+}
+
+CullFrustum VulkanIndirectScene::frustum(const tg::mat4 &view_proj)
+{
+  return Frustum(view_proj).planes();
+}
+
+void VulkanIndirectScene::cull(VkCommandBuffer cmd_buf, uint32_t frame, uint32_t frustum_offset, uint32_t view)
+{
+  assert(view < _views);
+  assert(!_data || frame < _dirty.size());
+
+  // the draws of an earlier frame may still read the commands and the count
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+  vkCmdFillBuffer(cmd_buf, *_counts, view * sizeof(uint32_t), sizeof(uint32_t), 0);
+
+  VkMemoryBarrier barrier = vks::initializers::memoryBarrier();
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+
+  if (_count && _data) {
+    CullParams params = {_count, view, _max_draws};
+    // in binding order, the frustum before the draw records
+    uint32_t offsets[2] = {frustum_offset, static_cast<uint32_t>(frame * _region_size)};
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipe_layout, 0, 1, &_cull_set, 2, offsets);
+    vkCmdPushConstants(cmd_buf, _cull_pipe_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(cmd_buf, (_count + 63) / 64, 1, 1);
+  }
+
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanIndirectScene::draw(VkCommandBuffer cmd_buf, const std::shared_ptr<IndirectPipeline> &pipeline, uint32_t frame, uint32_t view)
+{
+  if (!pipeline || !pipeline->valid() || !_indices)
+    return;
+
+  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
+
+  VkDescriptorSet sets[2] = {pipeline->materials()->descriptor_set(), _draw_set};
+  uint32_t offset = static_cast<uint32_t>(frame * _region_size);
+  vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipe_layout(), 2, 2, sets, 1, &offset);
+
+  VkBuffer bufs[3] = {*_positions, *_normals, *_uvs};
+  VkDeviceSize offsets[3] = {};
+  vkCmdBindVertexBuffers(cmd_buf, 0, 3, bufs, offsets);
+  vkCmdBindIndexBuffer(cmd_buf, *_indices, 0, VK_INDEX_TYPE_UINT16);
+
+  vkCmdDrawIndexedIndirectCount(cmd_buf, *_commands, view * _max_draws * sizeof(VkDrawIndexedIndirectCommand), *_counts,
+                                view * sizeof(uint32_t), _count, sizeof(VkDrawIndexedIndirectCommand));
+}
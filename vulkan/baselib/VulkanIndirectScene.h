@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <vector>
+
+#include "tvec.h"
+#include "RenderData.h"
+
+class VulkanDevice;
+class VulkanBuffer;
+class MeshPrimitive;
+class IndirectPipeline;
+
+// Draws a whole scene with one vkCmdDrawIndexedIndirectCount per view. The geometry of
+// every primitive is appended to shared vertex and index buffers, and each primitive
+// becomes an IndirectDraw record with its transform, material, bounding sphere and
+// index range. cull() records a compute pass that tests the spheres against a frustum and
+// compacts the visible draws into indirect commands and a count, draw() binds the shared
+// buffers once and draws them, so the CPU cost no longer grows with the draws. Views cull
+// into commands of their own, e.g. the camera and a shadow map in the same frame. The
+// records have a region per frame in flight like InstancedMesh, update() copies the ones
+// moved since the region of a frame was last written.
+class VulkanIndirectScene {
+public:
+  VulkanIndirectScene(const std::shared_ptr<VulkanDevice> &dev, uint32_t max_draws = 16384, uint32_t views = 2);
+  ~VulkanIndirectScene();
+
+  static bool supported(VulkanDevice *dev);
+
+  // appends the geometry of the primitive as a new draw and returns its index, drawable
+  // after the next realize()
+  uint32_t add(const std::shared_ptr<MeshPrimitive> &pri, uint32_t material, const tg::mat4 &m);
+
+  // moves a draw and its bounds, the regions get it in their next update()
+  void set_transform(uint32_t draw, const tg::mat4 &m);
+
+  // uploads the shared buffers of all draws added so far, no pending frame may use them;
+  // frames is the number of frames recorded and in flight, e.g. the swapchain images
+  void realize(uint32_t frames);
+
+  // call once the fence of the frame has signaled, before it is submitted again
+  void update(uint32_t frame);
+
+  uint32_t count() { return _count; }
+
+  uint32_t views() { return _views; }
+
+  // set 3 of IndirectPipeline, the draw records for the vertex shader
+  VkDescriptorSetLayout draw_layout() { return _draw_layout; }
+  VkDescriptorSet draw_set() { return _draw_set; }
+
+  // UNIFORM_BUFFER_DYNAMIC holding the CullFrustum of a view, e.g. from a uniform ring
+  void set_frustum_buffer(const VkDescriptorBufferInfo &descriptor);
+
+  // the planes of the clip space of view_proj in world space
+  static CullFrustum frustum(const tg::mat4 &view_proj);
+
+  // outside a render pass, culls the draws in the region of the frame against the frustum
+  // at the offset of the frustum buffer into the commands of the view
+  void cull(VkCommandBuffer cmd_buf, uint32_t frame, uint32_t frustum_offset, uint32_t view = 0);
+
+  // the draws of the view that passed its last cull; sets 0 and 1 are bound by the caller
+  void draw(VkCommandBuffer cmd_buf, const std::shared_ptr<IndirectPipeline> &pipeline, uint32_t frame, uint32_t view = 0);
+
+private:
+  struct Geometry {
+    std::shared_ptr<MeshPrimitive> pri;
+    // the bounding sphere in the primitive's space
+    tg::vec4 sphere;
+  };
+
+  void create_cull_pipeline();
+
+  void changed(uint32_t begin, uint32_t end);
+
+private:
+  std::shared_ptr<VulkanDevice> _device;
+
+  uint32_t _max_draws = 0, _views = 0;
+  uint32_t _count = 0;
+
+  std::vector<Geometry> _geometry;
+  uint32_t _index_count = 0, _vertex_count = 0;
+
+  std::shared_ptr<VulkanBuffer> _positions, _normals, _uvs, _indices;
+
+  std::vector<IndirectDraw> _records;
+
+  // the records each region is missing, one range per frame
+  struct Range {
+    uint32_t begin = 0, end = 0;
+  };
+  std::vector<Range> _dirty;
+
+  // host visible records per frame, the compacted commands and a count per view
+  std::shared_ptr<VulkanBuffer> _draws, _commands, _counts;
+  uint8_t *_data = nullptr;
+  VkDeviceSize _region_size = 0;
+
+  VkDescriptorSetLayout _draw_layout = VK_NULL_HANDLE;
+  VkDescriptorSet _draw_set = VK_NULL_HANDLE;
+
+  VkDescriptorSetLayout _cull_layout = VK_NULL_HANDLE;
+  VkDescriptorSet _cull_set = VK_NULL_HANDLE;
+  VkPipelineLayout _cull_pipe_layout = VK_NULL_HANDLE;
+  VkPipeline _cull_pipeline = VK_NULL_HANDLE;
+};
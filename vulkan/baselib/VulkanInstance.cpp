@@ -6,6 +6,7 @@
 #include <string>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 #include <vulkan/vulkan.h> 
 #include <vulkan/vulkan_win32.h>
@@ -88,9 +89,6 @@ void VulkanInstance::initialize()
   appInfo.pEngineName = "demo";
   appInfo.apiVersion = VK_API_VERSION_1_3;
 
-  std::vector<const char*> instanceExtensions = {VK_KHR_SURFACE_EXTENSION_NAME};
-  instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
-
   uint32_t extCount = 0;
   std::vector<std::string> supportedExt;
   vkEnumerateInstanceExtensionProperties(nullptr, &extCount, nullptr);
@@ -101,6 +99,15 @@ void VulkanInstance::initialize()
         supportedExt.emplace_back(ext.extensionName);
     }
   }
+  // a headless setup such as lavapipe without a display may lack the surface extensions
+  std::vector<const char*> instanceExtensions;
+  for (auto ext : {VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME}) {
+    if (std::find(supportedExt.begin(), supportedExt.end(), ext) != supportedExt.end())
+      instanceExtensions.push_back(ext);
+    else
+      std::cerr << "Instance extension \"" << ext << "\" is not present, only offscreen rendering is available\n";
+  }
+
   VkInstanceCreateInfo instanceCreateInfo = {};
   instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   instanceCreateInfo.pNext = NULL;
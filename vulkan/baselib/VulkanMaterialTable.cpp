@@ -0,0 +1,158 @@
+#include "VulkanMaterialTable.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTexture.h"
+#include "VulkanTools.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+VulkanMaterialTable::VulkanMaterialTable(const std::shared_ptr<VulkanDevice> &dev, uint32_t max_materials, uint32_t max_textures)
+  : _device(dev)
+  , _max_materials(max_materials)
+  , _max_textures(max_textures)
+{
+  // the array lives in an update after bind pool, which has its own, usually larger, limits
+  auto &props = dev->properties12();
+  _max_textures = std::min(_max_textures, props.maxDescriptorSetUpdateAfterBindSampledImages);
+  _max_textures = std::min(_max_textures, props.maxPerStageDescriptorUpdateAfterBindSamplers);
+  _max_textures = std::min(_max_textures, props.maxPerStageDescriptorUpdateAfterBindSampledImages);
+  _max_textures = std::min(_max_textures, props.maxDescriptorSetUpdateAfterBindSamplers);
+
+  VkDescriptorSetLayoutBinding bindings[2] = {};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[1].descriptorCount = _max_textures;
+  bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  // Textures are appended while recorded command buffers still reference the set,
+  // only the slots a draw actually indexes have to be valid.
+  VkDescriptorBindingFlags binding_flags[2] = {};
+  binding_flags[1] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                     VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+  VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo = {};
+  flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+  flagsInfo.bindingCount = 2;
+  flagsInfo.pBindingFlags = binding_flags;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.pNext = &flagsInfo;
+  layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+  layoutInfo.bindingCount = 2;
+  layoutInfo.pBindings = bindings;
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*dev, &layoutInfo, nullptr, &_layout));
+
+  VkDescriptorPoolSize pool_sizes[] = {{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+                                       {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _max_textures}};
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  pool_info.maxSets = 1;
+  pool_info.poolSizeCount = 2;
+  pool_info.pPoolSizes = pool_sizes;
+  VK_CHECK_RESULT(vkCreateDescriptorPool(*dev, &pool_info, nullptr, &_pool));
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = _pool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &_layout;
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(*dev, &allocInfo, &_set));
+
+  // Host visible so materials can be appended without a transfer, they are only
+  // written before the draws that use them are submitted
+  VkDeviceSize sz = _max_materials * sizeof(BindlessMaterial);
+  _buf = dev->create_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
+  _data = reinterpret_cast<BindlessMaterial *>(_buf->map());
+
+  VkDescriptorBufferInfo descriptor = {};
+  descriptor.buffer = *_buf;
+  descriptor.offset = 0;
+  descriptor.range = VK_WHOLE_SIZE;
+
+  VkWriteDescriptorSet write = {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = _set;
+  write.dstBinding = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pBufferInfo = &descriptor;
+  vkUpdateDescriptorSets(*dev, 1, &write, 0, nullptr);
+}
+
+VulkanMaterialTable::~VulkanMaterialTable()
+{
+  if (_data) {
+    _buf->unmap();
+    _data = nullptr;
+  }
+  _buf.reset();
+
+  if (_pool) {
+    vkDestroyDescriptorPool(*_device, _pool, nullptr);
+    _pool = VK_NULL_HANDLE;
+    _set = VK_NULL_HANDLE;
+  }
+
+  if (_layout) {
+    vkDestroyDescriptorSetLayout(*_device, _layout, nullptr);
+    _layout = VK_NULL_HANDLE;
+  }
+}
+
+bool VulkanMaterialTable::supported(VulkanDevice *dev)
+{
+  auto &f = dev->features12();
+  return f.runtimeDescriptorArray && f.descriptorBindingPartiallyBound && f.descriptorBindingSampledImageUpdateAfterBind &&
+         f.descriptorBindingUpdateUnusedWhilePending && f.shaderSampledImageArrayNonUniformIndexing;
+}
+
+uint32_t VulkanMaterialTable::add(const Material &m)
+{
+  // past the end of the mapped buffer otherwise, also in release builds
+  if (_count >= _max_materials)
+    throw std::runtime_error("material table of " + std::to_string(_max_materials) + " materials is full.");
+
+  auto &dst = _data[_count];
+  dst.ao = m.pbrdata.ao;
+  dst.metallic = m.pbrdata.metallic;
+  dst.roughness = m.pbrdata.roughness;
+  dst.tex = m.albedo_tex ? texture_index(m.albedo_tex) : -1;
+  dst.albedo = m.pbrdata.albedo;
+
+  return _count++;
+}
+
+int VulkanMaterialTable::texture_index(const std::shared_ptr<VulkanTexture> &tex)
+{
+  auto it = _texture_ids.find(tex.get());
+  if (it != _texture_ids.end())
+    return it->second;
+
+  if (_textures.size() >= _max_textures)
+    return -1;
+
+  int id = static_cast<int>(_textures.size());
+  _textures.push_back(tex);
+  _texture_ids.emplace(tex.get(), id);
+
+  auto descriptor = tex->descriptor();
+  VkWriteDescriptorSet write = {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = _set;
+  write.dstBinding = 1;
+  write.dstArrayElement = id;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &descriptor;
+  vkUpdateDescriptorSets(*_device, 1, &write, 0, nullptr);
+
+  return id;
+}
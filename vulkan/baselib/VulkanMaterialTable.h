@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "RenderData.h"
+
+class VulkanDevice;
+class VulkanBuffer;
+class VulkanTexture;
+
+// All materials of a scene in one descriptor set: binding 0 is a storage buffer of
+// BindlessMaterial, binding 1 a partially bound array of albedo textures indexed by
+// BindlessMaterial::tex. Draws select their material with a push-constant index.
+class VulkanMaterialTable {
+public:
+  VulkanMaterialTable(const std::shared_ptr<VulkanDevice> &dev, uint32_t max_materials = 4096, uint32_t max_textures = 1024);
+  ~VulkanMaterialTable();
+
+  static bool supported(VulkanDevice *dev);
+
+  VkDescriptorSetLayout layout() { return _layout; }
+
+  VkDescriptorSet descriptor_set() { return _set; }
+
+  uint32_t add(const Material &m);
+
+  int texture_index(const std::shared_ptr<VulkanTexture> &tex);
+
+  uint32_t count() { return _count; }
+
+private:
+  std::shared_ptr<VulkanDevice> _device;
+
+  uint32_t _max_materials = 0, _max_textures = 0;
+
+  VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+  VkDescriptorPool _pool = VK_NULL_HANDLE;
+  VkDescriptorSet _set = VK_NULL_HANDLE;
+
+  std::shared_ptr<VulkanBuffer> _buf;
+  BindlessMaterial *_data = nullptr;
+  uint32_t _count = 0;
+
+  std::vector<std::shared_ptr<VulkanTexture>> _textures;
+  std::unordered_map<VulkanTexture *, int> _texture_ids;
+};
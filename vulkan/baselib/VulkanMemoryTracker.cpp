@@ -0,0 +1,169 @@
+#include "VulkanMemoryTracker.h"
+#include "VulkanDevice.h"
+
+#include "imgui/imgui.h"
+
+namespace {
+
+// without the budget extension only this share of a heap is assumed to be ours
+const double heap_share = 0.8;
+
+// keep a margin below the reported budget, it moves with other processes
+const double budget_margin = 0.95;
+
+double mb(VkDeviceSize size)
+{
+  return size / (1024.0 * 1024.0);
+}
+
+} // namespace
+
+VulkanMemoryTracker::VulkanMemoryTracker(VulkanDevice *dev, bool budget_ext) : _device(dev), _budget_ext(budget_ext)
+{
+  _heap_tracked.resize(dev->memory_properties().memoryHeapCount, 0);
+}
+
+const char *VulkanMemoryTracker::category_name(MemoryCategory category)
+{
+  switch (category) {
+    case MemoryCategory::vertex:
+      return "vertex";
+    case MemoryCategory::index:
+      return "index";
+    case MemoryCategory::uniform:
+      return "uniform";
+    case MemoryCategory::storage:
+      return "storage";
+    case MemoryCategory::texture:
+      return "texture";
+    case MemoryCategory::render_target:
+      return "render target";
+    case MemoryCategory::staging:
+      return "staging";
+    default:
+      return "other";
+  }
+}
+
+void VulkanMemoryTracker::track(VkDeviceMemory memory, uint32_t type, VkDeviceSize size, MemoryCategory category)
+{
+  Allocation allocation;
+  allocation.heap = _device->memory_properties().memoryTypes[type].heapIndex;
+  allocation.size = size;
+  allocation.category = category;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _allocations[memory] = allocation;
+  _heap_tracked[allocation.heap] += size;
+  _category_size[size_t(category)] += size;
+  _category_count[size_t(category)]++;
+}
+
+void VulkanMemoryTracker::untrack(VkDeviceMemory memory)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _allocations.find(memory);
+  if (it == _allocations.end())
+    return;
+
+  auto &allocation = it->second;
+  _heap_tracked[allocation.heap] -= allocation.size;
+  _category_size[size_t(allocation.category)] -= allocation.size;
+  _category_count[size_t(allocation.category)]--;
+  _allocations.erase(it);
+}
+
+void VulkanMemoryTracker::query_heaps(std::vector<Heap> &heaps)
+{
+  auto &props = _device->memory_properties();
+  heaps.resize(props.memoryHeapCount);
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+  budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  if (_budget_ext) {
+    VkPhysicalDeviceMemoryProperties2 props2 = {};
+    props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    props2.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(_device->physical_device(), &props2);
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (uint32_t i = 0; i < props.memoryHeapCount; i++) {
+    auto &heap = heaps[i];
+    heap.size = props.memoryHeaps[i].size;
+    heap.flags = props.memoryHeaps[i].flags;
+    heap.tracked = _heap_tracked[i];
+    if (_budget_ext) {
+      heap.budget = budget.heapBudget[i];
+      heap.usage = budget.heapUsage[i];
+    } else {
+      heap.budget = VkDeviceSize(heap.size * heap_share);
+      heap.usage = heap.tracked;
+    }
+  }
+}
+
+VulkanMemoryTracker::Stats VulkanMemoryTracker::stats()
+{
+  Stats stats;
+  query_heaps(stats.heaps);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (size_t i = 0; i < size_t(MemoryCategory::count); i++) {
+    stats.category_size[i] = _category_size[i];
+    stats.category_count[i] = _category_count[i];
+  }
+  stats.allocations = static_cast<uint32_t>(_allocations.size());
+  return stats;
+}
+
+bool VulkanMemoryTracker::fits(VkDeviceSize size, VkMemoryPropertyFlags props)
+{
+  auto type = _device->memory_type_index(~0u, props);
+  if (!type)
+    return false;
+
+  std::vector<Heap> heaps;
+  query_heaps(heaps);
+
+  auto &heap = heaps[_device->memory_properties().memoryTypes[*type].heapIndex];
+  return heap.usage + size <= VkDeviceSize(heap.budget * budget_margin);
+}
+
+void VulkanMemoryTracker::draw_imgui()
+{
+  auto stats = this->stats();
+
+  ImGui::SetNextWindowSize(ImVec2(360, 300), ImGuiCond_Once);
+  ImGui::Begin("GPU memory");
+
+  ImGui::Text("%u allocations%s", stats.allocations, _budget_ext ? "" : ", no budget extension");
+
+  for (size_t i = 0; i < stats.heaps.size(); i++) {
+    auto &heap = stats.heaps[i];
+    bool local = heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    ImGui::Text("heap %zu%s: %.1f / %.1f MB", i, local ? " (device)" : "", mb(heap.usage), mb(heap.budget));
+    float fraction = heap.budget ? float(double(heap.usage) / heap.budget) : 0.f;
+    ImGui::ProgressBar(fraction, ImVec2(-1, 0));
+  }
+
+  if (ImGui::BeginTable("categories", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    ImGui::TableSetupColumn("category");
+    ImGui::TableSetupColumn("count");
+    ImGui::TableSetupColumn("MB");
+    ImGui::TableHeadersRow();
+
+    for (size_t i = 0; i < size_t(MemoryCategory::count); i++) {
+      ImGui::TableNextRow();
+      ImGui::TableSetColumnIndex(0);
+      ImGui::TextUnformatted(category_name(MemoryCategory(i)));
+      ImGui::TableSetColumnIndex(1);
+      ImGui::Text("%u", stats.category_count[i]);
+      ImGui::TableSetColumnIndex(2);
+      ImGui::Text("%.2f", mb(stats.category_size[i]));
+    }
+    ImGui::EndTable();
+  }
+
+  ImGui::End();
+}
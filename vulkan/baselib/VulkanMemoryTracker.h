@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "VulkanDef.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class VulkanDevice;
+
+// Accounts every allocation made through VulkanDevice::allocate_memory by heap and
+// category. Heap usage and budget come from VK_EXT_memory_budget when the device has
+// it, otherwise the tracked sizes are held against a share of the heap size.
+class VulkanMemoryTracker {
+public:
+  struct Heap {
+    VkDeviceSize size = 0;
+    VkDeviceSize budget = 0;
+    VkDeviceSize usage = 0;
+    VkDeviceSize tracked = 0;
+    VkMemoryHeapFlags flags = 0;
+  };
+
+  struct Stats {
+    std::vector<Heap> heaps;
+    VkDeviceSize category_size[size_t(MemoryCategory::count)] = {};
+    uint32_t category_count[size_t(MemoryCategory::count)] = {};
+    uint32_t allocations = 0;
+  };
+
+  VulkanMemoryTracker(VulkanDevice *dev, bool budget_ext);
+
+  void track(VkDeviceMemory memory, uint32_t type, VkDeviceSize size, MemoryCategory category);
+  void untrack(VkDeviceMemory memory);
+
+  Stats stats();
+
+  // whether size more bytes stay within the budget of the heap backing props
+  bool fits(VkDeviceSize size, VkMemoryPropertyFlags props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  bool budget_ext() { return _budget_ext; }
+
+  void draw_imgui();
+
+  static const char *category_name(MemoryCategory category);
+
+private:
+  struct Allocation {
+    uint32_t heap = 0;
+    VkDeviceSize size = 0;
+    MemoryCategory category = MemoryCategory::other;
+  };
+
+  void query_heaps(std::vector<Heap> &heaps);
+
+private:
+  VulkanDevice *_device = nullptr;
+  bool _budget_ext = false;
+
+  std::mutex _mutex;
+
+  std::unordered_map<VkDeviceMemory, Allocation> _allocations;
+  std::vector<VkDeviceSize> _heap_tracked;
+  VkDeviceSize _category_size[size_t(MemoryCategory::count)] = {};
+  uint32_t _category_count[size_t(MemoryCategory::count)] = {};
+};
@@ -1,6 +1,8 @@
 #include "VulkanPipeline.h"
 #include "VulkanPass.h"
 #include "VulkanTools.h"
+#include "VulkanPipelineLibrary.h"
+#include "VulkanDescriptorAllocator.h"
 
 #include "config.h"
 #include "tvec.h"
@@ -18,14 +20,11 @@ VulkanPipeline::VulkanPipeline(const std::shared_ptr<VulkanDevice>& dev) : _devi
 VulkanPipeline::~VulkanPipeline()
 {
   if(_matrix_layout) {
-    vkDestroyDescriptorSetLayout(*_device, _matrix_layout, nullptr);
+    destroy_layout(_matrix_layout);
     _matrix_layout = VK_NULL_HANDLE;
   }
 
-  if(_pipeline) {
-    vkDestroyPipeline(*_device, _pipeline, nullptr);
-    _pipeline = VK_NULL_HANDLE;
-  }
+  release();
 
   if(_pipe_layout) {
     vkDestroyPipelineLayout(*_device, _pipe_layout, nullptr);
@@ -33,11 +32,17 @@ VulkanPipeline::~VulkanPipeline()
   }
 }
 
+void VulkanPipeline::destroy_layout(VkDescriptorSetLayout layout)
+{
+  _device->descriptors()->forget(layout);
+  vkDestroyDescriptorSetLayout(*_device, layout, nullptr);
+}
+
 VkDescriptorSetLayout VulkanPipeline::matrix_layout()
 {
   if (!_matrix_layout) {
     VkDescriptorSetLayoutBinding layoutBinding = {};
-    layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layoutBinding.descriptorType = uniform_type();
     layoutBinding.descriptorCount = 1;
     layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     layoutBinding.pImmutableSamplers = nullptr;
@@ -56,6 +61,55 @@ VkDescriptorSetLayout VulkanPipeline::matrix_layout()
   return _matrix_layout;
 }
 
+VkPipeline VulkanPipeline::pipeline()
+{
+  if (!_pipeline && _pending.valid()) {
+    _pipeline = _pending.get();
+    _pending = {};
+  }
+  return _pipeline;
+}
+
+void VulkanPipeline::set_rendering(const std::vector<VkFormat> &colors, VkFormat depth)
+{
+  _dynamic_rendering = true;
+  _color_formats = colors;
+  _depth_format = depth;
+}
+
+void VulkanPipeline::compile(const VkGraphicsPipelineCreateInfo &info)
+{
+  release();
+
+  if (!_dynamic_rendering) {
+    _pending = _device->pipelines()->request(info);
+    return;
+  }
+
+  VkPipelineRenderingCreateInfo rendering = {};
+  rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+  rendering.pNext = info.pNext;
+  rendering.colorAttachmentCount = static_cast<uint32_t>(_color_formats.size());
+  rendering.pColorAttachmentFormats = _color_formats.data();
+  rendering.depthAttachmentFormat = _depth_format;
+  rendering.stencilAttachmentFormat = vks::tools::formatHasStencil(_depth_format) ? _depth_format : VK_FORMAT_UNDEFINED;
+
+  VkGraphicsPipelineCreateInfo dynamic = info;
+  dynamic.pNext = &rendering;
+  dynamic.renderPass = VK_NULL_HANDLE;
+  dynamic.subpass = 0;
+  _pending = _device->pipelines()->request(dynamic);
+}
+
+void VulkanPipeline::release()
+{
+  auto pipeline = this->pipeline();
+  if (pipeline) {
+    _device->pipelines()->release(pipeline);
+    _pipeline = VK_NULL_HANDLE;
+  }
+}
+
 VkPipelineLayout VulkanPipeline::pipe_layout()
 {
   if (!_pipe_layout) {
@@ -3,6 +3,9 @@
 #include <vulkan/vulkan_core.h>
 #include "VulkanDevice.h"
 
+#include <future>
+#include <vector>
+
 class VulkanPass;
 
 class VulkanPipeline{
@@ -10,20 +13,40 @@ public:
   VulkanPipeline(const std::shared_ptr<VulkanDevice> &dev);
   ~VulkanPipeline();
 
-  operator VkPipeline() { return _pipeline; }
+  operator VkPipeline() { return pipeline(); }
+
+  VkPipeline pipeline();
 
+  // render_pass may be null once set_rendering gave the attachment formats
   virtual void realize(VulkanPass *render_pass, int subpass = 0) = 0;
 
+  // builds the pipeline for dynamic rendering with these attachment formats instead of
+  // a render pass, the stencil format follows depth formats that have stencil
+  void set_rendering(const std::vector<VkFormat> &colors, VkFormat depth = VK_FORMAT_UNDEFINED);
+
   VkDescriptorSetLayout matrix_layout();
   void set_matrix_layout(VkDescriptorSetLayout layout) { _matrix_layout = layout; }
 
-  bool valid() { return _pipeline != VK_NULL_HANDLE; }
+  bool valid() { return _pipeline != VK_NULL_HANDLE || _pending.valid(); }
+
+  // per-frame uniform sets become UNIFORM_BUFFER_DYNAMIC, set before the layouts are created
+  void set_dynamic_uniforms(bool dynamic) { _dynamic_uniforms = dynamic; }
 
   VkPipelineLayout pipe_layout();
 
 protected:
 
   virtual VkPipelineLayout  create_pipe_layout() = 0;
+
+  // hands the state to the device pipeline library, compiled in the background
+  void compile(const VkGraphicsPipelineCreateInfo &info);
+
+  void release();
+
+  // drops the sets the descriptor allocator recycled for the layout before destroying it
+  void destroy_layout(VkDescriptorSetLayout layout);
+
+  VkDescriptorType uniform_type() { return _dynamic_uniforms ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; }
   
   std::shared_ptr<VulkanDevice> _device;
 
@@ -31,4 +54,11 @@ protected:
 
   VkPipelineLayout  _pipe_layout = VK_NULL_HANDLE;
   VkPipeline        _pipeline = VK_NULL_HANDLE;
+  std::shared_future<VkPipeline> _pending;
+
+  bool _dynamic_uniforms = false;
+
+  bool _dynamic_rendering = false;
+  std::vector<VkFormat> _color_formats;
+  VkFormat _depth_format = VK_FORMAT_UNDEFINED;
 };
\ No newline at end of file
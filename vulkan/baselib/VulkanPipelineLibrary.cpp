@@ -0,0 +1,409 @@
+#include "VulkanPipelineLibrary.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include "ThreadPool.h"
+
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+struct KeyWriter {
+  std::string data;
+
+  template <typename T>
+  void add(const T &v)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    data.append(reinterpret_cast<const char *>(&v), sizeof(T));
+  }
+
+  template <typename T>
+  void add(const std::vector<T> &v)
+  {
+    add(static_cast<uint32_t>(v.size()));
+    if (!v.empty())
+      data.append(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+  }
+};
+
+template <typename T>
+std::vector<T> copy_array(const T *p, uint32_t n)
+{
+  return p ? std::vector<T>(p, p + n) : std::vector<T>();
+}
+
+}  // namespace
+
+// Deep copy of a VkGraphicsPipelineCreateInfo so it can be compiled after the caller
+// returned, together with the key identifying its state. Only the render pass/dynamic
+// rendering info is taken from pNext chains.
+struct VulkanPipelineLibrary::State {
+  VkGraphicsPipelineCreateInfo info = {};
+
+  std::vector<VkPipelineShaderStageCreateInfo> stages;
+  std::vector<std::string> names;
+  std::vector<VkSpecializationInfo> specs;
+  std::vector<std::vector<VkSpecializationMapEntry>> spec_entries;
+  std::vector<std::vector<char>> spec_data;
+
+  VkPipelineVertexInputStateCreateInfo vertex_input = {};
+  std::vector<VkVertexInputBindingDescription> bindings;
+  std::vector<VkVertexInputAttributeDescription> attributes;
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+  VkPipelineTessellationStateCreateInfo tessellation = {};
+
+  VkPipelineViewportStateCreateInfo viewport = {};
+  std::vector<VkViewport> viewports;
+  std::vector<VkRect2D> scissors;
+
+  VkPipelineRasterizationStateCreateInfo rasterization = {};
+
+  VkPipelineMultisampleStateCreateInfo multisample = {};
+  std::vector<VkSampleMask> sample_mask;
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+
+  VkPipelineColorBlendStateCreateInfo color_blend = {};
+  std::vector<VkPipelineColorBlendAttachmentState> blend_attachments;
+
+  VkPipelineDynamicStateCreateInfo dynamic = {};
+  std::vector<VkDynamicState> dynamic_states;
+
+  VkPipelineRenderingCreateInfo rendering = {};
+  std::vector<VkFormat> color_formats;
+
+  std::string key;
+
+  State(const VkGraphicsPipelineCreateInfo &src);
+  State(const State &) = delete;
+  State &operator=(const State &) = delete;
+};
+
+VulkanPipelineLibrary::State::State(const VkGraphicsPipelineCreateInfo &src)
+{
+  KeyWriter key_writer;
+
+  info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  info.flags = src.flags;
+  info.layout = src.layout;
+  info.renderPass = src.renderPass;
+  info.subpass = src.subpass;
+  key_writer.add(info.flags);
+  key_writer.add(info.layout);
+  key_writer.add(info.renderPass);
+  key_writer.add(info.subpass);
+
+  for (auto next = static_cast<const VkBaseInStructure *>(src.pNext); next; next = next->pNext) {
+    if (next->sType == VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO) {
+      auto r = reinterpret_cast<const VkPipelineRenderingCreateInfo *>(next);
+      rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+      rendering.viewMask = r->viewMask;
+      rendering.depthAttachmentFormat = r->depthAttachmentFormat;
+      rendering.stencilAttachmentFormat = r->stencilAttachmentFormat;
+      color_formats = copy_array(r->pColorAttachmentFormats, r->colorAttachmentCount);
+      rendering.colorAttachmentCount = static_cast<uint32_t>(color_formats.size());
+      rendering.pColorAttachmentFormats = color_formats.data();
+      info.pNext = &rendering;
+
+      key_writer.add(rendering.viewMask);
+      key_writer.add(rendering.depthAttachmentFormat);
+      key_writer.add(rendering.stencilAttachmentFormat);
+      key_writer.add(color_formats);
+    }
+  }
+
+  stages = copy_array(src.pStages, src.stageCount);
+  names.resize(stages.size());
+  specs.resize(stages.size());
+  spec_entries.resize(stages.size());
+  spec_data.resize(stages.size());
+  for (size_t i = 0; i < stages.size(); i++) {
+    auto &stage = stages[i];
+    stage.pNext = nullptr;
+    names[i] = stage.pName ? stage.pName : "main";
+    stage.pName = names[i].c_str();
+
+    key_writer.add(stage.flags);
+    key_writer.add(stage.stage);
+    key_writer.add(stage.module);
+    key_writer.data.append(names[i]).push_back('\0');
+
+    if (stage.pSpecializationInfo) {
+      auto &spec = *stage.pSpecializationInfo;
+      spec_entries[i] = copy_array(spec.pMapEntries, spec.mapEntryCount);
+      auto data = static_cast<const char *>(spec.pData);
+      spec_data[i] = data ? std::vector<char>(data, data + spec.dataSize) : std::vector<char>();
+
+      specs[i].mapEntryCount = static_cast<uint32_t>(spec_entries[i].size());
+      specs[i].pMapEntries = spec_entries[i].data();
+      specs[i].dataSize = spec_data[i].size();
+      specs[i].pData = spec_data[i].data();
+      stage.pSpecializationInfo = &specs[i];
+
+      key_writer.add(spec_entries[i]);
+      key_writer.add(spec_data[i]);
+    } else {
+      key_writer.add(uint32_t(0));
+    }
+  }
+  info.stageCount = static_cast<uint32_t>(stages.size());
+  info.pStages = stages.data();
+
+  if (auto s = src.pVertexInputState) {
+    bindings = copy_array(s->pVertexBindingDescriptions, s->vertexBindingDescriptionCount);
+    attributes = copy_array(s->pVertexAttributeDescriptions, s->vertexAttributeDescriptionCount);
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input.flags = s->flags;
+    vertex_input.vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size());
+    vertex_input.pVertexBindingDescriptions = bindings.data();
+    vertex_input.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+    vertex_input.pVertexAttributeDescriptions = attributes.data();
+    info.pVertexInputState = &vertex_input;
+
+    key_writer.add(vertex_input.flags);
+    key_writer.add(bindings);
+    key_writer.add(attributes);
+  }
+  key_writer.add(info.pVertexInputState != nullptr);
+
+  if (auto s = src.pInputAssemblyState) {
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.flags = s->flags;
+    input_assembly.topology = s->topology;
+    input_assembly.primitiveRestartEnable = s->primitiveRestartEnable;
+    info.pInputAssemblyState = &input_assembly;
+
+    key_writer.add(input_assembly.flags);
+    key_writer.add(input_assembly.topology);
+    key_writer.add(input_assembly.primitiveRestartEnable);
+  }
+  key_writer.add(info.pInputAssemblyState != nullptr);
+
+  if (auto s = src.pTessellationState) {
+    tessellation.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+    tessellation.flags = s->flags;
+    tessellation.patchControlPoints = s->patchControlPoints;
+    info.pTessellationState = &tessellation;
+
+    key_writer.add(tessellation.flags);
+    key_writer.add(tessellation.patchControlPoints);
+  }
+  key_writer.add(info.pTessellationState != nullptr);
+
+  if (auto s = src.pViewportState) {
+    viewports = copy_array(s->pViewports, s->viewportCount);
+    scissors = copy_array(s->pScissors, s->scissorCount);
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.flags = s->flags;
+    viewport.viewportCount = s->viewportCount;
+    viewport.pViewports = viewports.empty() ? nullptr : viewports.data();
+    viewport.scissorCount = s->scissorCount;
+    viewport.pScissors = scissors.empty() ? nullptr : scissors.data();
+    info.pViewportState = &viewport;
+
+    key_writer.add(viewport.flags);
+    key_writer.add(viewport.viewportCount);
+    key_writer.add(viewport.scissorCount);
+    key_writer.add(viewports);
+    key_writer.add(scissors);
+  }
+  key_writer.add(info.pViewportState != nullptr);
+
+  if (auto s = src.pRasterizationState) {
+    rasterization = *s;
+    rasterization.pNext = nullptr;
+    info.pRasterizationState = &rasterization;
+
+    key_writer.add(rasterization.flags);
+    key_writer.add(rasterization.depthClampEnable);
+    key_writer.add(rasterization.rasterizerDiscardEnable);
+    key_writer.add(rasterization.polygonMode);
+    key_writer.add(rasterization.cullMode);
+    key_writer.add(rasterization.frontFace);
+    key_writer.add(rasterization.depthBiasEnable);
+    key_writer.add(rasterization.depthBiasConstantFactor);
+    key_writer.add(rasterization.depthBiasClamp);
+    key_writer.add(rasterization.depthBiasSlopeFactor);
+    key_writer.add(rasterization.lineWidth);
+  }
+  key_writer.add(info.pRasterizationState != nullptr);
+
+  if (auto s = src.pMultisampleState) {
+    multisample = *s;
+    multisample.pNext = nullptr;
+    if (s->pSampleMask) {
+      sample_mask = copy_array(s->pSampleMask, (static_cast<uint32_t>(s->rasterizationSamples) + 31) / 32);
+      multisample.pSampleMask = sample_mask.data();
+    }
+    info.pMultisampleState = &multisample;
+
+    key_writer.add(multisample.flags);
+    key_writer.add(multisample.rasterizationSamples);
+    key_writer.add(multisample.sampleShadingEnable);
+    key_writer.add(multisample.minSampleShading);
+    key_writer.add(sample_mask);
+    key_writer.add(multisample.alphaToCoverageEnable);
+    key_writer.add(multisample.alphaToOneEnable);
+  }
+  key_writer.add(info.pMultisampleState != nullptr);
+
+  if (auto s = src.pDepthStencilState) {
+    depth_stencil = *s;
+    depth_stencil.pNext = nullptr;
+    info.pDepthStencilState = &depth_stencil;
+
+    key_writer.add(depth_stencil.flags);
+    key_writer.add(depth_stencil.depthTestEnable);
+    key_writer.add(depth_stencil.depthWriteEnable);
+    key_writer.add(depth_stencil.depthCompareOp);
+    key_writer.add(depth_stencil.depthBoundsTestEnable);
+    key_writer.add(depth_stencil.stencilTestEnable);
+    key_writer.add(depth_stencil.front);
+    key_writer.add(depth_stencil.back);
+    key_writer.add(depth_stencil.minDepthBounds);
+    key_writer.add(depth_stencil.maxDepthBounds);
+  }
+  key_writer.add(info.pDepthStencilState != nullptr);
+
+  if (auto s = src.pColorBlendState) {
+    blend_attachments = copy_array(s->pAttachments, s->attachmentCount);
+    color_blend = *s;
+    color_blend.pNext = nullptr;
+    color_blend.attachmentCount = static_cast<uint32_t>(blend_attachments.size());
+    color_blend.pAttachments = blend_attachments.data();
+    info.pColorBlendState = &color_blend;
+
+    key_writer.add(color_blend.flags);
+    key_writer.add(color_blend.logicOpEnable);
+    key_writer.add(color_blend.logicOp);
+    key_writer.add(blend_attachments);
+    key_writer.add(color_blend.blendConstants);
+  }
+  key_writer.add(info.pColorBlendState != nullptr);
+
+  if (auto s = src.pDynamicState) {
+    dynamic_states = copy_array(s->pDynamicStates, s->dynamicStateCount);
+    dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic.flags = s->flags;
+    dynamic.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+    dynamic.pDynamicStates = dynamic_states.data();
+    info.pDynamicState = &dynamic;
+
+    key_writer.add(dynamic.flags);
+    key_writer.add(dynamic_states);
+  }
+  key_writer.add(info.pDynamicState != nullptr);
+
+  key = std::move(key_writer.data);
+}
+
+VulkanPipelineLibrary::VulkanPipelineLibrary(VulkanDevice *dev) : _device(dev)
+{
+  // created up front, the workers only use it
+  _device->get_or_create_pipecache();
+  _pool = std::make_unique<ThreadPool>();
+}
+
+VulkanPipelineLibrary::~VulkanPipelineLibrary()
+{
+  wait();
+  _pool.reset();
+
+  for (auto &[key, entry] : _pipelines)
+    vkDestroyPipeline(*_device, entry.pipeline.get(), nullptr);
+  _pipelines.clear();
+  _keys.clear();
+
+  for (auto &[file, module] : _shaders)
+    vkDestroyShaderModule(*_device, module, nullptr);
+  _shaders.clear();
+}
+
+VkShaderModule VulkanPipelineLibrary::shader(const std::string &file)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _shaders.find(file);
+  if (it != _shaders.end())
+    return it->second;
+
+  auto module = _device->create_shader(file);
+  _shaders.emplace(file, module);
+  return module;
+}
+
+VkShaderModule VulkanPipelineLibrary::shader(const std::string &name, const char *source, int n)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _shaders.find(name);
+  if (it != _shaders.end())
+    return it->second;
+
+  auto module = _device->create_shader(source, n);
+  _shaders.emplace(name, module);
+  return module;
+}
+
+std::shared_future<VkPipeline> VulkanPipelineLibrary::request(const VkGraphicsPipelineCreateInfo &info)
+{
+  auto state = std::make_shared<State>(info);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _pipelines.find(state->key);
+  if (it != _pipelines.end()) {
+    it->second.refs++;
+    return it->second.pipeline;
+  }
+
+  // the handle is mapped back to its key before the future is ready, so whoever got the
+  // handle can release it
+  Entry entry;
+  entry.refs = 1;
+  entry.pipeline = _pool
+                       ->submit([this, state]() {
+                         auto pipeline = _device->create_graphics_pipeline(state->info);
+                         std::lock_guard<std::mutex> lock(_mutex);
+                         _keys.emplace(pipeline, state->key);
+                         return pipeline;
+                       })
+                       .share();
+  _pipelines.emplace(state->key, entry);
+  return entry.pipeline;
+}
+
+void VulkanPipelineLibrary::release(VkPipeline pipeline)
+{
+  if (!pipeline)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto key = _keys.find(pipeline);
+    if (key == _keys.end())
+      return;
+
+    auto it = _pipelines.find(key->second);
+    if (--it->second.refs > 0)
+      return;
+
+    _pipelines.erase(it);
+    _keys.erase(key);
+  }
+
+  vkDestroyPipeline(*_device, pipeline, nullptr);
+}
+
+void VulkanPipelineLibrary::wait()
+{
+  // waited on without the lock, the compile tasks take it to register their handles
+  std::vector<std::shared_future<VkPipeline>> pending;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &[key, entry] : _pipelines)
+      pending.push_back(entry.pipeline);
+  }
+
+  for (auto &pipeline : pending)
+    pipeline.wait();
+}
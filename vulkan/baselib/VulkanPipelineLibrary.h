@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class VulkanDevice;
+class ThreadPool;
+
+// Owns the graphics pipelines and shader modules of a device. Requests with identical
+// state share one VkPipeline; new state is copied and compiled on worker threads so the
+// caller only blocks when it first needs the handle.
+class VulkanPipelineLibrary {
+public:
+  VulkanPipelineLibrary(VulkanDevice *dev);
+  ~VulkanPipelineLibrary();
+
+  VkShaderModule shader(const std::string &file);
+  VkShaderModule shader(const std::string &name, const char *source, int n);
+
+  std::shared_future<VkPipeline> request(const VkGraphicsPipelineCreateInfo &info);
+
+  VkPipeline create(const VkGraphicsPipelineCreateInfo &info) { return request(info).get(); }
+
+  void release(VkPipeline pipeline);
+
+  void wait();
+
+private:
+  struct State;
+
+  struct Entry {
+    std::shared_future<VkPipeline> pipeline;
+    uint32_t refs = 0;
+  };
+
+private:
+  VulkanDevice *_device = nullptr;
+
+  std::unique_ptr<ThreadPool> _pool;
+
+  std::mutex _mutex;
+  std::unordered_map<std::string, Entry> _pipelines;
+  // of the compiled pipelines, for release
+  std::unordered_map<VkPipeline, std::string> _keys;
+  std::unordered_map<std::string, VkShaderModule> _shaders;
+};
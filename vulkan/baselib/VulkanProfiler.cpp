@@ -0,0 +1,286 @@
+#include "VulkanProfiler.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+#include "imgui/imgui.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const size_t max_history = 1024;
+
+// fence slots with submission timings, a view keeps a few frames in flight
+const uint32_t max_submit_slots = 8;
+
+} // namespace
+
+VulkanProfiler::VulkanProfiler(VulkanDevice *dev, uint32_t max_images, uint32_t max_scopes)
+  : _device(dev)
+  , _max_images(max_images)
+  , _max_scopes(max_scopes)
+{
+  auto &family = dev->queue_family_properties()[dev->graphic_family()];
+  if (family.timestampValidBits == 0) {
+    std::cerr << "GPU profiler disabled, the graphics queue has no timestamp support\n";
+    return;
+  }
+
+  _period = dev->limits().timestampPeriod;
+  if (family.timestampValidBits < 64)
+    _mask = (1ull << family.timestampValidBits) - 1;
+
+  VkQueryPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  _submit_first = _max_images * pass_count * _max_scopes * 2;
+  pool_info.queryCount = _submit_first + max_submit_slots * 2;
+  VK_CHECK_RESULT(vkCreateQueryPool(*dev, &pool_info, nullptr, &_pool));
+
+  _blocks.resize(_max_images * pass_count);
+  for (uint32_t i = 0; i < _blocks.size(); i++)
+    _blocks[i].first = i * _max_scopes * 2;
+
+  _submit_written.assign(max_submit_slots, false);
+}
+
+VulkanProfiler::~VulkanProfiler()
+{
+  if (_pool) {
+    vkDestroyQueryPool(*_device, _pool, nullptr);
+    _pool = VK_NULL_HANDLE;
+  }
+}
+
+VulkanProfiler::Block *VulkanProfiler::block(VkCommandBuffer cmd)
+{
+  auto it = _recorded.find(cmd);
+  if (it == _recorded.end())
+    return nullptr;
+  return &_blocks[it->second];
+}
+
+void VulkanProfiler::record(VkCommandBuffer cmd, uint32_t image, Pass pass)
+{
+  if (!enabled())
+    return;
+
+  // a handle recorded for another image or pass before leaves its old block
+  auto it = _recorded.find(cmd);
+  if (it != _recorded.end()) {
+    _blocks[it->second].cmd = VK_NULL_HANDLE;
+    _recorded.erase(it);
+  }
+
+  if (image >= _max_images)
+    return;
+
+  uint32_t index = image * pass_count + pass;
+  auto &blk = _blocks[index];
+  if (blk.cmd)
+    _recorded.erase(blk.cmd);
+  blk.cmd = cmd;
+  _recorded[cmd] = index;
+
+  blk.used = 0;
+  blk.queries.clear();
+  blk.stack.clear();
+
+  // results still in flight belong to the old recording
+  for (auto &submitted : _submitted)
+    submitted.erase(std::remove(submitted.begin(), submitted.end(), index), submitted.end());
+}
+
+void VulkanProfiler::begin(VkCommandBuffer cmd, const char *name)
+{
+  if (!enabled())
+    return;
+
+  auto blk = block(cmd);
+  if (!blk || blk->used + 2 > _max_scopes * 2)
+    return;
+
+  Query query;
+  query.name = name;
+  query.depth = static_cast<uint32_t>(blk->stack.size());
+  query.begin = blk->first + blk->used++;
+  query.end = blk->first + blk->used++;
+
+  blk->stack.push_back(static_cast<uint32_t>(blk->queries.size()));
+  blk->queries.push_back(query);
+
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _pool, query.begin);
+}
+
+void VulkanProfiler::end(VkCommandBuffer cmd)
+{
+  if (!enabled())
+    return;
+
+  auto blk = block(cmd);
+  if (!blk || blk->stack.empty())
+    return;
+
+  auto &query = blk->queries[blk->stack.back()];
+  blk->stack.pop_back();
+
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _pool, query.end);
+}
+
+void VulkanProfiler::reset(VkCommandBuffer prologue, uint32_t frame, const VkCommandBuffer *cmds, uint32_t n)
+{
+  if (!enabled())
+    return;
+
+  if (frame >= _submitted.size())
+    _submitted.resize(frame + 1);
+
+  auto &submitted = _submitted[frame];
+  submitted.clear();
+  for (uint32_t i = 0; i < n; i++) {
+    auto it = _recorded.find(cmds[i]);
+    if (it == _recorded.end() || _blocks[it->second].used == 0)
+      continue;
+
+    auto &blk = _blocks[it->second];
+    vkCmdResetQueryPool(prologue, _pool, blk.first, blk.used);
+    submitted.push_back(it->second);
+  }
+}
+
+void VulkanProfiler::collect(uint32_t frame)
+{
+  if (!enabled() || frame >= _submitted.size() || _submitted[frame].empty())
+    return;
+
+  std::vector<Scope> scopes;
+  std::vector<uint64_t> results;
+  for (auto index : _submitted[frame]) {
+    // value and availability per query, a re-recorded buffer may have written only some
+    auto &blk = _blocks[index];
+    results.assign(blk.used * 2, 0);
+    vkGetQueryPoolResults(*_device, _pool, blk.first, blk.used, results.size() * sizeof(uint64_t), results.data(),
+                          2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    for (auto &query : blk.queries) {
+      uint32_t b = (query.begin - blk.first) * 2;
+      uint32_t e = (query.end - blk.first) * 2;
+      if (!results[b + 1] || !results[e + 1])
+        continue;
+
+      uint64_t ticks = ((results[e] & _mask) - (results[b] & _mask)) & _mask;
+      Scope scope;
+      scope.name = query.name;
+      scope.depth = query.depth;
+      scope.ms = ticks * _period / 1e6;
+      scopes.push_back(scope);
+    }
+  }
+  _submitted[frame].clear();
+
+  if (scopes.empty())
+    return;
+
+  for (auto &scope : scopes) {
+    auto it = _average.find(scope.name);
+    if (it == _average.end())
+      _average.emplace(scope.name, scope.ms);
+    else
+      it->second = it->second * 0.95 + scope.ms * 0.05;
+  }
+
+  _last = scopes;
+  _history.emplace_back(_frame_count++, std::move(scopes));
+  if (_history.size() > max_history)
+    _history.pop_front();
+}
+
+void VulkanProfiler::begin_submit(VkCommandBuffer prologue, uint32_t slot)
+{
+  if (!enabled() || slot >= max_submit_slots)
+    return;
+
+  uint32_t first = _submit_first + slot * 2;
+  vkCmdResetQueryPool(prologue, _pool, first, 2);
+  vkCmdWriteTimestamp(prologue, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _pool, first);
+}
+
+void VulkanProfiler::end_submit(VkCommandBuffer epilogue, uint32_t slot)
+{
+  if (!enabled() || slot >= max_submit_slots)
+    return;
+
+  vkCmdWriteTimestamp(epilogue, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _pool, _submit_first + slot * 2 + 1);
+  _submit_written[slot] = true;
+}
+
+float VulkanProfiler::submit_time(uint32_t slot)
+{
+  if (!enabled() || slot >= max_submit_slots || !_submit_written[slot])
+    return -1;
+  _submit_written[slot] = false;
+
+  uint64_t results[4] = {};
+  vkGetQueryPoolResults(*_device, _pool, _submit_first + slot * 2, 2, sizeof(results), results, 2 * sizeof(uint64_t),
+                        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if (!results[1] || !results[3])
+    return -1;
+
+  uint64_t ticks = ((results[2] & _mask) - (results[0] & _mask)) & _mask;
+  return float(ticks * _period / 1e6);
+}
+
+void VulkanProfiler::draw_imgui()
+{
+  ImGui::SetNextWindowSize(ImVec2(360, 240), ImGuiCond_Once);
+  ImGui::Begin("GPU profiler");
+
+  if (!enabled()) {
+    ImGui::Text("timestamps not supported");
+    ImGui::End();
+    return;
+  }
+
+  if (ImGui::BeginTable("scopes", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    ImGui::TableSetupColumn("scope");
+    ImGui::TableSetupColumn("ms");
+    ImGui::TableSetupColumn("avg ms");
+    ImGui::TableHeadersRow();
+
+    for (auto &scope : _last) {
+      ImGui::TableNextRow();
+      ImGui::TableSetColumnIndex(0);
+      ImGui::Indent(scope.depth * 12.f + 1.f);
+      ImGui::TextUnformatted(scope.name.c_str());
+      ImGui::Unindent(scope.depth * 12.f + 1.f);
+      ImGui::TableSetColumnIndex(1);
+      ImGui::Text("%.3f", scope.ms);
+      ImGui::TableSetColumnIndex(2);
+      ImGui::Text("%.3f", _average[scope.name]);
+    }
+    ImGui::EndTable();
+  }
+
+  if (ImGui::Button("export csv"))
+    export_csv("gpu_profile.csv");
+
+  ImGui::End();
+}
+
+bool VulkanProfiler::export_csv(const std::string &file)
+{
+  std::ofstream out(file);
+  if (!out) {
+    std::cerr << "could not write gpu profile to " << file << "\n";
+    return false;
+  }
+
+  out << "frame,scope,depth,ms\n";
+  for (auto &[frame, scopes] : _history) {
+    for (auto &scope : scopes)
+      out << frame << "," << scope.name << "," << scope.depth << "," << scope.ms << "\n";
+  }
+  return true;
+}
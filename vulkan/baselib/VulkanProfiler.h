@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+class VulkanDevice;
+
+// GPU timings from vkCmdWriteTimestamp. Every swapchain image has a block of queries per
+// pass in one pool; a command buffer recorded for a pass of an image takes over its block,
+// so pre-recorded buffers keep their scopes until re-recorded and reallocated buffers do
+// not use up blocks. The view resets the blocks of a frame in its prologue and reads them
+// back once the fence of that frame slot signals again, which never waits on the GPU.
+class VulkanProfiler {
+public:
+  // the command buffers of an image that hold scopes
+  enum Pass {
+    view_pass,
+    overlay_pass,
+    pass_count,
+  };
+
+  struct Scope {
+    std::string name;
+    uint32_t depth = 0;
+    double ms = 0;
+  };
+
+  VulkanProfiler(VulkanDevice *dev, uint32_t max_images = 16, uint32_t max_scopes = 64);
+  ~VulkanProfiler();
+
+  bool enabled() { return _pool != VK_NULL_HANDLE; }
+
+  // starts recording cmd for a pass of the image, forgetting the scopes the block had
+  // before; images beyond max_images are not profiled
+  void record(VkCommandBuffer cmd, uint32_t image, Pass pass);
+
+  void begin(VkCommandBuffer cmd, const char *name);
+  void end(VkCommandBuffer cmd);
+
+  // records the query resets for the command buffers submitted in this frame slot
+  void reset(VkCommandBuffer prologue, uint32_t frame, const VkCommandBuffer *cmds, uint32_t n);
+
+  // reads the last submission of the frame slot, call after its fence has signaled
+  void collect(uint32_t frame);
+
+  // a timestamp pair around a whole submission of a fence slot: the prologue resets and
+  // begins it, the last command buffer of the submission ends it
+  void begin_submit(VkCommandBuffer prologue, uint32_t slot);
+  void end_submit(VkCommandBuffer epilogue, uint32_t slot);
+
+  // GPU ms of the last submission of the fence slot, negative when unknown; read once,
+  // after its fence has signaled
+  float submit_time(uint32_t slot);
+
+  const std::vector<Scope> &frame() { return _last; }
+
+  void draw_imgui();
+
+  bool export_csv(const std::string &file);
+
+private:
+  struct Query {
+    std::string name;
+    uint32_t depth = 0;
+    uint32_t begin = 0, end = 0;
+  };
+
+  struct Block {
+    // recorded into the block last
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    uint32_t first = 0;
+    uint32_t used = 0;
+    std::vector<Query> queries;
+    std::vector<uint32_t> stack;
+  };
+
+  Block *block(VkCommandBuffer cmd);
+
+private:
+  VulkanDevice *_device = nullptr;
+
+  VkQueryPool _pool = VK_NULL_HANDLE;
+  uint32_t _max_images = 0, _max_scopes = 0;
+
+  double _period = 1.0;
+  uint64_t _mask = ~0ull;
+
+  std::vector<Block> _blocks;
+  // of the command buffers recorded into a block, one per block at most
+  std::unordered_map<VkCommandBuffer, uint32_t> _recorded;
+  // blocks by frame slot
+  std::vector<std::vector<uint32_t>> _submitted;
+
+  // the first query of the submission pairs and whether a slot's pair was written since
+  // it was read
+  uint32_t _submit_first = 0;
+  std::vector<bool> _submit_written;
+
+  std::vector<Scope> _last;
+  std::unordered_map<std::string, double> _average;
+
+  uint64_t _frame_count = 0;
+  std::deque<std::pair<uint64_t, std::vector<Scope>>> _history;
+};
@@ -0,0 +1,822 @@
+#include "VulkanRenderGraph.h"
+#include "VulkanDevice.h"
+#include "VulkanProfiler.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+VkCommandBufferInheritanceInfo VulkanRenderGraph::Target::inheritance() const
+{
+  VkCommandBufferInheritanceInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  info.renderPass = render_pass;
+  info.subpass = 0;
+  info.framebuffer = framebuffer;
+  if (!render_pass)
+    info.pNext = &rendering;
+  return info;
+}
+
+VulkanRenderGraph::PassBuilder &VulkanRenderGraph::PassBuilder::read(Resource res, Usage usage)
+{
+  _graph->_passes[_pass].accesses.push_back({res, usage, false});
+  return *this;
+}
+
+VulkanRenderGraph::PassBuilder &VulkanRenderGraph::PassBuilder::write(Resource res, Usage usage)
+{
+  _graph->_passes[_pass].accesses.push_back({res, usage, true});
+  return *this;
+}
+
+VulkanRenderGraph::PassBuilder &VulkanRenderGraph::PassBuilder::clear(Resource res, VkClearValue value)
+{
+  _graph->_passes[_pass].clears[res] = value;
+  return *this;
+}
+
+VulkanRenderGraph::PassBuilder &VulkanRenderGraph::PassBuilder::secondary()
+{
+  _graph->_passes[_pass].secondary = true;
+  return *this;
+}
+
+VulkanRenderGraph::PassBuilder &VulkanRenderGraph::PassBuilder::side_effect()
+{
+  _graph->_passes[_pass].side_effect = true;
+  return *this;
+}
+
+VulkanRenderGraph::VulkanRenderGraph(const std::shared_ptr<VulkanDevice> &dev) : _device(dev)
+{
+}
+
+VulkanRenderGraph::~VulkanRenderGraph()
+{
+  reset();
+}
+
+VulkanRenderGraph::Resource VulkanRenderGraph::create_image(const std::string &name, const ImageInfo &info)
+{
+  assert(!_compiled);
+  ResourceData res;
+  res.name = name;
+  res.info = info;
+  _resources.push_back(res);
+  return static_cast<Resource>(_resources.size() - 1);
+}
+
+VulkanRenderGraph::Resource VulkanRenderGraph::import_image(const std::string &name, const ImageInfo &info, VkImageLayout initial,
+                                                            VkImageLayout final)
+{
+  assert(!_compiled);
+  ResourceData res;
+  res.name = name;
+  res.info = info;
+  res.imported = true;
+  res.initial = initial;
+  res.final = final;
+  _resources.push_back(res);
+  return static_cast<Resource>(_resources.size() - 1);
+}
+
+void VulkanRenderGraph::bind_image(Resource res, VkImage image, VkImageView view)
+{
+  assert(_resources[res].imported);
+  _resources[res].vkimage = image;
+  _resources[res].view = view;
+}
+
+VulkanRenderGraph::Resource VulkanRenderGraph::import_buffer(const std::string &name, VkBuffer buffer)
+{
+  assert(!_compiled);
+  ResourceData res;
+  res.name = name;
+  res.image = false;
+  res.imported = true;
+  res.buffer = buffer;
+  _resources.push_back(res);
+  return static_cast<Resource>(_resources.size() - 1);
+}
+
+VulkanRenderGraph::PassBuilder VulkanRenderGraph::add_pass(const std::string &name, Execute execute)
+{
+  assert(!_compiled);
+  Pass pass;
+  pass.name = name;
+  pass.execute = std::move(execute);
+  _passes.push_back(std::move(pass));
+  return PassBuilder(this, static_cast<uint32_t>(_passes.size() - 1));
+}
+
+void VulkanRenderGraph::set_render_area(const std::string &pass, VkExtent2D extent)
+{
+  for (auto &p : _passes) {
+    if (p.name == pass)
+      p.area = extent;
+  }
+}
+
+void VulkanRenderGraph::set_dynamic_rendering(bool enable)
+{
+  assert(!_compiled);
+  _dynamic_rendering = enable;
+}
+
+void VulkanRenderGraph::reset()
+{
+  for (auto &pass : _passes) {
+    for (auto &[views, framebuffer] : pass.framebuffers)
+      vkDestroyFramebuffer(*_device, framebuffer, nullptr);
+    if (pass.render_pass)
+      vkDestroyRenderPass(*_device, pass.render_pass, nullptr);
+  }
+  _passes.clear();
+
+  for (auto &res : _resources) {
+    if (res.imported)
+      continue;
+    if (res.view)
+      vkDestroyImageView(*_device, res.view, nullptr);
+    if (res.vkimage)
+      vkDestroyImage(*_device, res.vkimage, nullptr);
+  }
+  _resources.clear();
+
+  for (auto &slot : _slots)
+    _device->free_memory(slot.memory);
+  _slots.clear();
+
+  _barriers.clear();
+  _final_barriers.clear();
+  _compiled = false;
+  _stats = {};
+}
+
+void VulkanRenderGraph::compile()
+{
+  if (_compiled)
+    return;
+
+  _stats = {};
+  cull();
+
+  for (uint32_t p = 0; p < _passes.size(); p++) {
+    auto &pass = _passes[p];
+    if (!pass.live)
+      continue;
+
+    // a resource accessed twice by one pass ends up as a single merged use
+    for (auto &access : pass.accesses) {
+      auto &res = _resources[access.res];
+      auto state = usage_state(access.usage);
+      state.write |= access.write;
+      if (res.uses.empty() || res.uses.back().first != p) {
+        res.uses.push_back({p, state});
+      } else {
+        auto &merged = res.uses.back().second;
+        if (state.write)
+          merged.layout = state.layout;
+        merged.stage |= state.stage;
+        merged.access |= state.access;
+        merged.write |= state.write;
+      }
+      res.first = std::min(res.first, p);
+      res.last = std::max(res.last, p);
+    }
+  }
+
+  create_transients();
+
+  for (auto &pass : _passes) {
+    if (pass.live)
+      create_render_pass(pass);
+  }
+
+  create_barriers();
+
+  _compiled = true;
+}
+
+void VulkanRenderGraph::cull()
+{
+  // walking back from the outputs, a pass lives if a live pass or the outside reads what it writes
+  std::vector<bool> needed(_resources.size(), false);
+  for (size_t i = 0; i < _resources.size(); i++)
+    needed[i] = _resources[i].imported;
+
+  for (auto it = _passes.rbegin(); it != _passes.rend(); ++it) {
+    auto &pass = *it;
+    pass.live = pass.side_effect;
+    for (auto &access : pass.accesses) {
+      if (access.write && needed[access.res])
+        pass.live = true;
+    }
+
+    if (!pass.live) {
+      _stats.culled++;
+      continue;
+    }
+
+    _stats.passes++;
+
+    // writes that are not cleared may keep what earlier passes wrote
+    for (auto &access : pass.accesses) {
+      if (!access.write || !pass.clears.count(access.res))
+        needed[access.res] = true;
+    }
+  }
+}
+
+void VulkanRenderGraph::create_transients()
+{
+  std::vector<Resource> transients;
+  for (Resource r = 0; r < _resources.size(); r++) {
+    auto &res = _resources[r];
+    if (res.imported || !res.image || res.uses.empty())
+      continue;
+
+    for (auto &pass : _passes) {
+      if (!pass.live)
+        continue;
+      for (auto &access : pass.accesses) {
+        if (access.res != r)
+          continue;
+        switch (access.usage) {
+        case Usage::color_attachment: res.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; break;
+        case Usage::depth_attachment:
+        case Usage::depth_read: res.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT; break;
+        case Usage::sampled: res.usage |= VK_IMAGE_USAGE_SAMPLED_BIT; break;
+        case Usage::storage_read:
+        case Usage::storage_write: res.usage |= VK_IMAGE_USAGE_STORAGE_BIT; break;
+        case Usage::transfer_src: res.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT; break;
+        case Usage::transfer_dst: res.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT; break;
+        default: break;
+        }
+      }
+    }
+
+    VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = res.info.format;
+    imageInfo.extent = {res.info.width, res.info.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = res.usage;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK_RESULT(vkCreateImage(*_device, &imageInfo, nullptr, &res.vkimage));
+    vkGetImageMemoryRequirements(*_device, res.vkimage, &res.requirements);
+
+    _stats.unaliased_size += res.requirements.size;
+    transients.push_back(r);
+  }
+  _stats.transients = static_cast<uint32_t>(transients.size());
+
+  // largest first, each image goes into the first slot it does not overlap with in time
+  std::sort(transients.begin(), transients.end(),
+            [this](Resource a, Resource b) { return _resources[a].requirements.size > _resources[b].requirements.size; });
+
+  for (auto r : transients) {
+    auto &res = _resources[r];
+    uint32_t found = UINT32_MAX;
+    for (uint32_t s = 0; s < _slots.size() && found == UINT32_MAX; s++) {
+      auto &slot = _slots[s];
+      if (!(slot.type_bits & res.requirements.memoryTypeBits))
+        continue;
+
+      bool overlap = false;
+      for (auto other : slot.resources) {
+        auto &o = _resources[other];
+        if (!(res.last < o.first || o.last < res.first))
+          overlap = true;
+      }
+      if (!overlap)
+        found = s;
+    }
+
+    if (found == UINT32_MAX) {
+      found = static_cast<uint32_t>(_slots.size());
+      _slots.emplace_back();
+    }
+
+    auto &slot = _slots[found];
+    slot.type_bits &= res.requirements.memoryTypeBits;
+    slot.size = std::max(slot.size, res.requirements.size);
+    slot.resources.push_back(r);
+    res.slot = found;
+  }
+
+  for (auto &slot : _slots) {
+    VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+    memAllocInfo.allocationSize = slot.size;
+    auto memIndex = _device->memory_type_index(slot.type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (!memIndex)
+      throw std::runtime_error("No proper memory type!");
+    memAllocInfo.memoryTypeIndex = *memIndex;
+    VK_CHECK_RESULT(_device->allocate_memory(memAllocInfo, MemoryCategory::render_target, &slot.memory));
+    _stats.transient_size += slot.size;
+
+    // the order the images take turns in, the barriers hand the memory over along it
+    std::sort(slot.resources.begin(), slot.resources.end(), [this](Resource a, Resource b) { return _resources[a].first < _resources[b].first; });
+
+    for (auto r : slot.resources) {
+      auto &res = _resources[r];
+      VK_CHECK_RESULT(vkBindImageMemory(*_device, res.vkimage, slot.memory, 0));
+
+      // depth of depth/stencil images that are sampled, both aspects otherwise
+      VkImageViewCreateInfo viewInfo = vks::initializers::imageViewCreateInfo();
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = res.info.format;
+      viewInfo.subresourceRange = {aspect(res.info.format), 0, 1, 0, 1};
+      if ((res.usage & VK_IMAGE_USAGE_SAMPLED_BIT) && has_depth(res.info.format))
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+      viewInfo.image = res.vkimage;
+      VK_CHECK_RESULT(vkCreateImageView(*_device, &viewInfo, nullptr, &res.view));
+    }
+  }
+}
+
+void VulkanRenderGraph::create_barriers()
+{
+  _barriers.clear();
+  _final_barriers.clear();
+
+  // the state every resource is in when the graph starts, left there by the previous
+  // execution or by the previous image living in the same memory
+  std::vector<State> states(_resources.size());
+  for (Resource r = 0; r < _resources.size(); r++) {
+    auto &res = _resources[r];
+    if (res.uses.empty())
+      continue;
+
+    auto &first = res.uses.front().second;
+    auto &last = res.uses.back().second;
+    auto &state = states[r];
+    if (res.imported) {
+      bool transition = res.final != VK_IMAGE_LAYOUT_UNDEFINED && res.final != last.layout;
+      state.layout = res.initial;
+      state.stage = transition ? first.stage : last.stage;
+      state.access = !transition && last.write ? last.access : 0;
+      state.write = !transition && last.write;
+    } else {
+      auto &members = _slots[res.slot].resources;
+      auto it = std::find(members.begin(), members.end(), r);
+      auto prev = it == members.begin() ? members.back() : *(it - 1);
+      auto &prev_last = _resources[prev].uses.back().second;
+      state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+      state.stage = prev_last.stage;
+      state.access = prev_last.write ? prev_last.access : 0;
+      state.write = prev_last.write;
+    }
+  }
+
+  for (uint32_t p = 0; p < _passes.size(); p++) {
+    auto &pass = _passes[p];
+    if (!pass.live)
+      continue;
+
+    for (Resource r = 0; r < _resources.size(); r++) {
+      auto &res = _resources[r];
+      auto use = std::find_if(res.uses.begin(), res.uses.end(), [p](auto &u) { return u.first == p; });
+      if (use == res.uses.end())
+        continue;
+
+      auto &dst = use->second;
+      auto &cur = states[r];
+      bool layout_change = res.image && cur.layout != dst.layout;
+
+      // reads after reads in the same layout need nothing, a later write waits for all of them
+      if (!layout_change && !cur.write && !dst.write) {
+        cur.stage |= dst.stage;
+        cur.access |= dst.access;
+        continue;
+      }
+
+      add_barrier(pass.barriers, r, cur, dst);
+      cur = dst;
+    }
+  }
+
+  for (Resource r = 0; r < _resources.size(); r++) {
+    auto &res = _resources[r];
+    if (!res.imported || res.uses.empty() || res.final == VK_IMAGE_LAYOUT_UNDEFINED || res.final == states[r].layout)
+      continue;
+
+    // handed to the presentation engine through the semaphore, otherwise to the first use
+    // of the next execution
+    State dst = {res.final, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, false};
+    if (res.final != VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
+      dst.stage = res.uses.front().second.stage;
+      dst.access = res.uses.front().second.access;
+    }
+    add_barrier(_final_barriers, r, states[r], dst);
+  }
+
+  _stats.barriers = static_cast<uint32_t>(_barriers.size());
+}
+
+void VulkanRenderGraph::add_barrier(std::vector<uint32_t> &list, Resource res, const State &src, const State &dst)
+{
+  Barrier barrier;
+  barrier.res = res;
+  barrier.src = src;
+  barrier.dst = dst;
+  // only writes have to be made available, reads just need to be done
+  if (!src.write)
+    barrier.src.access = 0;
+  list.push_back(static_cast<uint32_t>(_barriers.size()));
+  _barriers.push_back(barrier);
+}
+
+void VulkanRenderGraph::emit(VkCommandBuffer cmd_buf, const std::vector<uint32_t> &list)
+{
+  if (list.empty())
+    return;
+
+  if (_dynamic_rendering) {
+    emit2(cmd_buf, list);
+    return;
+  }
+
+  VkPipelineStageFlags src_stage = 0, dst_stage = 0;
+  std::vector<VkImageMemoryBarrier> images;
+  std::vector<VkBufferMemoryBarrier> buffers;
+  for (auto index : list) {
+    auto &barrier = _barriers[index];
+    auto &res = _resources[barrier.res];
+    src_stage |= barrier.src.stage;
+    dst_stage |= barrier.dst.stage;
+
+    if (res.image) {
+      VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+      imageBarrier.srcAccessMask = barrier.src.access;
+      imageBarrier.dstAccessMask = barrier.dst.access;
+      imageBarrier.oldLayout = barrier.src.layout;
+      imageBarrier.newLayout = barrier.dst.layout;
+      imageBarrier.image = res.vkimage;
+      imageBarrier.subresourceRange = {aspect(res.info.format), 0, 1, 0, 1};
+      images.push_back(imageBarrier);
+    } else {
+      VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+      bufferBarrier.srcAccessMask = barrier.src.access;
+      bufferBarrier.dstAccessMask = barrier.dst.access;
+      bufferBarrier.buffer = res.buffer;
+      bufferBarrier.size = VK_WHOLE_SIZE;
+      buffers.push_back(bufferBarrier);
+    }
+  }
+
+  if (!src_stage)
+    src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  if (!dst_stage)
+    dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+  vkCmdPipelineBarrier(cmd_buf, src_stage, dst_stage, 0, 0, nullptr, static_cast<uint32_t>(buffers.size()), buffers.data(),
+                       static_cast<uint32_t>(images.size()), images.data());
+}
+
+void VulkanRenderGraph::emit2(VkCommandBuffer cmd_buf, const std::vector<uint32_t> &list)
+{
+  // every barrier keeps its own stages instead of the union over the whole batch; the
+  // legacy stage and access bits have the same values in the 2 variants
+  std::vector<VkImageMemoryBarrier2> images;
+  std::vector<VkBufferMemoryBarrier2> buffers;
+  for (auto index : list) {
+    auto &barrier = _barriers[index];
+    auto &res = _resources[barrier.res];
+
+    if (res.image) {
+      VkImageMemoryBarrier2 imageBarrier = {};
+      imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+      imageBarrier.srcStageMask = barrier.src.stage;
+      imageBarrier.srcAccessMask = barrier.src.access;
+      imageBarrier.dstStageMask = barrier.dst.stage;
+      imageBarrier.dstAccessMask = barrier.dst.access;
+      imageBarrier.oldLayout = barrier.src.layout;
+      imageBarrier.newLayout = barrier.dst.layout;
+      imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      imageBarrier.image = res.vkimage;
+      imageBarrier.subresourceRange = {aspect(res.info.format), 0, 1, 0, 1};
+      images.push_back(imageBarrier);
+    } else {
+      VkBufferMemoryBarrier2 bufferBarrier = {};
+      bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+      bufferBarrier.srcStageMask = barrier.src.stage;
+      bufferBarrier.srcAccessMask = barrier.src.access;
+      bufferBarrier.dstStageMask = barrier.dst.stage;
+      bufferBarrier.dstAccessMask = barrier.dst.access;
+      bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      bufferBarrier.buffer = res.buffer;
+      bufferBarrier.size = VK_WHOLE_SIZE;
+      buffers.push_back(bufferBarrier);
+    }
+  }
+
+  VkDependencyInfo dependency = {};
+  dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependency.bufferMemoryBarrierCount = static_cast<uint32_t>(buffers.size());
+  dependency.pBufferMemoryBarriers = buffers.data();
+  dependency.imageMemoryBarrierCount = static_cast<uint32_t>(images.size());
+  dependency.pImageMemoryBarriers = images.data();
+  vkCmdPipelineBarrier2(cmd_buf, &dependency);
+}
+
+void VulkanRenderGraph::create_render_pass(Pass &pass)
+{
+  uint32_t index = static_cast<uint32_t>(&pass - _passes.data());
+
+  // colors in declaration order and the depth last, the same as the render passes
+  // pipelines are usually realized against
+  Resource depth = invalid;
+  Usage depth_usage = Usage::depth_attachment;
+  for (auto &access : pass.accesses) {
+    if (access.usage == Usage::color_attachment)
+      pass.attachments.push_back(access.res);
+    else if (access.usage == Usage::depth_attachment || access.usage == Usage::depth_read) {
+      depth = access.res;
+      depth_usage = access.usage;
+    }
+  }
+  if (depth != invalid)
+    pass.attachments.push_back(depth);
+
+  if (pass.attachments.empty())
+    return;
+
+  std::vector<VkAttachmentDescription> attachments;
+  std::vector<VkAttachmentReference> colors;
+  VkAttachmentReference depthReference = {};
+  for (auto r : pass.attachments) {
+    auto &res = _resources[r];
+    bool is_depth = r == depth;
+    auto layout = usage_state(is_depth ? depth_usage : Usage::color_attachment).layout;
+
+    // what was there before is only loaded if it is defined and not cleared anyway, and only
+    // stored if a later pass or the outside still wants it
+    bool defined = res.first < index || (res.imported && res.initial != VK_IMAGE_LAYOUT_UNDEFINED);
+    bool used_later = res.last > index || res.imported;
+    auto clear = pass.clears.find(r);
+
+    VkAttachmentDescription attachment = {};
+    attachment.format = res.info.format;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = clear != pass.clears.end() ? VK_ATTACHMENT_LOAD_OP_CLEAR
+                        : defined                  ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                                   : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.storeOp = used_later ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    bool stencil = is_depth && vks::tools::formatHasStencil(res.info.format);
+    attachment.stencilLoadOp = stencil ? attachment.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = stencil ? attachment.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // the graph transitions before the pass, the render pass itself never does
+    attachment.initialLayout = layout;
+    attachment.finalLayout = layout;
+
+    VkAttachmentReference reference = {static_cast<uint32_t>(attachments.size()), layout};
+    if (is_depth)
+      depthReference = reference;
+    else
+      colors.push_back(reference);
+    attachments.push_back(attachment);
+
+    pass.clear_values.push_back(clear != pass.clears.end() ? clear->second : VkClearValue{});
+  }
+
+  auto &first = _resources[pass.attachments.front()];
+  pass.extent = {first.info.width, first.info.height};
+  pass.descriptions = attachments;
+
+  // dynamic rendering takes the same ops and layouts per begin
+  if (_dynamic_rendering)
+    return;
+
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = static_cast<uint32_t>(colors.size());
+  subpass.pColorAttachments = colors.data();
+  subpass.pDepthStencilAttachment = depth != invalid ? &depthReference : nullptr;
+
+  VkRenderPassCreateInfo renderPassInfo = vks::initializers::renderPassCreateInfo();
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments = attachments.data();
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  VK_CHECK_RESULT(vkCreateRenderPass(*_device, &renderPassInfo, nullptr, &pass.render_pass));
+}
+
+VkFramebuffer VulkanRenderGraph::framebuffer(Pass &pass)
+{
+  std::vector<VkImageView> views;
+  for (auto r : pass.attachments)
+    views.push_back(_resources[r].view);
+
+  auto it = pass.framebuffers.find(views);
+  if (it != pass.framebuffers.end())
+    return it->second;
+
+  // one per set of bound imports, e.g. per swapchain image
+  VkFramebufferCreateInfo frameBufferCreateInfo = vks::initializers::framebufferCreateInfo();
+  frameBufferCreateInfo.renderPass = pass.render_pass;
+  frameBufferCreateInfo.attachmentCount = static_cast<uint32_t>(views.size());
+  frameBufferCreateInfo.pAttachments = views.data();
+  frameBufferCreateInfo.width = pass.extent.width;
+  frameBufferCreateInfo.height = pass.extent.height;
+  frameBufferCreateInfo.layers = 1;
+
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &framebuffer));
+  pass.framebuffers[views] = framebuffer;
+  return framebuffer;
+}
+
+void VulkanRenderGraph::begin_rendering(VkCommandBuffer cmd_buf, Pass &pass, Target &target)
+{
+  std::vector<VkRenderingAttachmentInfo> colors;
+  VkRenderingAttachmentInfo depth = {}, stencil = {};
+  VkFormat depth_format = VK_FORMAT_UNDEFINED;
+  for (size_t i = 0; i < pass.attachments.size(); i++) {
+    auto &desc = pass.descriptions[i];
+
+    VkRenderingAttachmentInfo attachment = {};
+    attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    attachment.imageView = _resources[pass.attachments[i]].view;
+    attachment.imageLayout = desc.initialLayout;
+    attachment.loadOp = desc.loadOp;
+    attachment.storeOp = desc.storeOp;
+    attachment.clearValue = pass.clear_values[i];
+
+    if (has_depth(desc.format)) {
+      depth = attachment;
+      depth_format = desc.format;
+      stencil = attachment;
+      stencil.loadOp = desc.stencilLoadOp;
+      stencil.storeOp = desc.stencilStoreOp;
+    } else {
+      colors.push_back(attachment);
+      target.color_formats.push_back(desc.format);
+    }
+  }
+  bool has_stencil = vks::tools::formatHasStencil(depth_format);
+
+  VkRenderingInfo renderingInfo = {};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+  renderingInfo.flags = pass.secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+  renderingInfo.renderArea.extent = target.extent;
+  renderingInfo.layerCount = 1;
+  renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colors.size());
+  renderingInfo.pColorAttachments = colors.data();
+  renderingInfo.pDepthAttachment = depth_format != VK_FORMAT_UNDEFINED ? &depth : nullptr;
+  renderingInfo.pStencilAttachment = has_stencil ? &stencil : nullptr;
+  vkCmdBeginRendering(cmd_buf, &renderingInfo);
+
+  target.rendering.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+  target.rendering.flags = renderingInfo.flags;
+  target.rendering.colorAttachmentCount = static_cast<uint32_t>(target.color_formats.size());
+  target.rendering.pColorAttachmentFormats = target.color_formats.data();
+  target.rendering.depthAttachmentFormat = depth_format;
+  target.rendering.stencilAttachmentFormat = has_stencil ? depth_format : VK_FORMAT_UNDEFINED;
+  target.rendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+}
+
+void VulkanRenderGraph::execute(VkCommandBuffer cmd_buf)
+{
+  compile();
+
+  auto profiler = _device->profiler();
+  for (auto &pass : _passes) {
+    if (!pass.live)
+      continue;
+
+    emit(cmd_buf, pass.barriers);
+
+    profiler->begin(cmd_buf, pass.name.c_str());
+
+    Target target;
+    target.extent = pass.extent;
+    if (pass.area.width && pass.area.height) {
+      target.extent.width = std::min(pass.area.width, pass.extent.width);
+      target.extent.height = std::min(pass.area.height, pass.extent.height);
+    }
+
+    if (_dynamic_rendering && !pass.attachments.empty()) {
+      begin_rendering(cmd_buf, pass, target);
+    } else if (pass.render_pass) {
+      target.render_pass = pass.render_pass;
+      target.framebuffer = framebuffer(pass);
+
+      VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+      renderPassBeginInfo.renderPass = target.render_pass;
+      renderPassBeginInfo.framebuffer = target.framebuffer;
+      renderPassBeginInfo.renderArea.extent = target.extent;
+      renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(pass.clear_values.size());
+      renderPassBeginInfo.pClearValues = pass.clear_values.data();
+      vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo,
+                           pass.secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    if (pass.execute)
+      pass.execute(cmd_buf, target);
+
+    if (_dynamic_rendering && !pass.attachments.empty())
+      vkCmdEndRendering(cmd_buf);
+    else if (pass.render_pass)
+      vkCmdEndRenderPass(cmd_buf);
+
+    profiler->end(cmd_buf);
+  }
+
+  emit(cmd_buf, _final_barriers);
+}
+
+VkImage VulkanRenderGraph::image(Resource res)
+{
+  return _resources[res].vkimage;
+}
+
+VkImageView VulkanRenderGraph::image_view(Resource res)
+{
+  return _resources[res].view;
+}
+
+const VulkanRenderGraph::ImageInfo &VulkanRenderGraph::info(Resource res)
+{
+  return _resources[res].info;
+}
+
+VkRenderPass VulkanRenderGraph::render_pass(const std::string &pass)
+{
+  for (auto &p : _passes) {
+    if (p.name == pass && p.live)
+      return p.render_pass;
+  }
+  return VK_NULL_HANDLE;
+}
+
+VulkanRenderGraph::State VulkanRenderGraph::usage_state(Usage usage)
+{
+  switch (usage) {
+  case Usage::color_attachment:
+    return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true};
+  case Usage::depth_attachment:
+    return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true};
+  case Usage::depth_read:
+    return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, false};
+  case Usage::sampled:
+    // the layout VulkanTexture writes into its descriptors, by fragment or compute shaders
+    return {VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT, false};
+  case Usage::storage_read:
+    return {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, false};
+  case Usage::storage_write:
+    return {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, true};
+  case Usage::transfer_src:
+    return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false};
+  case Usage::transfer_dst:
+    return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, true};
+  case Usage::vertex_buffer:
+    return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, false};
+  case Usage::index_buffer:
+    return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, false};
+  case Usage::indirect_buffer:
+    return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, false};
+  case Usage::uniform_buffer:
+    return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_UNIFORM_READ_BIT, false};
+  }
+  return {};
+}
+
+bool VulkanRenderGraph::has_depth(VkFormat format)
+{
+  switch (format) {
+  case VK_FORMAT_D16_UNORM:
+  case VK_FORMAT_X8_D24_UNORM_PACK32:
+  case VK_FORMAT_D32_SFLOAT:
+  case VK_FORMAT_D16_UNORM_S8_UINT:
+  case VK_FORMAT_D24_UNORM_S8_UINT:
+  case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+VkImageAspectFlags VulkanRenderGraph::aspect(VkFormat format)
+{
+  if (!has_depth(format))
+    return VK_IMAGE_ASPECT_COLOR_BIT;
+  if (vks::tools::formatHasStencil(format))
+    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+  return VK_IMAGE_ASPECT_DEPTH_BIT;
+}
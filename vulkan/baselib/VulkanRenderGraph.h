@@ -0,0 +1,236 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class VulkanDevice;
+
+// Passes of a frame declare the images and buffers they read and write, compile() derives
+// the rest: passes whose results nobody uses are culled, transient images whose lifetimes
+// do not overlap share memory, and the barriers and layout transitions between passes are
+// worked out from the declared usages. Raster passes get a render pass and framebuffer
+// from the graph, compatible with pipelines realized against a VkRenderPass of the same
+// attachment formats. With dynamic rendering the passes begin with vkCmdBeginRendering
+// instead, no render pass or framebuffer objects exist, and the barriers go through
+// vkCmdPipelineBarrier2 with the stages and accesses of each resource. A compiled graph
+// is executed into every command buffer recorded for it, imported images are bound again
+// before each execute.
+class VulkanRenderGraph {
+public:
+  using Resource = uint32_t;
+  static constexpr Resource invalid = UINT32_MAX;
+
+  enum class Usage {
+    color_attachment,
+    depth_attachment,
+    depth_read,
+    sampled,
+    storage_read,
+    storage_write,
+    transfer_src,
+    transfer_dst,
+    vertex_buffer,
+    index_buffer,
+    indirect_buffer,
+    uniform_buffer,
+  };
+
+  struct ImageInfo {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+  };
+
+  // what a raster pass renders into, for the pipelines and secondaries recorded in it
+  struct Target {
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VkExtent2D extent = {};
+
+    // attachment formats of a dynamic rendering pass
+    std::vector<VkFormat> color_formats;
+    VkCommandBufferInheritanceRenderingInfo rendering = {};
+
+    // points into the target, only valid while the pass executes
+    VkCommandBufferInheritanceInfo inheritance() const;
+  };
+
+  using Execute = std::function<void(VkCommandBuffer cmd_buf, const Target &target)>;
+
+  class PassBuilder {
+  public:
+    PassBuilder(VulkanRenderGraph *graph, uint32_t pass) : _graph(graph), _pass(pass) {}
+
+    PassBuilder &read(Resource res, Usage usage);
+    PassBuilder &write(Resource res, Usage usage);
+
+    // attachment is cleared on load instead of loaded or discarded
+    PassBuilder &clear(Resource res, VkClearValue value);
+
+    // the pass is recorded into secondary command buffers
+    PassBuilder &secondary();
+
+    // kept even if none of its writes are used
+    PassBuilder &side_effect();
+
+  private:
+    VulkanRenderGraph *_graph = nullptr;
+    uint32_t _pass = 0;
+  };
+
+  struct Stats {
+    uint32_t passes = 0;
+    uint32_t culled = 0;
+    uint32_t barriers = 0;
+    uint32_t transients = 0;
+    // memory of the transient images after aliasing and if each had its own
+    VkDeviceSize transient_size = 0;
+    VkDeviceSize unaliased_size = 0;
+  };
+
+  VulkanRenderGraph(const std::shared_ptr<VulkanDevice> &dev);
+  ~VulkanRenderGraph();
+
+  // image created and owned by the graph, its contents do not outlive the frame
+  Resource create_image(const std::string &name, const ImageInfo &info);
+
+  // image owned elsewhere, in layout initial before the graph runs and left in final
+  // after it; VK_IMAGE_LAYOUT_UNDEFINED as final keeps the layout of the last use
+  Resource import_image(const std::string &name, const ImageInfo &info, VkImageLayout initial = VK_IMAGE_LAYOUT_UNDEFINED,
+                        VkImageLayout final = VK_IMAGE_LAYOUT_UNDEFINED);
+  void bind_image(Resource res, VkImage image, VkImageView view);
+
+  Resource import_buffer(const std::string &name, VkBuffer buffer);
+
+  PassBuilder add_pass(const std::string &name, Execute execute);
+
+  // Raster pass renders into the top left extent of its attachments only, e.g. scaled
+  // rendering into a target of the full size; an empty extent renders to all of them.
+  // Takes effect with the next execute, no recompile
+  void set_render_area(const std::string &pass, VkExtent2D extent);
+
+  // before compiling, needs VulkanDevice::dynamic_rendering()
+  void set_dynamic_rendering(bool enable);
+  bool dynamic_rendering() { return _dynamic_rendering; }
+
+  // no submission may still use the graph, everything compiled is destroyed
+  void reset();
+
+  // once every pass is added, execute() compiles on first use otherwise; resources and
+  // passes can only be added again after reset()
+  void compile();
+
+  bool compiled() { return _compiled; }
+
+  void execute(VkCommandBuffer cmd_buf);
+
+  VkImage image(Resource res);
+  VkImageView image_view(Resource res);
+  const ImageInfo &info(Resource res);
+
+  // render pass of a compiled raster pass, VK_NULL_HANDLE if it was culled
+  VkRenderPass render_pass(const std::string &pass);
+
+  const Stats &stats() { return _stats; }
+
+private:
+  struct Access {
+    Resource res = invalid;
+    Usage usage = Usage::sampled;
+    bool write = false;
+  };
+
+  struct Pass {
+    std::string name;
+    Execute execute;
+    std::vector<Access> accesses;
+    std::map<Resource, VkClearValue> clears;
+    bool secondary = false;
+    bool side_effect = false;
+    VkExtent2D area = {};
+
+    // compiled
+    bool live = false;
+    std::vector<Resource> attachments;
+    std::vector<VkAttachmentDescription> descriptions;
+    std::vector<VkClearValue> clear_values;
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    VkExtent2D extent = {};
+    std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+    std::vector<uint32_t> barriers;
+  };
+
+  struct State {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stage = 0;
+    VkAccessFlags access = 0;
+    bool write = false;
+  };
+
+  struct ResourceData {
+    std::string name;
+    bool image = true;
+    bool imported = false;
+    ImageInfo info;
+    VkImageLayout initial = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout final = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImage vkimage = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+
+    // compiled, the merged usage of every live pass touching the resource in pass order
+    std::vector<std::pair<uint32_t, State>> uses;
+    uint32_t first = UINT32_MAX, last = 0;
+    VkImageUsageFlags usage = 0;
+    VkMemoryRequirements requirements = {};
+    uint32_t slot = UINT32_MAX;
+  };
+
+  struct Barrier {
+    Resource res = invalid;
+    State src, dst;
+  };
+
+  struct Slot {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    uint32_t type_bits = ~0u;
+    std::vector<Resource> resources;
+  };
+
+  static State usage_state(Usage usage);
+
+  static bool has_depth(VkFormat format);
+  static VkImageAspectFlags aspect(VkFormat format);
+
+  void cull();
+  void create_transients();
+  void create_barriers();
+  void create_render_pass(Pass &pass);
+  VkFramebuffer framebuffer(Pass &pass);
+  void begin_rendering(VkCommandBuffer cmd_buf, Pass &pass, Target &target);
+
+  void add_barrier(std::vector<uint32_t> &list, Resource res, const State &src, const State &dst);
+  void emit(VkCommandBuffer cmd_buf, const std::vector<uint32_t> &list);
+  void emit2(VkCommandBuffer cmd_buf, const std::vector<uint32_t> &list);
+
+private:
+  std::shared_ptr<VulkanDevice> _device;
+
+  std::vector<ResourceData> _resources;
+  std::vector<Pass> _passes;
+  std::vector<Slot> _slots;
+
+  std::vector<Barrier> _barriers;
+  std::vector<uint32_t> _final_barriers;
+
+  bool _compiled = false;
+  bool _dynamic_rendering = false;
+  Stats _stats;
+};
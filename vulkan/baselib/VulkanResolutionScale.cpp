@@ -0,0 +1,62 @@
+#include "VulkanResolutionScale.h"
+
+#include <algorithm>
+#include <cmath>
+
+VulkanResolutionScale::VulkanResolutionScale(const Config &config) : _config(config)
+{
+  _scale = quantize(_config.max_scale);
+}
+
+bool VulkanResolutionScale::update(float gpu_ms)
+{
+  if (gpu_ms <= 0)
+    return false;
+
+  _times.push_back(gpu_ms);
+  if (_times.size() < std::max(_config.window, 1u))
+    return false;
+
+  float sum = 0;
+  for (auto t : _times)
+    sum += t;
+  float average = sum / _times.size();
+  _times.pop_front();
+
+  // the cost follows the pixel count, the square of the scale
+  float scale = _scale;
+  if (average > _config.budget_ms)
+    scale = _scale * std::sqrt(_config.budget_ms / average);
+  else if (average < _config.budget_ms * _config.headroom)
+    scale = _scale + _config.step;
+
+  scale = quantize(scale);
+  if (scale == _scale)
+    return false;
+
+  _scale = scale;
+  _times.clear();
+  return true;
+}
+
+void VulkanResolutionScale::reset(float scale)
+{
+  _scale = quantize(scale);
+  _times.clear();
+}
+
+VkExtent2D VulkanResolutionScale::extent(VkExtent2D full)
+{
+  VkExtent2D scaled;
+  scaled.width = std::max(1u, static_cast<uint32_t>(full.width * _scale + 0.5f));
+  scaled.height = std::max(1u, static_cast<uint32_t>(full.height * _scale + 0.5f));
+  return scaled;
+}
+
+float VulkanResolutionScale::quantize(float scale)
+{
+  // rounded down when shrinking, so an over budget frame always gets at least one step
+  float step = std::max(_config.step, 0.01f);
+  float quantized = scale < _scale ? std::floor(scale / step + 1e-3f) * step : std::round(scale / step) * step;
+  return std::clamp(quantized, _config.min_scale, _config.max_scale);
+}
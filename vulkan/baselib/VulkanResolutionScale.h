@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+
+// Render scale of a pass from recent GPU frame times against a budget. The times are
+// averaged over a window before the scale moves, down by the estimated area ratio when
+// over budget and up one step when well under it, so it settles instead of flipping every
+// frame. The scale is quantized to the step, which keeps re-recording of pre-recorded
+// command buffers rare; the window starts over after each change since frames in flight
+// still report the old scale.
+class VulkanResolutionScale {
+public:
+  struct Config {
+    float budget_ms = 16.6f;
+    float min_scale = 0.5f;
+    float max_scale = 1.0f;
+    float step = 0.05f;
+    // below this fraction of the budget the scale goes up
+    float headroom = 0.8f;
+    uint32_t window = 16;
+  };
+
+  VulkanResolutionScale(const Config &config = Config());
+
+  Config &config() { return _config; }
+
+  // feeds the GPU time of a finished frame, true when the scale changed
+  bool update(float gpu_ms);
+
+  void reset(float scale = 1.0f);
+
+  float scale() { return _scale; }
+
+  // the scaled extent of full, at least 1x1
+  VkExtent2D extent(VkExtent2D full);
+
+private:
+  float quantize(float scale);
+
+private:
+  Config _config;
+  float _scale = 1.0f;
+  std::deque<float> _times;
+};
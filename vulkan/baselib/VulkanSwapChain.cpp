@@ -3,7 +3,9 @@
 #include "VulkanDevice.h"
 #include "VulkanInstance.h"
 #include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
 
+#include <algorithm>
 #include <array>
 
 VulkanSwapChain::VulkanSwapChain(const std::shared_ptr<VulkanDevice> &dev)
@@ -27,11 +29,8 @@ VulkanSwapChain::VulkanSwapChain(const std::shared_ptr<VulkanDevice> &dev)
 
 VulkanSwapChain::~VulkanSwapChain() 
 {
-  if (_swapChain != VK_NULL_HANDLE) {
-    for (uint32_t i = 0; i < _images.size(); i++) {
-      vkDestroyImageView(*_device, _images[i].view, nullptr);
-    }
-  }
+  destroy_images();
+  destroy_retired(_generation);
 
   if(_swapChain)
     vkDestroySwapchainKHR(*_device, _swapChain, nullptr);
@@ -104,40 +103,52 @@ void VulkanSwapChain::set_surface(VkSurfaceKHR surface)
   }
 }
 
-void VulkanSwapChain::realize(uint32_t width, uint32_t height, bool vsync, bool fullscreen) 
+void VulkanSwapChain::realize(uint32_t width, uint32_t height, bool fullscreen) 
 {
   _width = width; _height = height;
-  vkDeviceWaitIdle(*_device);
+  _generation++;
+
+  // offscreen images are sized once up front, nothing is in flight yet
+  if (headless()) {
+    vkDeviceWaitIdle(*_device);
+    realize_offscreen();
+    return;
+  }
 
   VkSwapchainKHR oldchain = _swapChain;
 
   VkSurfaceCapabilitiesKHR surfaceCaps;
   vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_device->physical_device(), _surface, &surfaceCaps);
 
+  // the window can be a bit off the surface while it is dragged, a defined current extent
+  // is the only one the surface takes
+  if (surfaceCaps.currentExtent.width != UINT32_MAX) {
+    width = surfaceCaps.currentExtent.width;
+    height = surfaceCaps.currentExtent.height;
+  }
+  width = std::clamp(width, surfaceCaps.minImageExtent.width, surfaceCaps.maxImageExtent.width);
+  height = std::clamp(height, surfaceCaps.minImageExtent.height, surfaceCaps.maxImageExtent.height);
+  _width = width; _height = height;
+
   uint32_t presetModeCount;
   vkGetPhysicalDeviceSurfacePresentModesKHR(_device->physical_device(), _surface, &presetModeCount, nullptr);
-  std::vector<VkPresentModeKHR> presentModes(presetModeCount);
-  vkGetPhysicalDeviceSurfacePresentModesKHR(_device->physical_device(), _surface, &presetModeCount, presentModes.data());
+  _present_modes.resize(presetModeCount);
+  vkGetPhysicalDeviceSurfacePresentModesKHR(_device->physical_device(), _surface, &presetModeCount, _present_modes.data());
 
   VkExtent2D chainExtent = {};
   chainExtent.width = width;
   chainExtent.height = height;
 
+  // FIFO is the only mode every surface has to support
   VkPresentModeKHR chainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+  if (std::find(_present_modes.begin(), _present_modes.end(), _request_mode) != _present_modes.end())
+    chainPresentMode = _request_mode;
+  _present_mode = chainPresentMode;
 
-  if(!vsync) {
-    for(int i = 0; i < presetModeCount; i++) {
-      if(presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-        chainPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-        break;
-      }
-      if (presentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-        chainPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-      }
-    }
-  }
+  _min_images = surfaceCaps.minImageCount;
+  _max_images = surfaceCaps.maxImageCount;
 
-  uint32_t desireImages = surfaceCaps.minImageCount + 1;
+  uint32_t desireImages = _request_images ? std::max(_request_images, surfaceCaps.minImageCount) : surfaceCaps.minImageCount + 1;
   if (surfaceCaps.maxImageCount > 0 && desireImages > surfaceCaps.maxImageCount)
     desireImages = surfaceCaps.maxImageCount;
 
@@ -195,15 +206,14 @@ void VulkanSwapChain::realize(uint32_t width, uint32_t height, bool vsync, bool
     swapchainCI.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
   }
 
-  vkCreateSwapchainKHR(*_device, &swapchainCI, nullptr, &_swapChain);
+  VK_CHECK_RESULT(vkCreateSwapchainKHR(*_device, &swapchainCI, nullptr, &_swapChain));
+  _usage = swapchainCI.imageUsage;
 
-  // If an existing swap chain is re-created, destroy the old swap chain
-  // This also cleans up all the presentable images
+  // The old chain can not be acquired from anymore, but frames still in flight render to
+  // and present its images; the view destroys it once they have retired
   if (oldchain != VK_NULL_HANDLE) {
-    for (uint32_t i = 0; i < _images.size(); i++) {
-      vkDestroyImageView(*_device, _images[i].view, nullptr);
-    }
-    vkDestroySwapchainKHR(*_device, oldchain, nullptr);
+    _retired.push_back({oldchain, std::move(_images), _generation - 1});
+    _images.clear();
   }
 
   uint32_t imageCount;
@@ -235,6 +245,66 @@ void VulkanSwapChain::realize(uint32_t width, uint32_t height, bool vsync, bool
   }
 }
 
+void VulkanSwapChain::realize_offscreen()
+{
+  destroy_images();
+
+  // as many images as a FIFO swapchain would hand out, the view keeps them all in flight
+  const uint32_t imageCount = 3;
+
+  VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = _color_format;
+  imageInfo.extent = {_width, _height, 1};
+  imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                    VK_IMAGE_USAGE_SAMPLED_BIT;
+  _usage = imageInfo.usage;
+
+  _images.resize(imageCount);
+  for (auto &img : _images) {
+    VK_CHECK_RESULT(vkCreateImage(*_device, &imageInfo, nullptr, &img.image));
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(*_device, img.image, &memReqs);
+    VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+    memAlloc.allocationSize = memReqs.size;
+    memAlloc.memoryTypeIndex = *_device->memory_type_index(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK_RESULT(_device->allocate_memory(memAlloc, MemoryCategory::render_target, &img.mem));
+    VK_CHECK_RESULT(vkBindImageMemory(*_device, img.image, img.mem, 0));
+
+    img.view = _device->create_image_view(img.image, _color_format);
+  }
+  _next_image = 0;
+}
+
+void VulkanSwapChain::destroy_retired(uint32_t generation)
+{
+  auto it = _retired.begin();
+  while (it != _retired.end()) {
+    if (it->generation >= generation) {
+      ++it;
+      continue;
+    }
+
+    for (auto &img : it->images)
+      vkDestroyImageView(*_device, img.view, nullptr);
+    vkDestroySwapchainKHR(*_device, it->chain, nullptr);
+    it = _retired.erase(it);
+  }
+}
+
+void VulkanSwapChain::destroy_images()
+{
+  for (auto &img : _images) {
+    vkDestroyImageView(*_device, img.view, nullptr);
+    if (img.mem) {
+      vkDestroyImage(*_device, img.image, nullptr);
+      _device->free_memory(img.mem);
+    }
+  }
+  _images.clear();
+}
+
 std::vector<VkFramebuffer> VulkanSwapChain::create_frame_buffer(VkRenderPass vkPass, const VkImageView& depth)
 {
   std::vector<VkImageView> imgviews;
@@ -277,6 +347,13 @@ std::vector<VkFramebuffer> VulkanSwapChain::create_frame_buffer(VkRenderPass vkP
 
 std::tuple<VkResult, uint32_t> VulkanSwapChain::acquire_image(VkSemaphore present_sema)
 {
+  // nothing to wait for offscreen, the semaphore stays unsignaled
+  if (headless()) {
+    uint32_t index = _next_image;
+    _next_image = (_next_image + 1) % image_count();
+    return {VK_SUCCESS, index};
+  }
+
   uint32_t index;
   auto result = vkAcquireNextImageKHR(*_device, _swapChain, UINT64_MAX, present_sema, nullptr, &index);
   return {result, index};
@@ -284,9 +361,23 @@ std::tuple<VkResult, uint32_t> VulkanSwapChain::acquire_image(VkSemaphore presen
 
 VkResult VulkanSwapChain::queue_present(VkQueue queue, uint32_t index, VkSemaphore wait_sema)
 {
+  if (headless())
+    return VK_SUCCESS;
+
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   presentInfo.pNext = NULL;
+
+  // ids only grow, also across recreated chains
+  VkPresentIdKHR presentId = {};
+  if (_device->present_wait()) {
+    presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentId.swapchainCount = 1;
+    _present_id++;
+    presentId.pPresentIds = &_present_id;
+    presentInfo.pNext = &presentId;
+  }
+
   presentInfo.swapchainCount = 1;
   presentInfo.pSwapchains = &_swapChain;
   presentInfo.pImageIndices = &index;
@@ -297,3 +388,38 @@ VkResult VulkanSwapChain::queue_present(VkQueue queue, uint32_t index, VkSemapho
   }
   return vkQueuePresentKHR(queue, &presentInfo);
 }
+
+VkResult VulkanSwapChain::wait_present(uint64_t id, uint64_t timeout)
+{
+  if (headless() || !_device->present_wait() || id == 0)
+    return VK_SUCCESS;
+
+  return _device->vkWaitForPresentKHR(*_device, _swapChain, id, timeout);
+}
+
+const char *VulkanSwapChain::present_mode_name(VkPresentModeKHR mode)
+{
+  switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "fifo_relaxed";
+    default:
+      return "unknown";
+  }
+}
+
+bool VulkanSwapChain::parse_present_mode(const std::string &name, VkPresentModeKHR &mode)
+{
+  for (auto candidate : {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR}) {
+    if (name == present_mode_name(candidate)) {
+      mode = candidate;
+      return true;
+    }
+  }
+  return false;
+}
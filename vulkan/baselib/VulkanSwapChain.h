@@ -2,6 +2,7 @@
 #define __VULkAN_SWAP_CHAIN_INC__
 
 #include <memory>
+#include <string>
 #include <vector>
 #include "vulkan/vulkan.h"
 
@@ -18,12 +19,53 @@ public:
 
   void set_surface(VkSurfaceKHR surface);
 
+  // without a surface realize creates plain offscreen images that are acquired round robin
+  bool headless() { return _surface == VK_NULL_HANDLE; }
+
   VkFormat color_format() { return _color_format; }
 
-  void realize(uint32_t width, uint32_t height, bool vsync, bool fullscreen = false);
+  // usage of the images, transfer bits depend on the surface
+  VkImageUsageFlags image_usage() { return _usage; }
+
+  // a realized chain is passed on as oldSwapchain and retired instead of destroyed, frames
+  // in flight may still render to and present its images
+  void realize(uint32_t width, uint32_t height, bool fullscreen = false);
+
+  // size of the realized images, the surface may not take the one asked for
+  VkExtent2D extent() { return {_width, _height}; }
+
+  // Applied by the next realize. A mode the surface lacks falls back to FIFO, which every
+  // surface supports; an image count of 0 asks for one more than the surface minimum
+  void set_present_mode(VkPresentModeKHR mode) { _request_mode = mode; }
+  void set_image_count(uint32_t count) { _request_images = count; }
+
+  // mode of the realized chain and the ones the surface supports
+  VkPresentModeKHR present_mode() { return _present_mode; }
+  const std::vector<VkPresentModeKHR> &present_modes() { return _present_modes; }
+
+  // image count limits of the surface, max is 0 without a limit
+  uint32_t min_image_count() { return _min_images; }
+  uint32_t max_image_count() { return _max_images; }
+
+  static const char *present_mode_name(VkPresentModeKHR mode);
+  static bool parse_present_mode(const std::string &name, VkPresentModeKHR &mode);
+
+  // id of the last queue_present, 0 without VK_KHR_present_wait
+  uint64_t present_id() { return _present_id; }
+
+  // blocks until the present with this id is on screen or the timeout in ns passed
+  VkResult wait_present(uint64_t id, uint64_t timeout);
+
+  // incremented by every realize
+  uint32_t generation() { return _generation; }
+
+  // destroys the chains retired before generation, no frame may use them anymore
+  void destroy_retired(uint32_t generation);
 
   uint32_t image_count() { return _images.size(); }
 
+  VkImage image(int idx) { return _images[idx].image; }
+
   VkImageView image_view(int idx) { return _images[idx].view; }
 
   std::vector<VkFramebuffer> create_frame_buffer(VkRenderPass vkPass, const VkImageView &depth);
@@ -34,23 +76,49 @@ public:
 
   VkResult queue_present(VkQueue queue, uint32_t index, VkSemaphore wait_sema = VK_NULL_HANDLE);
 
+private:
+  void realize_offscreen();
+
+  void destroy_images();
+
 private:
   std::shared_ptr<VulkanDevice>    _device;
 
   VkSurfaceKHR _surface = VK_NULL_HANDLE;
   uint32_t _queueIndex = UINT32_MAX;
-  VkFormat _color_format;
+  VkFormat _color_format = VK_FORMAT_B8G8R8A8_UNORM;
   VkColorSpaceKHR _color_space;
   VkSwapchainKHR _swapChain = VK_NULL_HANDLE;
+  VkImageUsageFlags _usage = 0;
 
   uint32_t _width = 0, _height = 0;
 
+  VkPresentModeKHR _request_mode = VK_PRESENT_MODE_FIFO_KHR;
+  uint32_t _request_images = 0;
+  VkPresentModeKHR _present_mode = VK_PRESENT_MODE_FIFO_KHR;
+  std::vector<VkPresentModeKHR> _present_modes;
+  uint32_t _min_images = 0, _max_images = 0;
+
+  uint64_t _present_id = 0;
+
   struct SwapChainImage{
     VkImage image;
     VkImageView view;
+    // only offscreen images own their memory
+    VkDeviceMemory mem = VK_NULL_HANDLE;
   };
   std::vector<SwapChainImage> _images;
 
+  struct Retired {
+    VkSwapchainKHR chain;
+    std::vector<SwapChainImage> images;
+    uint32_t generation;
+  };
+  std::vector<Retired> _retired;
+  uint32_t _generation = 0;
+
+  uint32_t _next_image = 0;
+
   //PFN_vkGetPhysicalDeviceSurfaceSupportKHR fpGetPhysicalDeviceSurfaceSupportKHR;
   //PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR fpGetPhysicalDeviceSurfaceCapabilitiesKHR;
   //PFN_vkGetPhysicalDeviceSurfaceFormatsKHR fpGetPhysicalDeviceSurfaceFormatsKHR;
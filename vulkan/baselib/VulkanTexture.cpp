@@ -1,12 +1,16 @@
 #include "VulkanTexture.h"
 #include "VulkanDevice.h"
 #include "VulkanBuffer.h"
+#include "VulkanTransfer.h"
 #include "VulkanInitializers.hpp"
 #include "VulkanTools.h"
 #include "VulkanImage.h"
+#include "VulkanMemoryTracker.h"
 
 #include "stb_image.h"
 
+#include <iostream>
+
 VulkanTexture::VulkanTexture()
 {
 }
@@ -18,7 +22,7 @@ VulkanTexture::~VulkanTexture()
   if (_image_view)
     vkDestroyImageView(*_device, _image_view, nullptr);
   if (_image_mem)
-    vkFreeMemory(*_device, _image_mem, nullptr);
+    _device->free_memory(_image_mem);
   if (_sampler)
     vkDestroySampler(*_device, _sampler, nullptr);
 }
@@ -77,51 +81,18 @@ void VulkanTexture::realize(const std::shared_ptr<VulkanDevice>& dev)
     return;
 
   _device = dev;
-  auto buf = _device->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, _data.size(), (void*)_data.data());
+
+  // shed the top level while the texture would push device local memory over budget
+  while (_w > 1 && _h > 1 && !_device->memory()->fits(_data.size())) {
+    if (!shrink())
+      break;
+  }
+
   auto [img, mem] = _device->create_image(_w, _h);
   _image = img;
   _image_mem = mem;
 
-  VkBufferImageCopy buffer_region = {};
-  buffer_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  buffer_region.imageSubresource.mipLevel = 0;
-  buffer_region.imageSubresource.baseArrayLayer = 0;
-  buffer_region.imageSubresource.layerCount = 1;
-  buffer_region.imageExtent.width = _w;
-  buffer_region.imageExtent.height = _h;
-  buffer_region.imageExtent.depth = 1;
-  buffer_region.bufferOffset = 0;
-  buffer_region.bufferImageHeight = _h;
-  buffer_region.bufferRowLength = _w;
-
-  VkImageSubresourceRange subrange = {};
-  subrange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  subrange.baseMipLevel = 0;
-  subrange.levelCount = 1;
-  subrange.layerCount = 1;
-
-  auto cmdbuf = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-  VkImageMemoryBarrier imgbarrier = vks::initializers::imageMemoryBarrier();
-  imgbarrier.image = img;
-  imgbarrier.subresourceRange = subrange;
-  imgbarrier.srcAccessMask = 0;
-  imgbarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  imgbarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  imgbarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-
-  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imgbarrier);
-
-  vkCmdCopyBufferToImage(cmdbuf, *buf, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_region);
-
-  imgbarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  imgbarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  imgbarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-  imgbarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imgbarrier);
-
-  _device->flush_command_buffer(cmdbuf, _device->transfer_queue());
+  _device->transfer()->upload_image(img, _w, _h, _data.data(), _data.size());
 
   auto samplerinfo = vks::initializers::samplerCreateInfo();
   samplerinfo.maxLod = 1;
@@ -146,3 +117,26 @@ void VulkanTexture::realize(const std::shared_ptr<VulkanImage> &img)
   VK_CHECK_RESULT(vkCreateSampler(*_device, &samplerinfo, nullptr, &sampler));
   _sampler = sampler;
 }
+
+bool VulkanTexture::shrink()
+{
+  if (_data.size() != size_t(_w) * _h * 4)
+    return false;
+
+  int w = _w / 2, h = _h / 2;
+  std::vector<uint8_t> data(size_t(w) * h * 4);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      auto src = &_data[(size_t(y) * 2 * _w + x * 2) * 4];
+      auto dst = &data[(size_t(y) * w + x) * 4];
+      for (int c = 0; c < 4; c++)
+        dst[c] = (src[c] + src[c + 4] + src[_w * 4 + c] + src[_w * 4 + c + 4] + 2) / 4;
+    }
+  }
+
+  std::cerr << "texture " << _w << "x" << _h << " over memory budget, loading " << w << "x" << h << "\n";
+  _w = w;
+  _h = h;
+  _data.swap(data);
+  return true;
+}
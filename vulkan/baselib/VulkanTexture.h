@@ -34,6 +34,10 @@ public:
 
   void realize(const std::shared_ptr<VulkanImage> &img);
 
+private:
+  // halves an RGBA8 image with a box filter, false for other layouts
+  bool shrink();
+
 private:
   std::shared_ptr<VulkanDevice> _device;
 
@@ -0,0 +1,293 @@
+#include "VulkanTransfer.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanCommandPools.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+VulkanTransfer::VulkanTransfer(VulkanDevice *dev) : _device(dev)
+{
+  _src_family = _device->transfer_family();
+  _dst_family = _device->graphic_family();
+  _queue = _device->transfer_queue();
+  _pool = _device->create_command_pool(_src_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+  if (_device->features12().timelineSemaphore) {
+    VkSemaphoreTypeCreateInfo typeInfo = {};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+    semaphoreInfo.pNext = &typeInfo;
+    VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, &_timeline));
+  }
+}
+
+VulkanTransfer::~VulkanTransfer()
+{
+  if (_recording) {
+    vkEndCommandBuffer(_batch.cmd_buf);
+    destroy(_batch);
+  }
+
+  for (auto &batch : _inflight)
+    destroy(batch);
+  _inflight.clear();
+
+  if (_timeline) {
+    vkDestroySemaphore(*_device, _timeline, nullptr);
+    _timeline = VK_NULL_HANDLE;
+  }
+
+  if (_pool) {
+    vkDestroyCommandPool(*_device, _pool, nullptr);
+    _pool = VK_NULL_HANDLE;
+  }
+}
+
+uint64_t VulkanTransfer::upload_buffer(VulkanBuffer *dst, const void *data, VkDeviceSize size,
+                                       VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, VkDeviceSize offset)
+{
+  auto &batch = recording();
+  auto staging = create_staging(data, size);
+  batch.stagings.push_back(staging);
+
+  VkBufferCopy region = {};
+  region.dstOffset = offset;
+  region.size = size;
+  vkCmdCopyBuffer(batch.cmd_buf, staging.buffer, *dst, 1, &region);
+
+  VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+  barrier.buffer = *dst;
+  barrier.offset = offset;
+  barrier.size = size;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+
+  if (dedicated()) {
+    // release on the transfer family, the matching acquire is recorded by acquire()
+    barrier.srcQueueFamilyIndex = _src_family;
+    barrier.dstQueueFamilyIndex = _dst_family;
+    vkCmdPipelineBarrier(batch.cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dst_access;
+    batch.buffer_acquires.push_back(barrier);
+  }
+  batch.dst_stages |= dst_stage;
+
+  return _submitted + 1;
+}
+
+uint64_t VulkanTransfer::upload_image(VkImage dst, uint32_t w, uint32_t h, const void *data, VkDeviceSize size,
+                                      VkPipelineStageFlags dst_stage, VkImageLayout dst_layout)
+{
+  auto &batch = recording();
+  auto staging = create_staging(data, size);
+  batch.stagings.push_back(staging);
+
+  VkImageSubresourceRange subrange = {};
+  subrange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subrange.baseMipLevel = 0;
+  subrange.levelCount = 1;
+  subrange.layerCount = 1;
+
+  VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+  barrier.image = dst;
+  barrier.subresourceRange = subrange;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  vkCmdPipelineBarrier(batch.cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent.width = w;
+  region.imageExtent.height = h;
+  region.imageExtent.depth = 1;
+  vkCmdCopyBufferToImage(batch.cmd_buf, staging.buffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = dst_layout;
+
+  if (dedicated()) {
+    barrier.srcQueueFamilyIndex = _src_family;
+    barrier.dstQueueFamilyIndex = _dst_family;
+    vkCmdPipelineBarrier(batch.cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    batch.image_acquires.push_back(barrier);
+  } else {
+    // same family: the layout transition is done here, the semaphore wait covers visibility
+    vkCmdPipelineBarrier(batch.cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+  batch.dst_stages |= dst_stage;
+
+  return _submitted + 1;
+}
+
+uint64_t VulkanTransfer::submit()
+{
+  if (!_recording)
+    return _submitted;
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(_batch.cmd_buf));
+  _recording = false;
+
+  _batch.value = ++_submitted;
+  _pending_stages |= _batch.dst_stages;
+
+  VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &_batch.cmd_buf;
+
+  if (_timeline) {
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &_batch.value;
+
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &_timeline;
+    VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE));
+  } else {
+    // no timeline semaphore support, fall back to a blocking upload
+    VkFence fence = _device->commands()->acquire_fence();
+    VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo, fence));
+    VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
+    _device->commands()->release_fence(fence);
+  }
+
+  if (!_batch.buffer_acquires.empty() || !_batch.image_acquires.empty()) {
+    Batch acquire;
+    acquire.value = _batch.value;
+    acquire.dst_stages = _batch.dst_stages;
+    acquire.buffer_acquires = std::move(_batch.buffer_acquires);
+    acquire.image_acquires = std::move(_batch.image_acquires);
+    _unacquired.push_back(std::move(acquire));
+  }
+
+  _batch.buffer_acquires.clear();
+  _batch.image_acquires.clear();
+  _inflight.push_back(std::move(_batch));
+  _batch = Batch();
+
+  collect();
+
+  return _submitted;
+}
+
+uint64_t VulkanTransfer::acquire(VkCommandBuffer cmd, VkPipelineStageFlags &wait_stages)
+{
+  submit();
+
+  // the source stages chain with the semaphore wait, which blocks the same stages
+  for (auto &batch : _unacquired) {
+    vkCmdPipelineBarrier(cmd, batch.dst_stages, batch.dst_stages, 0, 0, nullptr,
+                         static_cast<uint32_t>(batch.buffer_acquires.size()), batch.buffer_acquires.data(),
+                         static_cast<uint32_t>(batch.image_acquires.size()), batch.image_acquires.data());
+  }
+  _unacquired.clear();
+
+  wait_stages = _pending_stages;
+  _pending_stages = 0;
+  _acquired = _submitted;
+  return _timeline ? _submitted : 0;
+}
+
+uint64_t VulkanTransfer::completed_value()
+{
+  if (!_timeline)
+    return _submitted;
+
+  uint64_t value = 0;
+  VK_CHECK_RESULT(vkGetSemaphoreCounterValue(*_device, _timeline, &value));
+  return value;
+}
+
+void VulkanTransfer::wait(uint64_t value)
+{
+  if (value > _submitted)
+    submit();
+
+  if (!_timeline)
+    return;
+
+  VkSemaphoreWaitInfo waitInfo = {};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &_timeline;
+  waitInfo.pValues = &value;
+  VK_CHECK_RESULT(vkWaitSemaphores(*_device, &waitInfo, DEFAULT_FENCE_TIMEOUT));
+}
+
+void VulkanTransfer::collect()
+{
+  auto value = completed_value();
+  auto it = std::remove_if(_inflight.begin(), _inflight.end(), [this, value](Batch &batch) {
+    if (batch.value > value)
+      return false;
+    destroy(batch);
+    return true;
+  });
+  _inflight.erase(it, _inflight.end());
+}
+
+VulkanTransfer::Batch &VulkanTransfer::recording()
+{
+  if (!_recording) {
+    _batch.cmd_buf = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, _pool, true);
+    _recording = true;
+  }
+  return _batch;
+}
+
+VulkanTransfer::Staging VulkanTransfer::create_staging(const void *data, VkDeviceSize size)
+{
+  Staging staging;
+
+  VkBufferCreateInfo bufferInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size);
+  VK_CHECK_RESULT(vkCreateBuffer(*_device, &bufferInfo, nullptr, &staging.buffer));
+
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(*_device, staging.buffer, &memReqs);
+
+  VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+  memAlloc.allocationSize = memReqs.size;
+  memAlloc.memoryTypeIndex = *_device->memory_type_index(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VK_CHECK_RESULT(_device->allocate_memory(memAlloc, MemoryCategory::staging, &staging.memory));
+
+  void *mapped = nullptr;
+  VK_CHECK_RESULT(vkMapMemory(*_device, staging.memory, 0, size, 0, &mapped));
+  memcpy(mapped, data, size);
+  vkUnmapMemory(*_device, staging.memory);
+
+  VK_CHECK_RESULT(vkBindBufferMemory(*_device, staging.buffer, staging.memory, 0));
+  return staging;
+}
+
+void VulkanTransfer::destroy(Batch &batch)
+{
+  for (auto &staging : batch.stagings) {
+    vkDestroyBuffer(*_device, staging.buffer, nullptr);
+    _device->free_memory(staging.memory);
+  }
+  batch.stagings.clear();
+
+  if (batch.cmd_buf) {
+    vkFreeCommandBuffers(*_device, _pool, 1, &batch.cmd_buf);
+    batch.cmd_buf = VK_NULL_HANDLE;
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <memory>
+
+class VulkanDevice;
+class VulkanBuffer;
+
+// Uploads staged through the transfer queue family. Every batch signals a value on a
+// timeline semaphore; when the transfer family differs from the graphics family the
+// batch releases ownership of its resources and the graphics side acquires them again
+// with acquire(), waiting only on the batch it needs.
+class VulkanTransfer {
+public:
+  VulkanTransfer(VulkanDevice *dev);
+  ~VulkanTransfer();
+
+  bool dedicated() const { return _src_family != _dst_family; }
+
+  VkSemaphore semaphore() const { return _timeline; }
+
+  uint64_t upload_buffer(VulkanBuffer *dst, const void *data, VkDeviceSize size,
+                         VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, VkDeviceSize offset = 0);
+
+  uint64_t upload_image(VkImage dst, uint32_t w, uint32_t h, const void *data, VkDeviceSize size,
+                        VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VkImageLayout dst_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  uint64_t submit();
+
+  bool has_pending() const { return _recording || _submitted > _acquired; }
+
+  // Records the pending ownership acquires into a graphics command buffer. Returns the
+  // timeline value the submission has to wait on (0 without timeline support) and the
+  // stages that wait has to block.
+  uint64_t acquire(VkCommandBuffer cmd, VkPipelineStageFlags &wait_stages);
+
+  uint64_t completed_value();
+
+  void wait(uint64_t value);
+
+  void collect();
+
+private:
+  struct Staging {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+  };
+
+  struct Batch {
+    uint64_t value = 0;
+    VkCommandBuffer cmd_buf = VK_NULL_HANDLE;
+    std::vector<Staging> stagings;
+    std::vector<VkBufferMemoryBarrier> buffer_acquires;
+    std::vector<VkImageMemoryBarrier> image_acquires;
+    VkPipelineStageFlags dst_stages = 0;
+  };
+
+  Batch &recording();
+
+  Staging create_staging(const void *data, VkDeviceSize size);
+
+  void destroy(Batch &batch);
+
+private:
+  VulkanDevice *_device = nullptr;
+
+  uint32_t _src_family = 0, _dst_family = 0;
+  VkQueue _queue = VK_NULL_HANDLE;
+  VkCommandPool _pool = VK_NULL_HANDLE;
+
+  VkSemaphore _timeline = VK_NULL_HANDLE;
+  uint64_t _submitted = 0;
+  uint64_t _acquired = 0;
+  VkPipelineStageFlags _pending_stages = 0;
+
+  bool _recording = false;
+  Batch _batch;
+
+  std::vector<Batch> _inflight;
+  std::vector<Batch> _unacquired;
+};
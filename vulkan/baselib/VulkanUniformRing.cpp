@@ -0,0 +1,63 @@
+#include "VulkanUniformRing.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+VulkanUniformRing::VulkanUniformRing(const std::shared_ptr<VulkanDevice> &dev, uint32_t frames, VkDeviceSize frame_size)
+  : _device(dev)
+  , _frames(frames)
+{
+  _alignment = std::max<VkDeviceSize>(dev->limits().minUniformBufferOffsetAlignment, 1);
+  _frame_size = (frame_size + _alignment - 1) & ~(_alignment - 1);
+
+  _buf = dev->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            _frame_size * _frames);
+  _data = _buf->map();
+}
+
+VulkanUniformRing::~VulkanUniformRing()
+{
+  if (_data) {
+    _buf->unmap();
+    _data = nullptr;
+  }
+}
+
+VkBuffer VulkanUniformRing::buffer()
+{
+  return *_buf;
+}
+
+VkDescriptorBufferInfo VulkanUniformRing::descriptor(VkDeviceSize range)
+{
+  VkDescriptorBufferInfo descriptor = {};
+  descriptor.buffer = *_buf;
+  descriptor.offset = 0;
+  descriptor.range = range;
+  return descriptor;
+}
+
+void VulkanUniformRing::begin_frame(uint32_t frame)
+{
+  assert(frame < _frames);
+  _begin = frame * _frame_size;
+  _head = _begin;
+}
+
+uint8_t *VulkanUniformRing::allocate(VkDeviceSize size, uint32_t &offset)
+{
+  // offsets recorded into command buffers point into this region, a larger one would
+  // need new descriptor sets and a record of every buffer, so the frame size is a budget
+  VkDeviceSize aligned = (size + _alignment - 1) & ~(_alignment - 1);
+  if (_head + aligned > _begin + _frame_size)
+    throw std::runtime_error("uniform ring frame of " + std::to_string(_frame_size) + " bytes overflowed by a push of " +
+                             std::to_string(size) + " bytes.");
+
+  offset = static_cast<uint32_t>(_head);
+  _head += aligned;
+  return _data + offset;
+}
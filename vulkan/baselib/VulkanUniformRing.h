@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <string.h>
+
+class VulkanDevice;
+class VulkanBuffer;
+
+// One persistently mapped, host coherent uniform buffer split into a region per frame
+// in flight. Data is bump allocated inside the region of the current frame and bound
+// through UNIFORM_BUFFER_DYNAMIC descriptors with the returned offsets, so writing the
+// next frame never touches memory the GPU may still read.
+class VulkanUniformRing {
+public:
+  VulkanUniformRing(const std::shared_ptr<VulkanDevice> &dev, uint32_t frames, VkDeviceSize frame_size = 64 * 1024);
+  ~VulkanUniformRing();
+
+  VkBuffer buffer();
+
+  uint32_t frames() { return _frames; }
+
+  // descriptor for a UNIFORM_BUFFER_DYNAMIC binding, the offset comes with the bind
+  VkDescriptorBufferInfo descriptor(VkDeviceSize range);
+
+  // call once the fence of the frame has signaled, before pushing its data
+  void begin_frame(uint32_t frame);
+
+  // throws once the pushes of a frame exceed the frame size
+  uint8_t *allocate(VkDeviceSize size, uint32_t &offset);
+
+  template <typename T>
+  uint32_t push(const T &data)
+  {
+    uint32_t offset = 0;
+    memcpy(allocate(sizeof(T), offset), &data, sizeof(T));
+    return offset;
+  }
+
+private:
+  std::shared_ptr<VulkanDevice> _device;
+  std::shared_ptr<VulkanBuffer> _buf;
+
+  uint8_t *_data = nullptr;
+
+  VkDeviceSize _alignment = 0;
+  VkDeviceSize _frame_size = 0;
+  uint32_t _frames = 0;
+
+  VkDeviceSize _begin = 0, _head = 0;
+};
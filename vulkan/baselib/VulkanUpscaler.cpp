@@ -0,0 +1,170 @@
+#include "VulkanUpscaler.h"
+#include "VulkanDevice.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanPipelineLibrary.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+#include "config.h"
+
+#include <cmath>
+#include <cstring>
+
+#define SHADER_DIR ROOT_DIR##"/vulkan/baselib/shaders"
+
+VulkanUpscaler::VulkanUpscaler(const std::shared_ptr<VulkanDevice> &dev) : _device(dev)
+{
+  VkDescriptorSetLayoutBinding bindings[] = {
+      vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+      vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+  };
+  auto layoutInfo = vks::initializers::descriptorSetLayoutCreateInfo(bindings, 2);
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*_device, &layoutInfo, nullptr, &_layout));
+
+  VkPushConstantRange range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params)};
+  auto pipeLayoutInfo = vks::initializers::pipelineLayoutCreateInfo(&_layout, 1);
+  pipeLayoutInfo.pushConstantRangeCount = 1;
+  pipeLayoutInfo.pPushConstantRanges = &range;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(*_device, &pipeLayoutInfo, nullptr, &_pipe_layout));
+
+  // EASU and RCAS fetch texels, the bilinear baseline filters; clamped at the image edge,
+  // the shaders clamp to the input extent themselves
+  auto samplerInfo = vks::initializers::samplerCreateInfo();
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  VK_CHECK_RESULT(vkCreateSampler(*_device, &samplerInfo, nullptr, &_sampler));
+
+  _pipelines[kernel_bilinear] = create_pipeline(SHADER_DIR "/upscale_bilinear.comp.spv");
+  _pipelines[kernel_easu] = create_pipeline(SHADER_DIR "/upscale_easu.comp.spv");
+  _pipelines[kernel_rcas] = create_pipeline(SHADER_DIR "/upscale_rcas.comp.spv");
+}
+
+VulkanUpscaler::~VulkanUpscaler()
+{
+  for (auto pipeline : _pipelines) {
+    if (pipeline)
+      vkDestroyPipeline(*_device, pipeline, nullptr);
+  }
+  vkDestroySampler(*_device, _sampler, nullptr);
+  vkDestroyPipelineLayout(*_device, _pipe_layout, nullptr);
+
+  _device->descriptors()->forget(_layout);
+  vkDestroyDescriptorSetLayout(*_device, _layout, nullptr);
+}
+
+const char *VulkanUpscaler::mode_name(Mode mode)
+{
+  switch (mode) {
+    case bilinear:
+      return "bilinear";
+    case easu:
+      return "easu";
+    case easu_rcas:
+      return "easu_rcas";
+    default:
+      return "unknown";
+  }
+}
+
+bool VulkanUpscaler::parse_mode(const char *name, Mode &mode)
+{
+  for (int i = 0; i < mode_count; i++) {
+    if (strcmp(name, mode_name(Mode(i))) == 0) {
+      mode = Mode(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+VkPipeline VulkanUpscaler::create_pipeline(const char *file)
+{
+  // the pipeline library only keeps graphics pipelines, these few are owned here
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.layout = _pipe_layout;
+  pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = _device->pipelines()->shader(file);
+  pipelineInfo.stage.pName = "main";
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateComputePipelines(*_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+  return pipeline;
+}
+
+VulkanRenderGraph::Resource VulkanUpscaler::add_passes(VulkanRenderGraph &graph, VulkanRenderGraph::Resource input, VkExtent2D output,
+                                                       VkFormat format)
+{
+  using Usage = VulkanRenderGraph::Usage;
+  using Target = VulkanRenderGraph::Target;
+
+  auto result = graph.create_image("upscaled", {output.width, output.height, format});
+
+  // EASU leaves the sharpening to a second pass, it needs the whole neighborhood
+  auto upscaled = result;
+  if (_mode == easu_rcas)
+    upscaled = graph.create_image("easu", {output.width, output.height, format});
+
+  auto kernel = _mode == bilinear ? kernel_bilinear : kernel_easu;
+  graph.add_pass(_mode == bilinear ? "bilinear" : "easu",
+                 [this, &graph, kernel, input, upscaled, output](VkCommandBuffer cmd_buf, const Target &) {
+                   auto set = descriptor_set(graph.image_view(input), graph.image_view(upscaled));
+                   dispatch(cmd_buf, kernel, set, graph.info(input), _input_extent, output);
+                 })
+      .read(input, Usage::sampled)
+      .write(upscaled, Usage::storage_write);
+
+  if (_mode == easu_rcas) {
+    graph.add_pass("rcas",
+                   [this, &graph, upscaled, result, output](VkCommandBuffer cmd_buf, const Target &) {
+                     auto set = descriptor_set(graph.image_view(upscaled), graph.image_view(result));
+                     dispatch(cmd_buf, kernel_rcas, set, graph.info(upscaled), output, output);
+                   })
+        .read(upscaled, Usage::sampled)
+        .write(result, Usage::storage_write);
+  }
+
+  return result;
+}
+
+VkDescriptorSet VulkanUpscaler::descriptor_set(VkImageView input, VkImageView output)
+{
+  // imported inputs may be bound to other views between executes, each recording writes
+  // the views it sees into a set of its frame
+  auto set = _device->descriptors()->allocate_frame(_layout);
+
+  VkDescriptorImageInfo inputInfo = vks::initializers::descriptorImageInfo(_sampler, input, VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
+  VkDescriptorImageInfo outputInfo = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, output, VK_IMAGE_LAYOUT_GENERAL);
+  VkWriteDescriptorSet writes[] = {
+      vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &inputInfo),
+      vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &outputInfo),
+  };
+  vkUpdateDescriptorSets(*_device, 2, writes, 0, nullptr);
+  return set;
+}
+
+void VulkanUpscaler::dispatch(VkCommandBuffer cmd_buf, Kernel kernel, VkDescriptorSet set, const VulkanRenderGraph::ImageInfo &input,
+                              VkExtent2D input_extent, VkExtent2D output)
+{
+  if (!input_extent.width || !input_extent.height)
+    input_extent = {input.width, input.height};
+
+  Params params = {};
+  params.input_rcp[0] = 1.f / input.width;
+  params.input_rcp[1] = 1.f / input.height;
+  params.scale[0] = float(input_extent.width) / output.width;
+  params.scale[1] = float(input_extent.height) / output.height;
+  params.input_max[0] = int32_t(input_extent.width) - 1;
+  params.input_max[1] = int32_t(input_extent.height) - 1;
+  params.output_extent[0] = int32_t(output.width);
+  params.output_extent[1] = int32_t(output.height);
+  params.sharpness = std::exp2(-_sharpness);
+
+  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelines[kernel]);
+  vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, _pipe_layout, 0, 1, &set, 0, nullptr);
+  vkCmdPushConstants(cmd_buf, _pipe_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params), &params);
+  vkCmdDispatch(cmd_buf, (output.width + 7) / 8, (output.height + 7) / 8, 1);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanRenderGraph.h"
+
+#include <memory>
+
+class VulkanDevice;
+
+// Spatial upscaling in compute shaders, after the 2 passes of FSR 1: EASU reconstructs each
+// output pixel from 12 input texels with a Lanczos 2 like kernel that is stretched along
+// the local edge direction, RCAS then sharpens with the strongest negative lobe that does
+// not clip the neighborhood. Bilinear is the baseline to compare them against. The input
+// is the top left extent of a sampled image, e.g. a scaled render target, the output a
+// new storage image of the output extent.
+class VulkanUpscaler {
+public:
+  enum Mode {
+    bilinear,
+    easu,
+    easu_rcas,
+    mode_count,
+  };
+
+  VulkanUpscaler(const std::shared_ptr<VulkanDevice> &dev);
+  ~VulkanUpscaler();
+
+  static const char *mode_name(Mode mode);
+  static bool parse_mode(const char *name, Mode &mode);
+
+  // takes effect with the next add_passes, easu_rcas has one more pass
+  void set_mode(Mode mode) { _mode = mode; }
+  Mode mode() { return _mode; }
+
+  // RCAS strength in stops, 0 is the strongest
+  void set_sharpness(float stops) { _sharpness = stops; }
+  float sharpness() { return _sharpness; }
+
+  // the part of the input holding the image, read whenever the passes execute
+  void set_input_extent(VkExtent2D extent) { _input_extent = extent; }
+
+  // adds the passes upscaling input into a new image of the output extent and returns that
+  // image; the format must support storage images and match rgba16f in the shaders
+  VulkanRenderGraph::Resource add_passes(VulkanRenderGraph &graph, VulkanRenderGraph::Resource input, VkExtent2D output,
+                                         VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT);
+
+private:
+  enum Kernel {
+    kernel_bilinear,
+    kernel_easu,
+    kernel_rcas,
+    kernel_count,
+  };
+
+  struct Params {
+    float input_rcp[2];
+    float scale[2];
+    int32_t input_max[2];
+    int32_t output_extent[2];
+    float sharpness;
+  };
+
+  VkPipeline create_pipeline(const char *file);
+
+  VkDescriptorSet descriptor_set(VkImageView input, VkImageView output);
+
+  void dispatch(VkCommandBuffer cmd_buf, Kernel kernel, VkDescriptorSet set, const VulkanRenderGraph::ImageInfo &input,
+                VkExtent2D input_extent, VkExtent2D output);
+
+private:
+  std::shared_ptr<VulkanDevice> _device;
+
+  VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+  VkPipelineLayout _pipe_layout = VK_NULL_HANDLE;
+  VkPipeline _pipelines[kernel_count] = {};
+  VkSampler _sampler = VK_NULL_HANDLE;
+
+  Mode _mode = easu_rcas;
+  float _sharpness = 0.2f;
+  VkExtent2D _input_extent = {};
+};
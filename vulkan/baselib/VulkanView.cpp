@@ -1,6 +1,13 @@
 #include "VulkanView.h"
 
 #include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
 #include <vulkan/vulkan.h>
 
 #include <SDL2/SDL_vulkan.h>
@@ -16,6 +23,15 @@
 #include "VulkanSwapChain.h"
 #include "VulkanPass.h"
 #include "VulkanImGUI.h"
+#include "VulkanTransfer.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanProfiler.h"
+#include "VulkanCommandPools.h"
+#include "VulkanBuffer.h"
+#include "VulkanFrameStats.h"
+#include "VulkanInitializers.hpp"
+
+#include "stb_image_write.h"
 
 
 using tg::vec2;
@@ -26,6 +42,8 @@ VulkanView::VulkanView(const std::shared_ptr<VulkanDevice>& dev, bool overlay) :
 {
   initialize();
 
+  _stats = std::make_unique<VulkanFrameStats>();
+
   if(overlay)
     _imgui = std::make_shared<VulkanImGUI>(this);
 }
@@ -34,19 +52,25 @@ VulkanView::~VulkanView()
 {
   vkDeviceWaitIdle(*_device);
 
+  retire_frames();
+  if (!_stats_file.empty())
+    _stats->dump(_stats_file);
+
   _imgui.reset();
-  for (auto fence : _fences)
-    vkDestroyFence(*_device, fence, nullptr);
 
-  vkDestroySemaphore(*_device, _presentSemaphore, nullptr);
-  vkDestroySemaphore(*_device, _renderSemaphore, nullptr);
+  destroy_sync_objs();
+
+  clear_frame();
+
+  // nothing is in flight anymore
+  for (auto &[serial, destroy] : _deferred)
+    destroy();
+  _deferred.clear();
 
   _swapchain.reset();
 
   _device->destroy_command_buffers(_cmd_bufs);
 
-  clear_frame();
-
   //auto surface = _swapchain->surface();
   //if (surface) {
   //  vkDestroySurfaceKHR(VulkanInstance::instance(), surface, nullptr);
@@ -56,13 +80,107 @@ VulkanView::~VulkanView()
 void VulkanView::set_surface(VkSurfaceKHR surface, int w, int h)
 {
   _swapchain->set_surface(surface);
-  _swapchain->realize(w, h, true);
 
   if (_imgui) _imgui->create_pipeline(_swapchain->color_format());
 
   resize_impl(w, h);
 }
 
+void VulkanView::set_offscreen(int w, int h)
+{
+  // no surface, the swapchain falls back to offscreen images of this size
+  if (_imgui) _imgui->create_pipeline(_swapchain->color_format());
+
+  resize_impl(w, h);
+}
+
+void VulkanView::render_frames(uint32_t n)
+{
+  for (uint32_t i = 0; i < n; i++) {
+    prepare_frame();
+    render();
+  }
+}
+
+bool VulkanView::save_image(const std::string &file)
+{
+  if (_last_image == UINT32_MAX)
+    return false;
+
+  // a presented image is the presentation engine's until it is acquired again, reading
+  // it races the present
+  if (!_swapchain->headless()) {
+    std::cerr << "only offscreen frames can be read back\n";
+    return false;
+  }
+
+  wait_frames();
+
+  auto format = _swapchain->color_format();
+  bool bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+  if (!bgra && format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB) {
+    std::cerr << "can not read back color format " << format << "\n";
+    return false;
+  }
+
+  VkDeviceSize size = VkDeviceSize(_w) * _h * 4;
+  auto readback = _device->create_buffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size);
+
+  // the last frame left the image in the present layout, the next render pass discards it
+  auto image = _swapchain->image(_last_image);
+  VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+  auto cmd = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+  vks::tools::insertImageMemoryBarrier(cmd, image, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                                       VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, range);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {uint32_t(_w), uint32_t(_h), 1};
+  vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, *readback, 1, &region);
+
+  vks::tools::insertImageMemoryBarrier(cmd, image, VK_ACCESS_TRANSFER_READ_BIT, 0,
+                                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                       VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, range);
+
+  VkBufferMemoryBarrier hostBarrier = vks::initializers::bufferMemoryBarrier();
+  hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  hostBarrier.buffer = *readback;
+  hostBarrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+  _device->flush_command_buffer(cmd, _device->graphic_queue(0));
+
+  std::vector<uint8_t> rgb(size_t(_w) * _h * 3);
+  auto src = readback->map();
+  for (size_t i = 0, n = size_t(_w) * _h; i < n; i++) {
+    rgb[i * 3 + 0] = src[i * 4 + (bgra ? 2 : 0)];
+    rgb[i * 3 + 1] = src[i * 4 + 1];
+    rgb[i * 3 + 2] = src[i * 4 + (bgra ? 0 : 2)];
+  }
+  readback->unmap();
+
+  bool ok = false;
+  auto ext = file.substr(file.find_last_of('.') + 1);
+  if (ext == "ppm") {
+    std::ofstream out(file, std::ios::binary);
+    if (out) {
+      out << "P6\n" << _w << " " << _h << "\n255\n";
+      out.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+      ok = out.good();
+    }
+  } else {
+    ok = stbi_write_png(file.c_str(), _w, _h, 3, rgb.data(), _w * 3) != 0;
+  }
+
+  if (!ok)
+    std::cerr << "could not write frame to " << file << "\n";
+  return ok;
+}
+
 void VulkanView::update_overlay()
 {
   if (_imgui)
@@ -71,74 +189,195 @@ void VulkanView::update_overlay()
 
 void VulkanView::frame(bool continus)
 {
+  // continuous mode draws every iteration, paint requests are redundant then
+  while (poll_events(!continus)) {
+    if (continus) {
+      prepare_frame();
+      render();
+    }
+  }
+}
+
+bool VulkanView::has_arg(int argc, char **argv, const char *name)
+{
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], name) == 0)
+      return true;
+  }
+  return false;
+}
+
+const char *VulkanView::arg_value(int argc, char **argv, const char *name)
+{
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], name) == 0)
+      return argv[i + 1];
+  }
+  return nullptr;
+}
+
+bool VulkanView::benchmark_args(int argc, char **argv, Benchmark &config)
+{
+  bool enabled = false;
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--benchmark") == 0)
+      enabled = true;
+    else if (strcmp(argv[i], "--warmup") == 0 && has_value)
+      config.warmup = static_cast<uint32_t>(std::stoul(argv[++i]));
+    else if (strcmp(argv[i], "--frames") == 0 && has_value)
+      config.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+    else if (strcmp(argv[i], "--orbit") == 0 && has_value)
+      config.orbit_step = std::stoi(argv[++i]);
+    else if (strcmp(argv[i], "--output") == 0 && has_value)
+      config.output = argv[++i];
+  }
+  return enabled;
+}
+
+int VulkanView::benchmark(const Benchmark &config)
+{
+  using clock = std::chrono::steady_clock;
+
+  // the same path every run, an orbit around the home position driven like a mouse drag
+  _manip.home();
+  left_drag(0, 0, 0, 0);
+
+  std::vector<double> times;
+  times.reserve(config.frames);
+
+  uint32_t total = config.warmup + config.frames;
+  auto last = clock::now();
+  for (uint32_t i = 0; i < total; i++) {
+    if (!poll_events(false)) {
+      std::cerr << "benchmark aborted after " << i << " frames\n";
+      vkDeviceWaitIdle(*_device);
+      return 1;
+    }
+
+    _manip.rotate(config.orbit_step, 0);
+    left_drag(0, 0, config.orbit_step, 0);
+    prepare_frame();
+    render();
+
+    // time between consecutive submissions, once the queue is full this is the frame time
+    auto now = clock::now();
+    if (i >= config.warmup)
+      times.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+    last = now;
+  }
+  vkDeviceWaitIdle(*_device);
+
+  if (times.empty())
+    return 1;
+
+  std::vector<double> sorted = times;
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&sorted](double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+  };
+
+  double sum = 0;
+  for (auto t : times)
+    sum += t;
+  double avg = sum / times.size();
+
+  std::ostringstream json;
+  json << "{\"width\": " << _w << ", \"height\": " << _h
+       << ", \"frames_in_flight\": " << frames_in_flight()
+       << ", \"warmup\": " << config.warmup << ", \"frames\": " << times.size()
+       << ", \"min_ms\": " << sorted.front() << ", \"avg_ms\": " << avg
+       << ", \"p50_ms\": " << percentile(0.50) << ", \"p95_ms\": " << percentile(0.95)
+       << ", \"p99_ms\": " << percentile(0.99) << ", \"max_ms\": " << sorted.back()
+       << ", \"fps\": " << 1000.0 / avg << "}\n";
+
+  if (config.output.empty()) {
+    std::cout << json.str();
+    return 0;
+  }
+
+  std::ofstream out(config.output);
+  if (!out) {
+    std::cerr << "could not write benchmark summary to " << config.output << "\n";
+    return 1;
+  }
+  out << json.str();
+  return 0;
+}
+
+bool VulkanView::poll_events(bool paint)
+{
+  // offscreen views have no window and run until the caller stops
+  if (_swapchain->headless())
+    return true;
+
   bool running = true;
-  while (running) {
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-      switch (event.type) {
-        case SDL_QUIT:
-          running = false;
-          break;
-        case SDL_WINDOWEVENT:
-          if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-            vkDeviceWaitIdle(*_device);
-            int w = event.window.data1;
-            int h = event.window.data2;
-            resize_impl(w, h);
-            update_frame();
-          }
-          break;
-        case SDL_USEREVENT:
-          if (event.user.code == WM_PAINT)
-            render();
-          break;
-        case SDL_MOUSEBUTTONDOWN:
-          if (_imgui && _imgui->mouse_down(event.button)) {
-          } else {
-            if (event.button.button == 1)
-              left_dn(event.button.x, event.button.y);
-          }
-          update_frame();
-          break;
-        case SDL_MOUSEBUTTONUP:
-          if (_imgui && _imgui->mouse_up(event.button)) {
-          } else {
-            if (event.button.button == 1)
-              left_up(event.button.x, event.button.y);
-          }
+  SDL_Event event;
+  while (SDL_PollEvent(&event)) {
+    switch (event.type) {
+      case SDL_QUIT:
+        running = false;
+        break;
+      case SDL_WINDOWEVENT:
+        if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
+          int w = event.window.data1;
+          int h = event.window.data2;
+          resize_impl(w, h);
           update_frame();
-          break;
-        case SDL_MOUSEMOTION:
-          if (_imgui && _imgui->mouse_move(event.motion)) {
-          } else {
-            if (event.motion.state & SDL_BUTTON_LMASK) {
-              _manip.rotate(event.motion.xrel, event.motion.yrel);
-              left_drag(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
-            } else if (event.motion.state & SDL_BUTTON_MMASK) {
-            } else if (event.motion.state & SDL_BUTTON_RMASK) {
-              _manip.translate(event.motion.xrel, -event.motion.yrel);
-              right_drag(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
-            }
+        }
+        break;
+      case SDL_USEREVENT:
+        if (event.user.code == WM_PAINT && paint)
+          render();
+        break;
+      case SDL_MOUSEBUTTONDOWN:
+        if (_imgui && _imgui->mouse_down(event.button)) {
+        } else {
+          if (event.button.button == 1)
+            left_dn(event.button.x, event.button.y);
+        }
+        update_frame();
+        break;
+      case SDL_MOUSEBUTTONUP:
+        if (_imgui && _imgui->mouse_up(event.button)) {
+        } else {
+          if (event.button.button == 1)
+            left_up(event.button.x, event.button.y);
+        }
+        update_frame();
+        break;
+      case SDL_MOUSEMOTION:
+        if (_imgui && _imgui->mouse_move(event.motion)) {
+        } else {
+          if (event.motion.state & SDL_BUTTON_LMASK) {
+            _manip.rotate(event.motion.xrel, event.motion.yrel);
+            left_drag(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
+          } else if (event.motion.state & SDL_BUTTON_MMASK) {
+          } else if (event.motion.state & SDL_BUTTON_RMASK) {
+            _manip.translate(event.motion.xrel, -event.motion.yrel);
+            right_drag(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
           }
-          update_frame();
-          break;
-        case SDL_MOUSEWHEEL: {
-          _manip.zoom(event.wheel.y);
-          wheel(event.wheel.y);
-          update_frame();
-          break;
         }
-        case SDL_KEYUP: {
-          if (event.key.keysym.scancode == SDL_SCANCODE_SPACE)
-            _manip.home();
-          key_up(event.key.keysym.scancode);
-          update_frame();
-        } break;
-        default:
-          break;
+        update_frame();
+        break;
+      case SDL_MOUSEWHEEL: {
+        _manip.zoom(event.wheel.y);
+        wheel(event.wheel.y);
+        update_frame();
+        break;
       }
+      case SDL_KEYUP: {
+        if (event.key.keysym.scancode == SDL_SCANCODE_SPACE)
+          _manip.home();
+        key_up(event.key.keysym.scancode);
+        update_frame();
+      } break;
+      default:
+        break;
     }
   }
+  return running;
 }
 
 void VulkanView::set_render_pass(VkRenderPass render_pass)
@@ -147,15 +386,62 @@ void VulkanView::set_render_pass(VkRenderPass render_pass)
 
 void VulkanView::set_frame_buffers(const std::vector<VkFramebuffer>& frame_bufs)
 {
-  for (auto& frame : _frame_bufs) {
-    if (frame) {
-      vkDestroyFramebuffer(*_device, frame, nullptr);
-      frame = VK_NULL_HANDLE;
-    }
-  }
+  clear_frame_buffers();
   _frame_bufs = frame_bufs;
 }
 
+void VulkanView::set_present_mode(VkPresentModeKHR mode)
+{
+  _swapchain->set_present_mode(mode);
+  _recreate = !_swapchain->headless();
+}
+
+void VulkanView::set_image_count(uint32_t count)
+{
+  _swapchain->set_image_count(count);
+  _recreate = !_swapchain->headless();
+}
+
+void VulkanView::defer_destroy(std::function<void()> destroy)
+{
+  _deferred.emplace_back(_serial, std::move(destroy));
+}
+
+void VulkanView::retire_frames()
+{
+  // from the timestamps around the submission, not from when the fence is looked at
+  auto profiler = _device->profiler();
+  for (uint32_t slot = 0; slot < _frames.size(); slot++) {
+    auto &frame = _frames[slot];
+    if (frame.retired || vkGetFenceStatus(*_device, frame.fence) != VK_SUCCESS)
+      continue;
+
+    float gpu = profiler->submit_time(slot);
+    if (gpu >= 0)
+      _stats->set(frame.serial, VulkanFrameStats::gpu_frame, gpu);
+    frame.retired = true;
+  }
+}
+
+void VulkanView::collect_deferred()
+{
+  if (_deferred.empty())
+    return;
+
+  // the oldest frame that may still run; a slot is only submitted again once its previous
+  // frame is done, so frames before the pending ones in each slot have retired
+  uint64_t pending = _serial + 1;
+  for (auto &frame : _frames) {
+    if (frame.serial && vkGetFenceStatus(*_device, frame.fence) != VK_SUCCESS)
+      pending = std::min(pending, frame.serial);
+  }
+
+  auto it = _deferred.begin();
+  for (; it != _deferred.end() && it->first < pending; ++it)
+    it->second();
+  _deferred.erase(_deferred.begin(), it);
+}
+
 uint32_t VulkanView::frame_count()
 {
   return _swapchain->image_count();
@@ -163,17 +449,42 @@ uint32_t VulkanView::frame_count()
 
 void VulkanView::update_frame()
 {
-  update_scene();
+  prepare_frame();
 
   SDL_Event ev;
   ev.type = SDL_USEREVENT;
   ev.user.code = WM_PAINT;
   SDL_PushEvent(&ev);
+}
 
-  if (_imgui && _imgui->update_frame()) {
-    VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &_fences[_framenum], VK_TRUE, UINT64_MAX));
-    _imgui->build_command_buffers();
-  }
+void VulkanView::prepare_frame()
+{
+  update_scene();
+
+  // the overlay is recorded per image in render(), nothing has to wait for the GPU here
+  if (_imgui)
+    _imgui->update_frame();
+}
+
+void VulkanView::wait_frames()
+{
+  std::vector<VkFence> fences;
+  for (auto &frame : _frames)
+    fences.push_back(frame.fence);
+  if (!fences.empty())
+    VK_CHECK_RESULT(vkWaitForFences(*_device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX));
+}
+
+void VulkanView::set_frames_in_flight(uint32_t n)
+{
+  n = std::clamp(n, 1u, 3u);
+  if (n == _frames_in_flight)
+    return;
+
+  _frames_in_flight = n;
+  vkDeviceWaitIdle(*_device);
+  destroy_sync_objs();
+  create_sync_objs();
 }
 
 void VulkanView::create_frame_buffers()
@@ -194,19 +505,28 @@ void VulkanView::create_frame_buffers()
 
 void VulkanView::create_command_buffers()
 {
-  int count = _swapchain->image_count();
-  if (count != _cmd_bufs.size()) {
-    _cmd_bufs = _device->create_command_buffers(count);
+  // only grows, a recreated swapchain may hand out fewer images while the buffers of the
+  // others are still pending
+  uint32_t count = _swapchain->image_count();
+  if (count > _cmd_bufs.size()) {
+    auto more = _device->create_command_buffers(count - _cmd_bufs.size());
+    _cmd_bufs.insert(_cmd_bufs.end(), more.begin(), more.end());
   }
 }
 
 void VulkanView::build_command_buffers()
 {
-  auto& framebuffers = _frame_bufs;
-  auto& renderPass = _render_pass;
-  vkDeviceWaitIdle(*_device);
+  _dirty.assign(_cmd_bufs.size(), true);
+}
 
-  assert(framebuffers.size() == _cmd_bufs.size());
+void VulkanView::frame_command_buffers(uint32_t index, std::vector<VkCommandBuffer> &cmd_bufs)
+{
+  cmd_bufs.push_back(_cmd_bufs[index]);
+}
+
+void VulkanView::record_command_buffer(uint32_t index)
+{
+  assert(index < _frame_bufs.size());
 
   VkCommandBufferBeginInfo buf_info = {};
   buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -220,6 +540,7 @@ void VulkanView::build_command_buffers()
   renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassBeginInfo.pNext = nullptr;
   renderPassBeginInfo.renderPass = *render_pass();
+  renderPassBeginInfo.framebuffer = _frame_bufs[index];
   renderPassBeginInfo.renderArea.offset.x = 0;
   renderPassBeginInfo.renderArea.offset.y = 0;
   renderPassBeginInfo.renderArea.extent.width = _w;
@@ -227,80 +548,213 @@ void VulkanView::build_command_buffers()
   renderPassBeginInfo.clearValueCount = 2;
   renderPassBeginInfo.pClearValues = clearValues;
 
-  for (int i = 0; i < _cmd_bufs.size(); i++) {
-    renderPassBeginInfo.framebuffer = framebuffers[i];
-    auto& cmd_buf = _cmd_bufs[i];
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
-
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    {
-      VkViewport viewport = {};
-      viewport.y = _h;
-      viewport.width = _w;
-      viewport.height = -_h;
-      viewport.minDepth = 0;
-      viewport.maxDepth = 1;
-      vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-    }
-
-    {
-      VkRect2D scissor = {};
-      scissor.extent.width = _w;
-      scissor.extent.height = _h;
-      scissor.offset.x = 0;
-      scissor.offset.y = 0;
-      vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-    }
+  auto profiler = _device->profiler();
+  auto& cmd_buf = _cmd_bufs[index];
+  VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
 
-    build_command_buffer(cmd_buf);
+  profiler->record(cmd_buf, index, VulkanProfiler::view_pass);
+  profiler->begin(cmd_buf, "main pass");
+  vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdEndRenderPass(cmd_buf);
+  {
+    VkViewport viewport = {};
+    viewport.y = _h;
+    viewport.width = _w;
+    viewport.height = -_h;
+    viewport.minDepth = 0;
+    viewport.maxDepth = 1;
+    vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+  }
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
+  {
+    VkRect2D scissor = {};
+    scissor.extent.width = _w;
+    scissor.extent.height = _h;
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
   }
+
+  build_command_buffer(cmd_buf);
+
+  vkCmdEndRenderPass(cmd_buf);
+  profiler->end(cmd_buf);
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
 }
 
 void VulkanView::render()
 {
-  // vkWaitForFences(*_device, 1, _fences[]);
-  auto [result, index] = _swapchain->acquire_image(_presentSemaphore);
-  if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
+  using clock = std::chrono::steady_clock;
+  auto ms = [](clock::time_point from, clock::time_point to) { return std::chrono::duration<float, std::milli>(to - from).count(); };
+
+  VulkanFrameStats::Frame stats;
+  auto start = clock::now();
+  if (_last_frame != clock::time_point())
+    stats.ms[VulkanFrameStats::interval] = ms(_last_frame, start);
+  _last_frame = start;
+  retire_frames();
+
+  // Latency over throughput: with n presents queued the frame starts once the one before
+  // them is on screen, instead of running ahead as far as the fences allow
+  if (_present_latency && _swapchain->present_id() >= _present_latency) {
+    auto wait = _swapchain->wait_present(_swapchain->present_id() + 1 - _present_latency, 100'000'000);
+    if (wait != VK_SUCCESS && wait != VK_TIMEOUT && wait != VK_ERROR_OUT_OF_DATE_KHR && wait != VK_SUBOPTIMAL_KHR)
+      VK_CHECK_RESULT(wait);
+  }
+
+  // only the frame that used this slot last has to be done, the ones after it keep
+  // running on the GPU while this one is recorded
+  auto &frame = _frames[_frame_slot];
+  VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+  auto waited = clock::now();
+  stats.ms[VulkanFrameStats::fence_wait] = ms(start, waited);
+  retire_frames();
+
+  collect_deferred();
+
+  if (_recreate)
+    recreate_swapchain();
+
+  auto [result, index] = _swapchain->acquire_image(frame.acquired);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    // nothing was acquired and the fence is still signaled, the frame is painted again
+    // with the new chain
+    recreate_swapchain();
+    update_frame();
+    return;
+  }
+  if (result == VK_SUBOPTIMAL_KHR)
+    _recreate = true;
+  else
     VK_CHECK_RESULT(result);
+
+  // the image can come back before the frame slot that rendered to it last
+  auto &image_fence = _images_in_flight[index];
+  if (image_fence && image_fence != frame.fence)
+    VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &image_fence, VK_TRUE, UINT64_MAX));
+  image_fence = frame.fence;
+
+  VK_CHECK_RESULT(vkResetFences(*_device, 1, &frame.fence));
+
+  // a recreation in between counts as waiting for the image
+  auto acquired = clock::now();
+  stats.ms[VulkanFrameStats::acquire_wait] = ms(waited, acquired);
+
+  // a command buffer recorded again below drops the secondaries and frame sets it used before
+  bool record = index < _dirty.size() && _dirty[index];
+  if (record) {
+    _device->commands()->release_secondary(index);
+    _device->descriptors()->release_frame(index);
   }
 
-  VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &_fences[index], VK_TRUE, UINT64_MAX));
-  VK_CHECK_RESULT(vkResetFences(*_device, 1, &_fences[index]));
+  // everything per swapchain image is idle now: command buffers, uniforms and the
+  // transient descriptor sets and command buffers of the image
+  _device->descriptors()->begin_frame(index);
+  _device->commands()->begin_frame(index);
+
+  auto profiler = _device->profiler();
+  profiler->collect(index);
+
+  update_uniforms(index);
+
+  // offscreen images are neither acquired nor presented, no binary semaphores then
+  bool headless = _swapchain->headless();
+
+  VkPipelineStageFlags waitStageMasks[2] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0};
+  VkSemaphore waitSemaphores[2] = {frame.acquired, VK_NULL_HANDLE};
+  uint64_t waitValues[2] = {0, 0};
+  uint32_t firstWait = headless ? 1 : 0;
 
-  VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.pWaitDstStageMask = &waitStageMask;   // Pointer to the list of pipeline stages that the semaphore waits will occur at
-  submitInfo.waitSemaphoreCount = 1;               // One wait semaphore
-  submitInfo.signalSemaphoreCount = 1;             // One signal semaphore
-
-  int cmdcount = 1;
-  VkCommandBuffer cmdbufs[2] = {_cmd_bufs[index], 0};
-  if (_imgui) {
-    cmdcount = 2;
-    cmdbufs[1] = _imgui->_cmd_bufs[index];
+  submitInfo.pWaitDstStageMask = waitStageMasks + firstWait;   // Pointer to the list of pipeline stages that the semaphore waits will occur at
+  submitInfo.waitSemaphoreCount = 1 - firstWait;
+  submitInfo.signalSemaphoreCount = headless ? 0 : 1;
+
+  // only what changed since this image was used last is recorded again, against its fence
+  if (record) {
+    record_command_buffer(index);
+    _dirty[index] = false;
   }
-  submitInfo.pCommandBuffers = cmdbufs;             // Command buffers(s) to execute in this batch (submission)
-  submitInfo.commandBufferCount = cmdcount;         // One command buffer
 
-  submitInfo.pWaitSemaphores = &_presentSemaphore;   // Semaphore(s) to wait upon before the submitted command buffer starts executing
-  submitInfo.pSignalSemaphores = &_renderSemaphore;  // Semaphore(s) to be signaled when command buffers have completed
+  auto prologue = _device->commands()->allocate(index);
+  std::vector<VkCommandBuffer> cmdbufs = {prologue};
+  frame_command_buffers(index, cmdbufs);
+  if (_imgui)
+    cmdbufs.push_back(_imgui->command_buffer(index));
+  uint32_t cmdcount = static_cast<uint32_t>(cmdbufs.size());
+
+  // The prologue resets the timestamp queries of this submission and, with pending
+  // uploads, takes ownership back on the graphics queue and waits on the timeline
+  // value of the last upload instead of stalling on the transfer queue
+  VkCommandBufferBeginInfo buf_info = vks::initializers::commandBufferBeginInfo();
+  buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(prologue, &buf_info));
+
+  profiler->reset(prologue, index, cmdbufs.data() + 1, cmdcount - 1);
+  profiler->begin_submit(prologue, _frame_slot);
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  auto transfer = _device->transfer();
+  if (transfer->has_pending()) {
+    auto value = transfer->acquire(prologue, waitStageMasks[1]);
+    if (value) {
+      waitSemaphores[1] = transfer->semaphore();
+      waitValues[1] = value;
+      if (!waitStageMasks[1])
+        waitStageMasks[1] = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+      timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+      timelineInfo.waitSemaphoreValueCount = 2 - firstWait;
+      timelineInfo.pWaitSemaphoreValues = waitValues + firstWait;
+      submitInfo.pNext = &timelineInfo;
+      submitInfo.waitSemaphoreCount = 2 - firstWait;
+    }
+  }
+  VK_CHECK_RESULT(vkEndCommandBuffer(prologue));
+
+  // closes the timestamp pair after everything else of the submission
+  if (profiler->enabled()) {
+    auto epilogue = _device->commands()->allocate(index);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(epilogue, &buf_info));
+    profiler->end_submit(epilogue, _frame_slot);
+    VK_CHECK_RESULT(vkEndCommandBuffer(epilogue));
+    cmdbufs.push_back(epilogue);
+    cmdcount++;
+  }
+
+  submitInfo.pCommandBuffers = cmdbufs.data();             // Command buffers(s) to execute in this batch (submission)
+  submitInfo.commandBufferCount = cmdcount;
+
+  submitInfo.pWaitSemaphores = waitSemaphores + firstWait;       // Semaphore(s) to wait upon before the submitted command buffer starts executing
+  submitInfo.pSignalSemaphores = &frame.rendered;   // Semaphore(s) to be signaled when command buffers have completed
 
   auto queue =_device->graphic_queue(0);
-  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, _fences[index]));
+  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frame.fence));
+  frame.serial = ++_serial;
+  frame.submitted = clock::now();
+  frame.retired = false;
+
+  // everything the first frame needs is created by now
+  if (frame.serial == 1)
+    _device->log_pipeline_stats();
+
+  stats.serial = frame.serial;
+  stats.ms[VulkanFrameStats::cpu_record] = ms(acquired, frame.submitted);
+  _stats->push(stats);
+
+  _last_image = index;
 
   {
-    _framenum = index;
-    auto present = _swapchain->queue_present(queue, _framenum, _renderSemaphore);
-    if (!((present == VK_SUCCESS) || (present == VK_SUBOPTIMAL_KHR))) {
+    auto present = _swapchain->queue_present(queue, index, frame.rendered);
+    if (present == VK_ERROR_OUT_OF_DATE_KHR || present == VK_SUBOPTIMAL_KHR)
+      _recreate = true;
+    else
       VK_CHECK_RESULT(present);
-    }
   }
+
+  _frame_slot = (_frame_slot + 1) % _frames.size();
 }
 
 void VulkanView::initialize()
@@ -324,48 +778,94 @@ void VulkanView::check_frame()
 
   build_command_buffers();
 
-  if (_fences.size() != _cmd_bufs.size()) {
-    for (auto fence : _fences)
-      vkDestroyFence(*_device, fence, nullptr);
-    _fences = _device->create_fences(_cmd_bufs.size());
-  }
+  // command buffers, uniforms and pools are per image index and outlive the swapchain,
+  // the fences of a recreated chain's indices are still waited for before reuse
+  if (_images_in_flight.size() < _swapchain->image_count())
+    _images_in_flight.resize(_swapchain->image_count(), VK_NULL_HANDLE);
+
+  // released descriptor sets wait for every index that still begins frames, the indices a
+  // smaller chain no longer hands out only until their last frames retire
+  defer_destroy([device = _device, swapchain = _swapchain]() { device->descriptors()->set_frames(swapchain->image_count()); });
 }
 
 void VulkanView::clear_frame()
 {
-  for (auto& framebuf : _frame_bufs)
-    vkDestroyFramebuffer(*_device, framebuf, nullptr);
-  _frame_bufs.clear();
+  clear_frame_buffers();
 
+  // in-flight frames may still render to the depth image
+  defer_destroy([depth = _depth]() {});
   _depth.reset();
 }
 
-void VulkanView::create_sync_objs()
+void VulkanView::clear_frame_buffers()
 {
-  VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-  semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  semaphoreCreateInfo.pNext = nullptr;
+  defer_destroy([device = _device, frame_bufs = _frame_bufs]() {
+    for (auto &framebuf : frame_bufs)
+      vkDestroyFramebuffer(*device, framebuf, nullptr);
+  });
+  _frame_bufs.clear();
+}
 
-  // Semaphore used to ensure that image presentation is complete before starting to submit again
-  VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &_presentSemaphore));
+void VulkanView::create_sync_objs()
+{
+  // Per frame in flight: a semaphore signaled when the swapchain image is acquired, one
+  // signaled when rendering is done for the present, and the fence of the submission
+  auto commands = _device->commands();
+  auto fences = _device->create_fences(_frames_in_flight);
+  _frames.resize(_frames_in_flight);
+  for (uint32_t i = 0; i < _frames_in_flight; i++) {
+    _frames[i].acquired = commands->acquire_semaphore();
+    _frames[i].rendered = commands->acquire_semaphore();
+    _frames[i].fence = fences[i];
+  }
+  _frame_slot = 0;
+}
 
-  // Semaphore used to ensure that all commands submitted have been finished before submitting the image to the queue
-  VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &_renderSemaphore));
+void VulkanView::destroy_sync_objs()
+{
+  auto commands = _device->commands();
+  for (auto &frame : _frames) {
+    commands->release_semaphore(frame.acquired);
+    commands->release_semaphore(frame.rendered);
+    vkDestroyFence(*_device, frame.fence, nullptr);
+  }
+  _frames.clear();
+  std::fill(_images_in_flight.begin(), _images_in_flight.end(), VK_NULL_HANDLE);
 }
 
 void VulkanView::resize_impl(int w, int h)
 {
-  if (w != _w && h != _h) {
+  if (w != _w || h != _h) {
     _w = w; _h = h;
 
-    _swapchain->realize(w, h, true);
-
-    clear_frame();
-    check_frame();
+    recreate_swapchain(true);
+  }
+}
 
-    resize(w, h);
+void VulkanView::recreate_swapchain(bool resized)
+{
+  _recreate = false;
+
+  // No device idle: the old chain is handed to the new one and kept, together with the
+  // framebuffers and depth image replaced below, until the frames using them retire
+  _swapchain->realize(_w, _h);
+  defer_destroy([swapchain = _swapchain, generation = _swapchain->generation()]() { swapchain->destroy_retired(generation); });
+
+  // attachments, render areas and the readback follow the images, not the window
+  auto extent = _swapchain->extent();
+  if (int(extent.width) != _w || int(extent.height) != _h) {
+    _w = extent.width;
+    _h = extent.height;
+    resized = true;
   }
 
+  clear_frame();
+  check_frame();
+  _last_image = UINT32_MAX;
+
   if (_imgui)
-    _imgui->resize(w, h);
+    _imgui->resize(_w, _h);
+
+  if (resized)
+    resize(_w, _h);
 }
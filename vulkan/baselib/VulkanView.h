@@ -3,7 +3,10 @@
 
 class VulkanDevice;
 
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "vulkan/vulkan.h"
@@ -14,6 +17,7 @@ class VulkanSwapChain;
 class VulkanImGUI;
 class VulkanImage;
 class VulkanPass;
+class VulkanFrameStats;
 
 class VulkanView {
 public:
@@ -23,9 +27,39 @@ public:
 
   void set_surface(VkSurfaceKHR surface, int w, int h);
 
+  // renders into offscreen color images of a fixed size instead of a surface
+  void set_offscreen(int w, int h);
+
+  // renders n frames without an event loop, for offscreen views
+  void render_frames(uint32_t n);
+
+  // reads the last rendered offscreen frame back, .ppm files are written as binary PPM,
+  // others as PNG
+  bool save_image(const std::string &file);
+
   void update_overlay();
 
-  void frame(bool continus = true);
+  // event loop, draws every iteration when continuous and on paint requests otherwise
+  void frame(bool continus = false);
+
+  struct Benchmark {
+    uint32_t warmup = 100;
+    uint32_t frames = 1000;
+    // horizontal drag per frame of the scripted camera orbit
+    int orbit_step = 2;
+    // json summary goes to stdout when empty
+    std::string output;
+  };
+
+  static bool has_arg(int argc, char **argv, const char *name);
+  static const char *arg_value(int argc, char **argv, const char *name);
+
+  // --benchmark [--warmup n] [--frames n] [--orbit step] [--output file], true if benchmarking
+  static bool benchmark_args(int argc, char **argv, Benchmark &config);
+
+  // renders the warmup and measured frames back to back, writes min/avg/p50/p95/p99 frame
+  // times and returns the process exit code
+  int benchmark(const Benchmark &config);
 
   VulkanDevice *device() { return _device.get(); }
 
@@ -41,6 +75,28 @@ public:
 
   uint32_t frame_count();
 
+  // frames the CPU may record and submit ahead of the GPU, clamped to [1, 3]
+  void set_frames_in_flight(uint32_t n);
+  uint32_t frames_in_flight() { return static_cast<uint32_t>(_frames.size()); }
+
+  // take effect with the next frame, the swapchain is recreated without a device idle
+  void set_present_mode(VkPresentModeKHR mode);
+  void set_image_count(uint32_t count);
+
+  // presents render() lets queue up before it waits for the oldest to reach the screen,
+  // 0 leaves pacing to the frame fences; needs VK_KHR_present_wait
+  void set_present_latency(uint32_t frames) { _present_latency = frames; }
+  uint32_t present_latency() { return _present_latency; }
+
+  VulkanFrameStats *frame_stats() { return _stats.get(); }
+
+  // the frame stats are written there as csv when the view is destroyed
+  void set_frame_stats_file(const std::string &file) { _stats_file = file; }
+
+  // runs destroy once every frame submitted so far has retired, for what frames in
+  // flight may still use, e.g. the attachments a resize replaces
+  void defer_destroy(std::function<void()> destroy);
+
   Manipulator &manipulator() { return _manip; }
 
   int width() { return _w; }
@@ -50,6 +106,9 @@ public:
   virtual void resize(int w, int h) = 0;
   virtual void build_command_buffer(VkCommandBuffer cmd_buf) = 0;
 
+  // called once the fence of the frame has signaled, per-frame uniforms go here
+  virtual void update_uniforms(uint32_t frame){};
+
   virtual void left_dn(int x, int y){};
   virtual void left_up(int x, int y){};
   virtual void wheel(int delta){};
@@ -63,23 +122,54 @@ protected:
 
   void update_frame();
 
+  // scene and overlay updates before a frame is rendered
+  void prepare_frame();
+
+  // waits for every submitted frame, before re-recording command buffers they may use
+  void wait_frames();
+
   virtual void create_frame_buffers();
 
   virtual void create_command_buffers();
 
+  // marks the command buffer of every swapchain image dirty, render() records it again
+  // once the fence of the image's previous frame has signaled, no device idle needed
   virtual void build_command_buffers();
 
+  // records the dirty command buffer of one swapchain image
+  virtual void record_command_buffer(uint32_t index);
+
+  // command buffers submitted for the image between the prologue and the overlay, views with
+  // cached passes add theirs here and re-record them when their own dirty flag is set
+  virtual void frame_command_buffers(uint32_t index, std::vector<VkCommandBuffer> &cmd_bufs);
+
 private:
   void initialize();
 
+  // false once the window is closed, paint requests are rendered when paint is set
+  bool poll_events(bool paint);
+
   void check_frame();
 
   void clear_frame();
 
+  void clear_frame_buffers();
+
   void create_sync_objs();
 
+  void destroy_sync_objs();
+
   void resize_impl(int w, int h);
 
+  // new swapchain and size dependent attachments, the old ones are deferred; the view takes
+  // the extent of the new chain and calls resize when it changed or resized is set
+  void recreate_swapchain(bool resized = false);
+
+  void collect_deferred();
+
+  // GPU times of the frames whose fences have signaled since
+  void retire_frames();
+
 protected:
   std::shared_ptr<VulkanDevice> _device;
   std::shared_ptr<VulkanSwapChain> _swapchain;
@@ -88,9 +178,9 @@ protected:
   std::shared_ptr<VulkanImGUI> _imgui = 0;
 
   std::vector<VkCommandBuffer> _cmd_bufs;
+  std::vector<bool> _dirty;
 
-  int _w, _h;
-  uint32_t _framenum = 0;
+  int _w = 0, _h = 0;
 
   VkFormat _depth_format = VK_FORMAT_D24_UNORM_S8_UINT;
 
@@ -100,9 +190,36 @@ protected:
 private:
   std::vector<VkFramebuffer> _frame_bufs;
 
-  VkSemaphore _presentSemaphore = VK_NULL_HANDLE;
-  VkSemaphore _renderSemaphore = VK_NULL_HANDLE;
-  std::vector<VkFence> _fences;
+  struct FrameSync {
+    VkSemaphore acquired = VK_NULL_HANDLE;
+    VkSemaphore rendered = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    // serial of the last frame submitted with the fence
+    uint64_t serial = 0;
+    std::chrono::steady_clock::time_point submitted;
+    bool retired = true;
+  };
+
+  uint32_t _frames_in_flight = 2;
+  uint32_t _frame_slot = 0;
+  std::vector<FrameSync> _frames;
+
+  // fence of the frame that last rendered to each swapchain image
+  std::vector<VkFence> _images_in_flight;
+
+  uint64_t _serial = 0;
+  std::vector<std::pair<uint64_t, std::function<void()>>> _deferred;
+
+  // the swapchain went out of date or suboptimal at present, or its config changed
+  bool _recreate = false;
+
+  uint32_t _present_latency = 0;
+
+  std::unique_ptr<VulkanFrameStats> _stats;
+  std::string _stats_file;
+  std::chrono::steady_clock::time_point _last_frame;
+
+  uint32_t _last_image = UINT32_MAX;
 
   Manipulator _manip;
 };
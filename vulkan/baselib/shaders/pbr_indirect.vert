@@ -0,0 +1,48 @@
+#version 450
+
+layout(binding = 0) uniform MVP
+{
+  vec4 eye;
+  mat4 proj;
+  mat4 view;
+} mvp;
+
+struct Draw
+{
+  mat4 m;
+  vec4 sphere;
+  uint material;
+  uint index_count;
+  uint first_index;
+  int vertex_offset;
+};
+
+layout(std430, set = 3, binding = 0) readonly buffer Draws
+{
+  Draw draws[];
+};
+
+layout(location = 0) in vec3 attr_pos;
+layout(location = 1) in vec3 attr_norm;
+layout(location = 2) in vec2 attr_uv;
+
+layout(location = 0) out vec3 vp_pos;
+layout(location = 1) out vec3 vp_norm;
+layout(location = 2) out vec2 vp_uv;
+layout(location = 3) flat out uint vp_material;
+
+void main(void)
+{
+  // the cull shader wrote the draw record as first instance
+  mat4 m = draws[gl_InstanceIndex].m;
+
+  vec4 pos = m * vec4(attr_pos, 1.0);
+  gl_Position = mvp.proj * mvp.view * pos;
+
+  vp_uv = attr_uv;
+  vp_material = draws[gl_InstanceIndex].material;
+  vp_pos = pos.xyz / pos.w;
+
+  vec4 norm = m * vec4(attr_norm, 0);
+  vp_norm = norm.xyz;
+}
@@ -0,0 +1,52 @@
+#version 450
+
+layout(binding = 0) uniform MVP
+{
+  vec4 eye;
+  mat4 proj;
+  mat4 view;
+} mvp;
+
+struct Instance
+{
+  mat4 m;
+  uint material;
+};
+
+layout(std430, set = 3, binding = 0) readonly buffer Instances
+{
+  Instance instances[];
+};
+
+layout(location = 0) in vec3 attr_pos;
+layout(location = 1) in vec3 attr_norm;
+layout(location = 2) in vec2 attr_uv;
+
+layout(location = 0) out vec3 vp_pos;
+layout(location = 1) out vec3 vp_norm;
+layout(location = 2) out vec2 vp_uv;
+layout(location = 3) flat out uint vp_material;
+
+// the primitive's transform and material, the same for all instances
+layout(push_constant) uniform Transform
+{
+  mat4 m;
+  uint material;
+}
+transform;
+
+void main(void)
+{
+  Instance instance = instances[gl_InstanceIndex];
+  mat4 m = instance.m * transform.m;
+
+  vec4 pos = m * vec4(attr_pos, 1.0);
+  gl_Position = mvp.proj * mvp.view * pos;
+
+  vp_uv = attr_uv;
+  vp_material = instance.material == 0xffffffffu ? transform.material : instance.material;
+  vp_pos = pos.xyz / pos.w;
+
+  vec4 norm = m * vec4(attr_norm, 0);
+  vp_norm = norm.xyz;
+}
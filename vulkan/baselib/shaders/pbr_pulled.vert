@@ -0,0 +1,50 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+layout(binding = 0) uniform MVP
+{
+  vec4 eye;
+  mat4 proj;
+  mat4 view;
+} mvp;
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer Floats
+{
+  float v[];
+};
+
+layout(location = 0) out vec3 vp_pos;
+layout(location = 1) out vec3 vp_norm;
+layout(location = 2) out vec2 vp_uv;
+layout(location = 3) flat out uint vp_material;
+
+layout(push_constant) uniform Transform
+{
+  mat4 m;
+  uint material;
+  uint pad;
+  Floats position;
+  Floats normal;
+  Floats uv;
+}
+transform;
+
+vec3 fetch3(Floats buf, int i)
+{
+  return vec3(buf.v[i * 3], buf.v[i * 3 + 1], buf.v[i * 3 + 2]);
+}
+
+void main(void)
+{
+  int i = gl_VertexIndex;
+
+  vec4 pos = transform.m * vec4(fetch3(transform.position, i), 1.0);
+  gl_Position = mvp.proj * mvp.view * pos;
+
+  vp_uv = vec2(transform.uv.v[i * 2], transform.uv.v[i * 2 + 1]);
+  vp_material = transform.material;
+  vp_pos = pos.xyz / pos.w;
+
+  vec4 norm = transform.m * vec4(fetch3(transform.normal, i), 0);
+  vp_norm = norm.xyz;
+}
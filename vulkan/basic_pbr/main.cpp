@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <exception>
 #include <stdexcept>
+#include <vector>
 
 #include "config.h"
 #include "Manipulator.h"
@@ -16,10 +20,15 @@
 #include "VulkanTools.h"
 #include "VulkanImage.h"
 #include "VulkanInitializers.hpp"
+#include "VulkanMaterialTable.h"
+#include "VulkanDescriptorAllocator.h"
+#include "MeshPrimitive.h"
+#include "InstancedMesh.h"
+#include "InstancedPipeline.h"
 
 #include "SimpleShape.h"
+#include "RenderData.h"
 
-#define WM_PAINT 1
 #define SHADER_DIR ROOT_DIR##"/vulkan/basic_pbr"
 
 constexpr float fov = 60;
@@ -51,35 +60,28 @@ struct alignas(16){
 	aligned_vec3 albedo;
 } material_ubo;
 
-class Test {
+class Test : public VulkanView {
 public:
-  Test(const std::shared_ptr<VulkanDevice> &dev) : _device(dev)
+  // instanced replaces the point lights by a parallel light, where the material table is supported
+  Test(const std::shared_ptr<VulkanDevice> &dev, bool instanced = false) : VulkanView(dev, false)
   {
-    _manip.set_home(vec3(0, -30, 0), vec3(0), vec3(0, 0, 1));
-
-    _swapchain = std::make_shared<VulkanSwapChain>(dev);
-
     create_sphere();
     create_pipe_layout();
+
+    if (instanced && VulkanMaterialTable::supported(dev.get()))
+      create_instanced();
   }
 
   ~Test()
   {
     vkDeviceWaitIdle(*_device);
 
-    free_resource();
-    for (auto fence : _fences)
-      vkDestroyFence(*_device, fence, nullptr);
-
-    _device->destroy_command_buffers(_cmd_bufs);
-
-    vkDestroyRenderPass(*_device, _render_pass, nullptr);
-
-    vkDestroySemaphore(*_device, _presentSemaphore, nullptr);
-    vkDestroySemaphore(*_device, _renderSemaphore, nullptr);
-
-    auto surface = _swapchain->surface();
-    _swapchain.reset();
+    if (_instanced_pipeline) {
+      auto descriptors = _device->descriptors();
+      descriptors->release(_instanced_pipeline->matrix_layout(), _instanced_matrix_set);
+      descriptors->release(_instanced_pipeline->light_layout(), _instanced_light_set);
+      _instanced_ubo_buf->unmap();
+    }
 
     if (_vert_buf) {
       vkDestroyBuffer(*_device, _vert_buf, nullptr);
@@ -119,237 +121,69 @@ public:
 
   void set_window(SDL_Window *win)
   {
-    SDL_GetWindowSize(win, &_w, &_h);
+    int w = 0, h = 0;
+    SDL_GetWindowSize(win, &w, &h);
 
     VkSurfaceKHR surface;
     if (!SDL_Vulkan_CreateSurface(win, inst, &surface))
       throw std::runtime_error("could not create vk surface.");
 
-    _swapchain->set_surface(surface);
-    _swapchain->realize(_w, _h, true);
-
-    create_sync_object();
-
-    int count = _swapchain->image_count();
-
-    _render_pass = _device->create_render_pass(_swapchain->color_format());
-
-    _cmd_bufs = _device->create_command_buffers(count);
+    set_surface(surface, w, h);
 
     create_pipeline();
 
-    apply_resource();
-
-    update_ubo();
+    update_frame();
   }
 
-  void apply_resource()
+  void set_headless(int w, int h)
   {
-    int count = _swapchain->image_count();
-    _depth = _device->create_depth_image(_w, _h);
+    set_offscreen(w, h);
 
-    _frame_bufs = _swapchain->create_frame_buffer(_render_pass, _depth->image_view());
-
-    build_command_buffers(_frame_bufs, _render_pass);
-
-    if (_fences.size() != _cmd_bufs.size()) {
-      for (auto fence : _fences)
-        vkDestroyFence(*_device, fence, nullptr);
-      _fences = _device->create_fences(_cmd_bufs.size());
-    }
+    create_pipeline();
   }
 
-  void free_resource()
-  {
-    for (auto &framebuf : _frame_bufs)
-      vkDestroyFramebuffer(*_device, framebuf, nullptr);
-    _frame_bufs.clear();
+  void wheel(int delta) { update_ubo(); }
+  void left_drag(int x, int y, int, int) { update_ubo(); }
+  void right_drag(int x, int y, int, int) { update_ubo(); }
+  void key_up(int) { update_ubo(); }
 
-    _depth.reset();
-  }
+  void resize(int, int) { update_ubo(); }
 
-  void create_sync_object()
+  void update_uniforms(uint32_t frame)
   {
-    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    semaphoreCreateInfo.pNext = nullptr;
-
-    // Semaphore used to ensure that image presentation is complete before starting to submit again
-    VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &_presentSemaphore));
-
-    // Semaphore used to ensure that all commands submitted have been finished before submitting the image to the queue
-    VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &_renderSemaphore));
+    if (_spheres)
+      _spheres->update(frame);
   }
 
-  void update()
+  void record_command_buffer(uint32_t index)
   {
-    SDL_Event ev;
-    ev.type = SDL_USEREVENT;
-    ev.user.code = WM_PAINT;
-    SDL_PushEvent(&ev);
+    _recording = index;
+    VulkanView::record_command_buffer(index);
   }
 
-  void draw()
+  // the view begins the render pass and sets the viewport and scissor
+  void build_command_buffer(VkCommandBuffer cmd_buf)
   {
-    // vkWaitForFences(*_device, 1, _fences[]);
-    auto [result, index] = _swapchain->acquire_image(_presentSemaphore);
-    if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
-      VK_CHECK_RESULT(result);
+    if (_spheres) {
+      VkDescriptorSet dessets[2] = {_instanced_matrix_set, _instanced_light_set};
+      vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _instanced_pipeline->pipe_layout(), 0, 2, dessets, 0, nullptr);
+      _spheres->build_command_buffer(cmd_buf, _instanced_pipeline, _recording);
+      return;
     }
 
-    VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &_fences[index], VK_TRUE, UINT64_MAX));
-    VK_CHECK_RESULT(vkResetFences(*_device, 1, &_fences[index]));
-
-    VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pWaitDstStageMask = &waitStageMask;   // Pointer to the list of pipeline stages that the semaphore waits will occur at
-    submitInfo.waitSemaphoreCount = 1;               // One wait semaphore
-    submitInfo.signalSemaphoreCount = 1;             // One signal semaphore
-    submitInfo.pCommandBuffers = &_cmd_bufs[index];  // Command buffers(s) to execute in this batch (submission)
-    submitInfo.commandBufferCount = 1;               // One command buffer
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
 
-    submitInfo.pWaitSemaphores = &_presentSemaphore;   // Semaphore(s) to wait upon before the submitted command buffer starts executing
-    submitInfo.pSignalSemaphores = &_renderSemaphore;  // Semaphore(s) to be signaled when command buffers have completed
-
-    // Submit to the graphics queue passing a wait fence
-    auto queue = _device->graphic_queue(0);
-    VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, _fences[index]));
+    VkDescriptorSet dessets[2] = {_matrix_set, _material_set};
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipe_layout, 0, 2, dessets, 0, nullptr);
 
     {
-      _frame = index;
-      auto present = _swapchain->queue_present(queue, _frame, _renderSemaphore);
-      if (!((present == VK_SUCCESS) || (present == VK_SUBOPTIMAL_KHR))) {
-        VK_CHECK_RESULT(present);
-      }
-    }
-  }
-
-  void loop()
-  {
-    bool running = true;
-    while (running) {
-      SDL_Event event;
-      while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-          case SDL_QUIT:
-            running = false;
-            break;
-          case SDL_WINDOWEVENT:
-            if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-              vkDeviceWaitIdle(*_device);
-              _w = event.window.data1;
-              _h = event.window.data2;
-              _swapchain->realize(_w, _h, true);
-              free_resource();
-              apply_resource();
-              update_ubo();
-              update();
-            }
-            break;
-          case SDL_USEREVENT:
-            if (event.user.code == WM_PAINT)
-              draw();
-            break;
-          case SDL_MOUSEMOTION:
-            if (event.motion.state & SDL_BUTTON_LMASK) {
-              _manip.rotate(event.motion.xrel, event.motion.yrel);
-              update_ubo();
-            } else if (event.motion.state & SDL_BUTTON_MMASK) {
-            } else if (event.motion.state & SDL_BUTTON_RMASK) {
-              _manip.translate(event.motion.xrel, -event.motion.yrel);
-              update_ubo();
-            }
-            update();
-            break;
-          case SDL_MOUSEWHEEL: {
-            _manip.zoom(event.wheel.y);
-            update_ubo();
-            update();
-            break;
-          }
-          case SDL_KEYUP: {
-            if (event.key.keysym.scancode == SDL_SCANCODE_SPACE)
-              _manip.home();
-            update_ubo();
-            update();
-          } break;
-          default:
-            break;
-        }
-      }
-    }
-  }
-
-  void build_command_buffers(std::vector<VkFramebuffer> &framebuffers, VkRenderPass renderPass)
-  {
-    assert(framebuffers.size() == _cmd_bufs.size());
-
-    VkCommandBufferBeginInfo buf_info = {};
-    buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    buf_info.pNext = nullptr;
-
-    VkClearValue clearValues[2];
-    clearValues[0].color = {{0.0, 0.0, 0.2, 1.0}};
-    clearValues[1].depthStencil = {1, 0};
-
-    VkRenderPassBeginInfo renderPassBeginInfo = {};
-    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.pNext = nullptr;
-    renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.renderArea.offset.x = 0;
-    renderPassBeginInfo.renderArea.offset.y = 0;
-    renderPassBeginInfo.renderArea.extent.width = _w;
-    renderPassBeginInfo.renderArea.extent.height = _h;
-    renderPassBeginInfo.clearValueCount = 2;
-    renderPassBeginInfo.pClearValues = clearValues;
-
-    for (int i = 0; i < _cmd_bufs.size(); i++) {
-      renderPassBeginInfo.framebuffer = framebuffers[i];
-      auto &cmd_buf = _cmd_bufs[i];
-      VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
-
-      vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-      {
-        VkViewport viewport = {};
-        viewport.y = _h;
-        viewport.width = _w;
-        viewport.height = -_h;
-        viewport.minDepth = 0;
-        viewport.maxDepth = 1;
-        vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-      }
-
-      {
-        VkRect2D scissor = {};
-        scissor.extent.width = _w;
-        scissor.extent.height = _h;
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-        vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-      }
-
-      {
-        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
-      }
-
-      VkDescriptorSet dessets[2] = {_matrix_set, _material_set};
-      vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipe_layout, 0, 2, dessets, 0, nullptr);
-
-      {
-        VkDeviceSize offset[2] = {0, _vert_count * sizeof(vec3)};
-        VkBuffer bufs[2] = {};
-        bufs[0] = _vert_buf;
-        bufs[1] = _vert_buf;
-        vkCmdBindVertexBuffers(cmd_buf, 0, 2, bufs, offset);
-        vkCmdBindIndexBuffer(cmd_buf, _index_buf, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdDrawIndexed(cmd_buf, _index_count, 49, 0, 0, 0);
-      }
-
-      vkCmdEndRenderPass(cmd_buf);
-
-      VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
+      VkDeviceSize offset[2] = {0, _vert_count * sizeof(vec3)};
+      VkBuffer bufs[2] = {};
+      bufs[0] = _vert_buf;
+      bufs[1] = _vert_buf;
+      vkCmdBindVertexBuffers(cmd_buf, 0, 2, bufs, offset);
+      vkCmdBindIndexBuffer(cmd_buf, _index_buf, 0, VK_INDEX_TYPE_UINT16);
+      vkCmdDrawIndexed(cmd_buf, _index_count, 49, 0, 0, 0);
     }
   }
 
@@ -514,7 +348,7 @@ public:
     VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
     pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineCreateInfo.layout = _pipe_layout;
-    pipelineCreateInfo.renderPass = _render_pass;
+    pipelineCreateInfo.renderPass = *render_pass();
 
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
     inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -618,23 +452,116 @@ public:
     pipelineCreateInfo.pDepthStencilState = &depthStencilState;
     pipelineCreateInfo.pDynamicState = &dynamicState;
 
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
+    _pipeline = _device->create_graphics_pipeline(pipelineCreateInfo);
 
     vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
     vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+
+    // the instance records have a region per swapchain image
+    if (_instanced_pipeline) {
+      _instanced_pipeline->realize(render_pass());
+      _spheres->realize(_device, _instanced_pipeline, frame_count());
+    }
+  }
+
+  // the grid as one sphere primitive with 49 instances, each with its own material
+  void create_instanced()
+  {
+    _instanced_pipeline = std::make_shared<InstancedPipeline>(_device);
+
+    Sphere sp(vec3(0), 1);
+    sp.build();
+    auto &verts = sp.get_vertex();
+    auto &norms = sp.get_norms();
+    auto &uv = sp.get_uvs();
+    auto &strip = sp.get_index();
+
+    // the pipeline draws triangle lists, the strip's degenerate joins are dropped
+    std::vector<uint16_t> index;
+    index.reserve(strip.size() * 3);
+    for (size_t i = 2; i < strip.size(); i++) {
+      uint16_t a = strip[i - 2], b = strip[i - 1], c = strip[i];
+      if (a == b || b == c || a == c)
+        continue;
+      if (i & 1)
+        std::swap(a, b);
+      index.push_back(a);
+      index.push_back(b);
+      index.push_back(c);
+    }
+
+    auto pri = std::make_shared<MeshPrimitive>();
+    pri->set_vertex((uint8_t *)verts.data(), verts.size() * sizeof(vec3));
+    pri->set_normal((uint8_t *)norms.data(), norms.size() * sizeof(vec3));
+    pri->set_uvs((uint8_t *)uv.data(), uv.size() * sizeof(vec2));
+    pri->set_index((uint8_t *)index.data(), index.size() * sizeof(uint16_t));
+    tg::mat4 m;
+    m.identity();
+    pri->set_transform(m);
+
+    std::vector<tg::mat4> transforms(49);
+    std::vector<uint32_t> materials(49);
+    for (int i = 0; i < 49; i++) {
+      float row = i / 7 - 3, col = i % 7 - 3;
+      transforms[i] = tg::translate(vec3(3 * col, 0, 3 * row));
+
+      Material mat = {};
+      mat.pbrdata.metallic = ((i / 7) + 1) / 7.f;
+      mat.pbrdata.roughness = ((i % 7) + 1) / 7.f;
+      mat.pbrdata.ao = 1;
+      mat.pbrdata.albedo = tg::vec4(1, 0, 0, 1);
+      materials[i] = _instanced_pipeline->materials()->add(mat);
+    }
+
+    _spheres = std::make_shared<InstancedMesh>(49);
+    _spheres->add_primitive(pri);
+    _spheres->set_instances(transforms, materials);
+
+    // MVP, then the light at the next offset a uniform buffer can be bound at
+    VkDeviceSize alignment = std::max<VkDeviceSize>(_device->limits().minUniformBufferOffsetAlignment, 1);
+    VkDeviceSize light_offset = (sizeof(MVP) + alignment - 1) & ~(alignment - 1);
+    _instanced_ubo_buf = _device->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, light_offset + sizeof(ParallelLight));
+    _instanced_ubo = _instanced_ubo_buf->map();
+
+    ParallelLight light;
+    light.light_dir = tg::normalize(vec3(1, -1, 1));
+    light.light_color = vec3(10);
+    memcpy(_instanced_ubo + light_offset, &light, sizeof(light));
+
+    auto descriptors = _device->descriptors();
+    _instanced_matrix_set = descriptors->allocate(_instanced_pipeline->matrix_layout());
+    _instanced_light_set = descriptors->allocate(_instanced_pipeline->light_layout());
+
+    VkDescriptorBufferInfo matrix_descriptor = {*_instanced_ubo_buf, 0, sizeof(MVP)};
+    VkDescriptorBufferInfo light_descriptor = {*_instanced_ubo_buf, light_offset, sizeof(ParallelLight)};
+    VkWriteDescriptorSet writes[2] = {
+      vks::initializers::writeDescriptorSet(_instanced_matrix_set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &matrix_descriptor),
+      vks::initializers::writeDescriptorSet(_instanced_light_set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &light_descriptor),
+    };
+    vkUpdateDescriptorSets(*_device, 2, writes, 0, nullptr);
   }
 
   void update_ubo()
   {
-    matrix_ubo.cam = _manip.eye();
-    matrix_ubo.view = _manip.view_matrix();
+    auto &manip = manipulator();
+    matrix_ubo.cam = manip.eye();
+    matrix_ubo.view = manip.view_matrix();
     matrix_ubo.model.identity();
-    matrix_ubo.prj = tg::perspective<float>(fov, float(_w) / _h, 0.1, 1000);
+    matrix_ubo.prj = tg::perspective<float>(fov, float(width()) / height(), 0.1, 1000);
     // tg::near_clip(matrix_ubo.prj, tg::vec4(0, 0, -1, 0.5));
     uint8_t *data = 0;
     VK_CHECK_RESULT(vkMapMemory(*_device, _ubo_buf->memory(), 0, sizeof(matrix_ubo), 0, (void **)&data));
     memcpy(data, &matrix_ubo, sizeof(matrix_ubo));
     vkUnmapMemory(*_device, _ubo_buf->memory());
+
+    if (_instanced_ubo) {
+      MVP mvp;
+      mvp.eye = matrix_ubo.cam;
+      mvp.prj = matrix_ubo.prj;
+      mvp.view = matrix_ubo.view;
+      memcpy(_instanced_ubo, &mvp, sizeof(mvp));
+    }
   }
 
   void create_sphere()
@@ -760,23 +687,6 @@ public:
   }
 
 private:
-  std::shared_ptr<VulkanDevice> _device;
-  std::shared_ptr<VulkanSwapChain> _swapchain;
-
-  int _w, _h;
-  uint32_t _frame = 0;
-
-  VkRenderPass _render_pass = VK_NULL_HANDLE;
-
-  std::shared_ptr<VulkanImage> _depth;
-
-  VkSemaphore _presentSemaphore;
-  VkSemaphore _renderSemaphore;
-
-  std::vector<VkCommandBuffer> _cmd_bufs;
-  std::vector<VkFramebuffer> _frame_bufs;
-  std::vector<VkFence> _fences;
-
   VkBuffer _vert_buf;
   VkDeviceMemory _vert_mem;
   VkBuffer _index_buf;
@@ -797,31 +707,69 @@ private:
   uint32_t _vert_count = 0;
   uint32_t _index_count = 0;
 
-  Manipulator _manip;
+  // one instanced draw of the grid, opt in
+  std::shared_ptr<InstancedPipeline> _instanced_pipeline;
+  std::shared_ptr<InstancedMesh> _spheres;
+  std::shared_ptr<VulkanBuffer> _instanced_ubo_buf;
+  uint8_t *_instanced_ubo = nullptr;
+  VkDescriptorSet _instanced_matrix_set = VK_NULL_HANDLE;
+  VkDescriptorSet _instanced_light_set = VK_NULL_HANDLE;
+  // the swapchain image whose commands are being recorded
+  uint32_t _recording = 0;
 };
 
 
-int main(int argc, char** argv)
+int main(int argc, char **argv)
 {
-  SDL_Window* win = 0;
+  SDL_Window *win = 0;
   std::shared_ptr<Test> test;
+
+  // --headless WxH renders offscreen without SDL, e.g. on lavapipe
+  auto headless = VulkanView::arg_value(argc, argv, "--headless");
+  // --capture file.png|file.ppm keeps the last frame, only offscreen ones: a presented
+  // image belongs to the presentation engine
+  auto capture = VulkanView::arg_value(argc, argv, "--capture");
+  auto device = VulkanView::arg_value(argc, argv, "--device");
   try {
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
-      throw std::runtime_error("sdl init error.");
-    win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
-    if (win == nullptr)
-      throw std::runtime_error("could not create sdl window.");
+    if (capture && !headless)
+      throw std::runtime_error("--capture needs --headless.");
+    int w = 800, h = 600;
+    if (headless) {
+      if (sscanf(headless, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+        throw std::runtime_error("headless size must be WxH.");
+    } else {
+      if (SDL_Init(SDL_INIT_VIDEO) != 0)
+        throw std::runtime_error("sdl init error.");
+      win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, w, h, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+      if (win == nullptr)
+        throw std::runtime_error("could not create sdl window.");
+    }
 
     inst.enable_debug();
-    auto dev = inst.create_device();
+    auto dev = inst.create_device(device ? device : "");
 
-    test = std::make_shared<Test>(dev);
-    test->set_window(win);
+    // --instanced draws the grid with one instanced draw, lit by a parallel light
+    test = std::make_shared<Test>(dev, VulkanView::has_arg(argc, argv, "--instanced"));
+    if (headless)
+      test->set_headless(w, h);
+    else
+      test->set_window(win);
 
-  } catch (std::runtime_error& e) {
+  } catch (std::runtime_error &e) {
     printf("%s", e.what());
     return -1;
   }
-  test->loop();
-  return 0;
-}
\ No newline at end of file
+
+  int result = 0;
+  VulkanView::Benchmark bench;
+  if (VulkanView::benchmark_args(argc, argv, bench))
+    result = test->benchmark(bench);
+  else if (headless)
+    test->render_frames(1);
+  else
+    test->frame(VulkanView::has_arg(argc, argv, "--continuous"));
+
+  if (capture && !test->save_image(capture))
+    result = 1;
+  return result;
+}
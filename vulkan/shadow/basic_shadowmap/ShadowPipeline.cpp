@@ -1,6 +1,7 @@
 #include "ShadowPipeline.h"
 #include "VulkanPass.h"
 #include "VulkanTools.h"
+#include "VulkanPipelineLibrary.h"
 #include "RenderData.h"
 
 
@@ -19,7 +20,7 @@ ShadowPipeline::ShadowPipeline(const std::shared_ptr<VulkanDevice> &dev) : Textu
 ShadowPipeline::~ShadowPipeline()
 {
   if (_shadow_layout)
-    vkDestroyDescriptorSetLayout(*_device, _shadow_layout, 0);
+    destroy_layout(_shadow_layout);
 }
 
 void ShadowPipeline::realize(VulkanPass *render_pass, int subpass)
@@ -29,7 +30,7 @@ void ShadowPipeline::realize(VulkanPass *render_pass, int subpass)
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipe_lay;
-  pipelineCreateInfo.renderPass = *render_pass;
+  pipelineCreateInfo.renderPass = render_pass ? VkRenderPass(*render_pass) : VK_NULL_HANDLE;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
   inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -118,13 +119,13 @@ void ShadowPipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/shadow.vert.spv");
+  shaderStages[0].module = _device->pipelines()->shader(SHADER_DIR "/shadow.vert.spv");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/shadow.frag.spv");
+  shaderStages[1].module = _device->pipelines()->shader(SHADER_DIR "/shadow.frag.spv");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -141,10 +142,7 @@ void ShadowPipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pDynamicState = &dynamicState;
   pipelineCreateInfo.subpass = subpass;
 
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
-
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  compile(pipelineCreateInfo);
 }
 
 VkPipelineLayout ShadowPipeline::pipe_layout()
@@ -177,7 +175,7 @@ VkDescriptorSetLayout ShadowPipeline::shadow_layout()
 {
   if (!_shadow_layout) {
     VkDescriptorSetLayoutBinding layoutBinding[2] = {};
-    layoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layoutBinding[0].descriptorType = uniform_type();
     layoutBinding[0].descriptorCount = 1;
     layoutBinding[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT;
     layoutBinding[0].pImmutableSamplers = nullptr;
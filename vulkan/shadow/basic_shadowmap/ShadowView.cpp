@@ -11,6 +11,8 @@
 #include "VulkanPass.h"
 #include "DepthPass.h"
 #include "VulkanInitializers.hpp"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanUniformRing.h"
 
 #include "VulkanPipeline.h"
 #include "TexturePipeline.h"
@@ -50,6 +52,9 @@ ShadowView::ShadowView(const std::shared_ptr<VulkanDevice> &dev) : VulkanView(de
   _shadow_pipeline = std::make_shared<ShadowPipeline>(dev);
   _depth_pipeline = std::make_shared<DepthPipeline>(dev, 2048, 2048);
 
+  _shadow_pipeline->set_dynamic_uniforms(true);
+  _depth_pipeline->set_dynamic_uniforms(true);
+
   _depth_image = _device->create_depth_image(2048, 2048, VK_FORMAT_D32_SFLOAT);
 
   _depth_pass = std::make_shared<DepthPass>(dev);
@@ -89,10 +94,13 @@ ShadowView::~ShadowView()
     _index_mem = VK_NULL_HANDLE;
   }
 
-  if (_descript_pool) {
-    vkDestroyDescriptorPool(*device(), _descript_pool, nullptr);
-    _descript_pool = VK_NULL_HANDLE;
-  }
+  auto descriptors = device()->descriptors();
+  descriptors->release(_shadow_pipeline->matrix_layout(), _matrix_set);
+  descriptors->release(_shadow_pipeline->light_layout(), _light_set);
+  descriptors->release(_shadow_pipeline->pbr_layout(), _pbr_set);
+  descriptors->release(_shadow_pipeline->shadow_layout(), _shadow_set);
+  if (_depth_pipeline)
+    descriptors->release(_depth_pipeline->matrix_layout(), _depth_matrix_set);
 
   for (int i = 0; i < _depth_frames.size(); i++) {
     vkDestroyFramebuffer(*_device, _depth_frames[i], 0);
@@ -210,7 +218,7 @@ void ShadowView::create_sphere()
     VkFence fence;
     VK_CHECK_RESULT(vkCreateFence(*device(), &fenceCreateInfo, nullptr, &fence));
 
-    VK_CHECK_RESULT(vkQueueSubmit(device()->transfer_queue(), 1, &submitInfo, fence));
+    VK_CHECK_RESULT(vkQueueSubmit(device()->graphic_queue(), 1, &submitInfo, fence));
     VK_CHECK_RESULT(vkWaitForFences(*device(), 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
     vkDestroyFence(*device(), fence, nullptr);
     vkFreeCommandBuffers(*device(), device()->command_pool(), 1, &cmdBuffer);
@@ -227,37 +235,19 @@ void ShadowView::set_uniforms()
   light.light_dir = tg::normalize(vec3(1, 1, 1));
   light.light_color = vec3(10);
 
-  uint8_t *data = 0;
-  VK_CHECK_RESULT(vkMapMemory(*device(), _light->memory(), 0, sizeof(light), 0, (void **)&data));
-  memcpy(data, &light, sizeof(light));
-
   pbr.albedo = vec3(0.8);
   pbr.ao = 1;
   pbr.metallic = 0.2;
   pbr.roughness = 0.7;
-  VK_CHECK_RESULT(vkMapMemory(*device(), _material->memory(), 0, sizeof(pbr), 0, (void **)&data));
-  memcpy(data, &pbr, sizeof(pbr));
 
   auto vp = tg::vec3(100);
-  _depth_matrix_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(MVP));
   _depth_matrix.view = tg::lookat(vp);
   _depth_matrix.prj = tg::ortho<float>(-25, 25, -25, 25, 10, 400);
 
-  VK_CHECK_RESULT(vkMapMemory(*device(), _depth_matrix_buf->memory(), 0, sizeof(MVP), 0, (void **)&data));
-  memcpy(data, &_depth_matrix, sizeof(MVP));
-
-  {
-    _shadow_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                          sizeof(ShadowMatrix));
-    ShadowMatrix sm;
-    sm.light = tg::normalize(vp); 
-    sm.view = _depth_matrix.view;
-    sm.prj = _depth_matrix.prj;
-    sm.mvp = _depth_matrix.prj * _depth_matrix.view;
-    
-    VK_CHECK_RESULT(vkMapMemory(*device(), _shadow_buf->memory(), 0, sizeof(ShadowMatrix), 0, (void **)&data));
-    memcpy(data, &sm, sizeof(ShadowMatrix));
-  }
+  _shadow_matrix.light = tg::normalize(vp);
+  _shadow_matrix.view = _depth_matrix.view;
+  _shadow_matrix.prj = _depth_matrix.prj;
+  _shadow_matrix.mvp = _depth_matrix.prj * _depth_matrix.view;
 }
 
 void ShadowView::update_ubo()
@@ -270,11 +260,45 @@ void ShadowView::update_ubo()
 
   // auto xx = _matrix.view * tg::vec4(0, 0, 100, 1);
   // xx = _matrix.prj * xx;
+}
+
+void ShadowView::update_uniforms(uint32_t frame)
+{
+  if (!_uniforms)
+    return;
+
+  // same sizes in the same order every frame, so the offsets match the ones recorded for this frame
+  _uniforms->begin_frame(frame);
+  _offsets.matrix = _uniforms->push(_matrix);
+  _offsets.light = _uniforms->push(light);
+  _offsets.material = _uniforms->push(pbr);
+  _offsets.depth = _uniforms->push(_depth_matrix);
+  _offsets.shadow = _uniforms->push(_shadow_matrix);
+}
+
+void ShadowView::update_uniform_sets()
+{
+  if (!_uniforms)
+    return;
+
+  VkDescriptorBufferInfo descriptors[5] = {_uniforms->descriptor(sizeof(_matrix)), _uniforms->descriptor(sizeof(light)),
+                                           _uniforms->descriptor(sizeof(pbr)), _uniforms->descriptor(sizeof(_depth_matrix)),
+                                           _uniforms->descriptor(sizeof(ShadowMatrix))};
+  VkDescriptorSet sets[5] = {_matrix_set, _light_set, _pbr_set, _depth_matrix_set, _shadow_set};
+
+  for (int i = 0; i < 5; i++) {
+    if (!sets[i])
+      continue;
 
-  uint8_t *data = 0;
-  VK_CHECK_RESULT(vkMapMemory(*device(), _ubo_buf->memory(), 0, sizeof(_matrix), 0, (void **)&data));
-  memcpy(data, &_matrix, sizeof(_matrix));
-  vkUnmapMemory(*device(), _ubo_buf->memory());
+    VkWriteDescriptorSet writeDescriptorSet = {};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.dstSet = sets[i];
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    writeDescriptorSet.pBufferInfo = &descriptors[i];
+    writeDescriptorSet.dstBinding = 0;
+    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+  }
 }
 
 void ShadowView::resize(int w, int h)
@@ -307,9 +331,14 @@ void ShadowView::key_up(int key)
 
 void ShadowView::create_command_buffers()
 {
-  int count = _swapchain->image_count();
-  if (count != _cmd_bufs.size()) {
-    _cmd_bufs = _device->create_command_buffers(count);
+  VulkanView::create_command_buffers();
+
+  // the descriptor sets point into the ring, they can not be rewritten while in flight
+  uint32_t count = _swapchain->image_count();
+  if (!_uniforms || _uniforms->frames() < count) {
+    vkDeviceWaitIdle(*_device);
+    _uniforms = std::make_shared<VulkanUniformRing>(_device, count, 4096);
+    update_uniform_sets();
   }
 }
 
@@ -319,7 +348,7 @@ void ShadowView::build_depth_command_buffer(VkCommandBuffer cmd_buf)
   mt.identity();
   if (_depth_pipeline && _depth_pipeline->valid()) {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_depth_pipeline);
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _depth_pipeline->pipe_layout(), 0, 1, &_depth_matrix_set, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _depth_pipeline->pipe_layout(), 0, 1, &_depth_matrix_set, 1, &_offsets.depth);
 
     vkCmdPushConstants(cmd_buf, _depth_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
 
@@ -339,11 +368,14 @@ void ShadowView::build_command_buffers()
   if (!_depth_pipeline->valid() || !_shadow_pipeline->valid())
     return;
 
-  vkDeviceWaitIdle(*_device);
+  VulkanView::build_command_buffers();
+}
 
+void ShadowView::record_command_buffer(uint32_t i)
+{
   auto &framebuffers = frame_buffers();
   auto &renderPass = *render_pass();
-  assert(framebuffers.size() == _cmd_bufs.size());
+  assert(i < framebuffers.size());
 
   VkCommandBufferBeginInfo buf_info = {};
   buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -361,39 +393,37 @@ void ShadowView::build_command_buffers()
   renderPassBeginInfo.clearValueCount = 1;
   renderPassBeginInfo.pClearValues = clearValues;
 
-  for (int i = 0; i < _cmd_bufs.size(); i++) {
-    renderPassBeginInfo.renderPass = *_depth_pass;
-    renderPassBeginInfo.framebuffer = _depth_frames[i];
-    renderPassBeginInfo.renderArea.extent.width = _depth_image->width();
-    renderPassBeginInfo.renderArea.extent.height = _depth_image->height();
-    auto &cmd_buf = _cmd_bufs[i];
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
+  renderPassBeginInfo.renderPass = *_depth_pass;
+  renderPassBeginInfo.framebuffer = _depth_frames[i];
+  renderPassBeginInfo.renderArea.extent.width = _depth_image->width();
+  renderPassBeginInfo.renderArea.extent.height = _depth_image->height();
+  auto &cmd_buf = _cmd_bufs[i];
+  VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
 
-    clearValues[0].depthStencil = {1.f, 0};
-    renderPassBeginInfo.clearValueCount = 1;
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  clearValues[0].depthStencil = {1.f, 0};
+  renderPassBeginInfo.clearValueCount = 1;
+  vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    build_depth_command_buffer(cmd_buf);
+  build_depth_command_buffer(cmd_buf);
 
-    vkCmdEndRenderPass(cmd_buf);
+  vkCmdEndRenderPass(cmd_buf);
 
-    clearValues[0].color = {{0.0, 0.0, 0.2, 1.0}};
-    clearValues[1].depthStencil = {1.f, 0};
-    renderPassBeginInfo.clearValueCount = 2;
+  clearValues[0].color = {{0.0, 0.0, 0.2, 1.0}};
+  clearValues[1].depthStencil = {1.f, 0};
+  renderPassBeginInfo.clearValueCount = 2;
 
-    renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.framebuffer = framebuffers[i];
-    renderPassBeginInfo.renderArea.extent.width = width();
-    renderPassBeginInfo.renderArea.extent.height = height();
+  renderPassBeginInfo.renderPass = renderPass;
+  renderPassBeginInfo.framebuffer = framebuffers[i];
+  renderPassBeginInfo.renderArea.extent.width = width();
+  renderPassBeginInfo.renderArea.extent.height = height();
 
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    build_command_buffer(cmd_buf);
+  build_command_buffer(cmd_buf);
 
-    vkCmdEndRenderPass(cmd_buf);
+  vkCmdEndRenderPass(cmd_buf);
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
-  }
+  VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
 }
 
 void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf) 
@@ -422,9 +452,9 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
   if (_shadow_pipeline && _shadow_pipeline->valid()) {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_shadow_pipeline);
 
-    uint32_t offset[1] = {};
+    uint32_t offset[3] = {_offsets.matrix, _offsets.light, _offsets.material};
     VkDescriptorSet dessets[3] = {_matrix_set, _light_set, _pbr_set};
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 0, 3, dessets, 1, offset);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 0, 3, dessets, 3, offset);
 
     VkWriteDescriptorSet texture_set = {};
     texture_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -436,7 +466,7 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
     texture_set.pImageInfo = &descriptor;
     _device->vkCmdPushDescriptorSetKHR(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 3, 1, &texture_set);
 
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 4, 1, &_shadow_set, 0, 0);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 4, 1, &_shadow_set, 1, &_offsets.shadow);
 
     vkCmdPushConstants(cmd_buf, _shadow_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
 
@@ -460,82 +490,12 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
 
 void ShadowView::create_pipe_layout()
 {
-  VkDescriptorPoolSize typeCounts[1];
-  typeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  typeCounts[0].descriptorCount = 10;
-
-  VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
-  descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  descriptorPoolInfo.pNext = nullptr;
-  descriptorPoolInfo.poolSizeCount = 1;
-  descriptorPoolInfo.pPoolSizes = typeCounts;
-  descriptorPoolInfo.maxSets = 10;
-
-  VkDescriptorPool desPool;
-  VK_CHECK_RESULT(vkCreateDescriptorPool(*device(), &descriptorPoolInfo, nullptr, &desPool));
-  _descript_pool = desPool;
-
-  //----------------------------------------------------------------------------------------------------
-  auto mlayout = _shadow_pipeline->matrix_layout();
-  auto llayout = _shadow_pipeline->light_layout();
-  auto playout = _shadow_pipeline->pbr_layout();
-
-  VkDescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.descriptorPool = desPool;
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &mlayout;
-
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_matrix_set));
-
-  allocInfo.pSetLayouts = &llayout;
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_light_set));
-
-  allocInfo.pSetLayouts = &playout;
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_pbr_set));
-
-  VkDescriptorBufferInfo descriptor = {};
-  int sz = sizeof(_matrix);
-  _ubo_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  descriptor.buffer = *_ubo_buf;
-  descriptor.offset = 0;
-  descriptor.range = sizeof(_matrix);
-
-  sz = sizeof(light);
-  VkDescriptorBufferInfo ldescriptor = {};
-  _light = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  ldescriptor.buffer = *_light;
-  ldescriptor.offset = 0;
-  ldescriptor.range = sz;
-
-  sz = sizeof(pbr);
-  VkDescriptorBufferInfo mdescriptor = {};
-  _material = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  mdescriptor.buffer = *_material;
-  mdescriptor.offset = 0;
-  mdescriptor.range = sz;
-
-  VkWriteDescriptorSet writeDescriptorSet = {};
-  writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  writeDescriptorSet.dstSet = _matrix_set;
-  writeDescriptorSet.descriptorCount = 1;
-  writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  writeDescriptorSet.pBufferInfo = &descriptor;
-  writeDescriptorSet.dstBinding = 0;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
-  writeDescriptorSet.dstSet = _light_set;
-  writeDescriptorSet.pBufferInfo = &ldescriptor;
-  writeDescriptorSet.dstBinding = 0;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
-  writeDescriptorSet.dstSet = _pbr_set;
-  writeDescriptorSet.pBufferInfo = &mdescriptor;
-  writeDescriptorSet.dstBinding = 0;
-  //writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+  auto descriptors = device()->descriptors();
+  _matrix_set = descriptors->allocate(_shadow_pipeline->matrix_layout());
+  _light_set = descriptors->allocate(_shadow_pipeline->light_layout());
+  _pbr_set = descriptors->allocate(_shadow_pipeline->pbr_layout());
 
+  update_uniform_sets();
 
   //----------------------------------------------------------------------------------------------------
   //{
@@ -579,9 +539,11 @@ void ShadowView::create_frame_buffers()
     frameBufferCreateInfo.height = _depth_image->height();
     frameBufferCreateInfo.layers = 1;
 
-    _depth_frames.resize(_swapchain->image_count());
-    for (int i = 0; i < _depth_frames.size(); i++) {
-      VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &_depth_frames[i]));
+    // the shadow map does not follow the window, only missing images get a framebuffer
+    for (size_t i = _depth_frames.size(); i < _swapchain->image_count(); i++) {
+      VkFramebuffer framebuffer = VK_NULL_HANDLE;
+      VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &framebuffer));
+      _depth_frames.push_back(framebuffer);
     }
   }
 
@@ -613,29 +575,7 @@ void ShadowView::create_pipeline()
   if (_depth_pipeline) {
     _depth_pipeline->realize(_depth_pass.get());
 
-    auto des_layout = _depth_pipeline->matrix_layout();
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descript_pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &des_layout;
-
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_depth_matrix_set));
-
-    int sz = sizeof(_depth_matrix);
-    VkDescriptorBufferInfo descriptor = {};
-    descriptor.buffer = *_depth_matrix_buf;
-    descriptor.offset = 0;
-    descriptor.range = sz;
-
-    VkWriteDescriptorSet writeDescriptorSet = {};
-    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSet.dstSet = _depth_matrix_set;
-    writeDescriptorSet.descriptorCount = 1;
-    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    writeDescriptorSet.pBufferInfo = &descriptor;
-    writeDescriptorSet.dstBinding = 0;
-    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+    _depth_matrix_set = device()->descriptors()->allocate(_depth_pipeline->matrix_layout());
   }
 
   _shadow_pipeline->realize(render_pass());
@@ -645,40 +585,21 @@ void ShadowView::create_pipeline()
   _deer->realize(_device, _shadow_pipeline);
 
   {
-    auto slayout = _shadow_pipeline->shadow_layout();
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descript_pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &slayout;
+    _shadow_set = device()->descriptors()->allocate(_shadow_pipeline->shadow_layout());
+    update_uniform_sets();
 
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_shadow_set));
+    _shadow_texture = std::make_shared<VulkanTexture>();
+    _shadow_texture->realize(_depth_image);
 
-    int sz = sizeof(ShadowMatrix);
-    VkDescriptorBufferInfo descriptor = {};
-    descriptor.buffer = *_shadow_buf;
-    descriptor.offset = 0;
-    descriptor.range = sz;
+    VkDescriptorImageInfo depthDescriptor = _shadow_texture->descriptor();
 
     VkWriteDescriptorSet writeDescriptorSet = {};
     writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeDescriptorSet.dstSet = _shadow_set;
     writeDescriptorSet.descriptorCount = 1;
-    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    writeDescriptorSet.pBufferInfo = &descriptor;
-    writeDescriptorSet.dstBinding = 0;
-    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
-    _shadow_texture = std::make_shared<VulkanTexture>();
-    _shadow_texture->realize(_depth_image);
-
-    VkDescriptorImageInfo depthDescriptor = _shadow_texture->descriptor();
-
     writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     writeDescriptorSet.dstBinding = 1;
-    writeDescriptorSet.pBufferInfo = 0;
     writeDescriptorSet.pImageInfo = &depthDescriptor;
-
     vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
   }
 
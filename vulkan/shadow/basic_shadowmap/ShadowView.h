@@ -7,6 +7,8 @@
 #include "DepthPipeline.h"
 #include "DepthPass.h"
 
+class VulkanUniformRing;
+
 class ShadowView : public VulkanView {
 public:
   ShadowView(const std::shared_ptr<VulkanDevice> &dev);
@@ -16,6 +18,8 @@ public:
 
   void set_uniforms();
   void update_ubo();
+  void update_uniforms(uint32_t frame) override;
+  void update_uniform_sets();
 
   void resize(int w, int h);
   void update_scene();
@@ -28,7 +32,8 @@ public:
   void create_command_buffers();
   void build_depth_command_buffer(VkCommandBuffer cmd_buf);
 
-  void build_command_buffers();
+  void build_command_buffers() override;
+  void record_command_buffer(uint32_t index) override;
   void build_command_buffer(VkCommandBuffer cmd_buf) override;
   void create_pipe_layout();
   void create_frame_buffers();
@@ -40,8 +45,6 @@ private:
   VkBuffer _index_buf;
   VkDeviceMemory _index_mem;
 
-  VkDescriptorPool _descript_pool = VK_NULL_HANDLE;
-
   std::vector<VkFramebuffer> _depth_frames;
 
   std::shared_ptr<DepthPass> _depth_pass;
@@ -57,15 +60,21 @@ private:
   VkDescriptorSet _basic_tex_set = VK_NULL_HANDLE;
 
   VkDescriptorSet _depth_matrix_set = VK_NULL_HANDLE;
-  std::shared_ptr<VulkanBuffer> _depth_matrix_buf;
 
   VkDescriptorSet _shadow_set = VK_NULL_HANDLE;
-  std::shared_ptr<VulkanBuffer> _shadow_buf;
   std::shared_ptr<VulkanTexture> _shadow_texture;
 
-  std::shared_ptr<VulkanBuffer> _ubo_buf, _light, _material;
+  std::shared_ptr<VulkanUniformRing> _uniforms;
+  struct {
+    uint32_t matrix = 0;
+    uint32_t light = 0;
+    uint32_t material = 0;
+    uint32_t depth = 0;
+    uint32_t shadow = 0;
+  } _offsets;
 
   MVP _matrix, _depth_matrix;
+  ShadowMatrix _shadow_matrix;
 
   uint32_t _vert_count = 0;
   uint32_t _index_count = 0;
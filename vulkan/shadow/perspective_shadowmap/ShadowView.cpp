@@ -1,5 +1,7 @@
 #include "ShadowView.h"
 
+#include <cstring>
+
 #include "VulkanDebug.h"
 #include "VulkanView.h"
 #include "VulkanInstance.h"
@@ -11,16 +13,28 @@
 #include "VulkanPass.h"
 #include "DepthPass.h"
 #include "VulkanInitializers.hpp"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanUniformRing.h"
+#include "VulkanProfiler.h"
+#include "VulkanCommandPools.h"
+#include "VulkanMemoryTracker.h"
+#include "VulkanRenderGraph.h"
+#include "VulkanFrameStats.h"
 
 #include "VulkanPipeline.h"
 #include "TexturePipeline.h"
 #include "DepthPipeline.h"
 #include "DepthPersPipeline.h"
+#include "BindlessPipeline.h"
+#include "IndirectPipeline.h"
+#include "VulkanMaterialTable.h"
+#include "VulkanIndirectScene.h"
 
 #include "SimpleShape.h"
 #include "RenderData.h"
 #include "GLTFLoader.h"
 #include "MeshInstance.h"
+#include "Frustum.h"
 
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_vulkan.h"
@@ -100,10 +114,35 @@ ShadowView::ShadowView(const std::shared_ptr<VulkanDevice> &dev) : VulkanView(de
   _shadow_pipeline = std::make_shared<ShadowPipeline>(dev);
 
   _depth_pipeline = std::make_shared<DepthPersPipeline>(dev, 2048, 2048);
+
+  _shadow_pipeline->set_dynamic_uniforms(true);
+  _depth_pipeline->set_dynamic_uniforms(true);
+
+  // sets 0 and 1 come from the shadow pipeline's layouts, the bindless ones are defined alike;
+  // opt in, the meshes only receive the shadow on the texture path
+  if (VulkanMaterialTable::supported(dev.get())) {
+    _bindless_pipeline = std::make_shared<BindlessPipeline>(dev);
+    _bindless_pipeline->set_dynamic_uniforms(true);
+
+    if (BindlessPipeline::pull_supported(dev.get())) {
+      _pulled_pipeline = std::make_shared<BindlessPipeline>(dev, _bindless_pipeline->materials(), true);
+      _pulled_pipeline->set_dynamic_uniforms(true);
+    }
+
+    // opt in, the depth pass keeps drawing the CPU culled primitives
+    if (VulkanIndirectScene::supported(dev.get())) {
+      _indirect_scene = std::make_shared<VulkanIndirectScene>(dev, 16384, 1);
+      _indirect_pipeline = std::make_shared<IndirectPipeline>(dev, _indirect_scene, _bindless_pipeline->materials());
+      _indirect_pipeline->set_dynamic_uniforms(true);
+    }
+  }
+
   _depth_image = _device->create_depth_image(2048, 2048, VK_FORMAT_D32_SFLOAT);
 
   _depth_pass = std::make_shared<DepthPass>(dev);
 
+  _upscaler = std::make_shared<VulkanUpscaler>(dev);
+
   {
     _basic_texture = std::make_shared<VulkanTexture>();
     _basic_texture->set_image(32, 32, tg::Tvec4<uint8_t>(128, 128, 128, 255));
@@ -149,21 +188,14 @@ ShadowView::~ShadowView()
     _index_mem = VK_NULL_HANDLE;
   }
 
-  if (_descript_pool) {
-    vkDestroyDescriptorPool(*device(), _descript_pool, nullptr);
-    _descript_pool = VK_NULL_HANDLE;
-  }
+  auto descriptors = device()->descriptors();
+  descriptors->release(_shadow_pipeline->matrix_layout(), _matrix_set);
+  descriptors->release(_shadow_pipeline->light_layout(), _light_set);
+  descriptors->release(_shadow_pipeline->pbr_layout(), _pbr_set);
+  if (_depth_pipeline)
+    descriptors->release(_depth_pipeline->matrix_layout(), _shadow_matrix_set);
 
-  for (int i = 0; i < _depth_frames.size(); i++) {
-    vkDestroyFramebuffer(*_device, _depth_frames[i], 0);
-  }
-  _depth_frames.clear();
-
-  for (int i = 0; i < _hud_frames.size(); i++)
-  {
-    vkDestroyFramebuffer(*_device, _hud_frames[i], 0);
-  }
-  _hud_frames.clear();
+  _graph.reset();
 }
 
 void ShadowView::create_sphere()
@@ -276,7 +308,7 @@ void ShadowView::create_sphere()
     VkFence fence;
     VK_CHECK_RESULT(vkCreateFence(*device(), &fenceCreateInfo, nullptr, &fence));
 
-    VK_CHECK_RESULT(vkQueueSubmit(device()->transfer_queue(), 1, &submitInfo, fence));
+    VK_CHECK_RESULT(vkQueueSubmit(device()->graphic_queue(), 1, &submitInfo, fence));
     VK_CHECK_RESULT(vkWaitForFences(*device(), 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
     vkDestroyFence(*device(), fence, nullptr);
     vkFreeCommandBuffers(*device(), device()->command_pool(), 1, &cmdBuffer);
@@ -303,9 +335,6 @@ void ShadowView::set_uniforms()
   memcpy(data, &pbr, sizeof(pbr));
   vkUnmapMemory(*device(), _material->memory());
 
-  _shadow_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(ShadowMatrix));
-
   update_light();
 }
 
@@ -315,13 +344,6 @@ void ShadowView::update_ubo()
   _matrix.view = manipulator().view_matrix();
   _matrix.prj = tg::perspective<float>(fov, float(width()) / height(), 0.1, 1000);
 
-  void *data = 0;
-  {
-    VK_CHECK_RESULT(vkMapMemory(*device(), _ubo_buf->memory(), 0, sizeof(_matrix), 0, (void **)&data));
-    memcpy(data, &_matrix, sizeof(_matrix));
-    vkUnmapMemory(*device(), _ubo_buf->memory());
-  }
-
   tg::boundingbox psc(tg::vec3(-10, -10, 0), tg::vec3(10, 10, 4));
   auto vp = manipulator().eye();
   auto ct = tg::vec3(0, 0, 0);
@@ -364,25 +386,156 @@ void ShadowView::update_ubo()
 
   _shadow_matrix.pers = mat;
 
-  {
-    VK_CHECK_RESULT(vkMapMemory(*device(), _shadow_buf->memory(), 0, sizeof(ShadowMatrix), 0, (void **)&data));
-    memcpy(data, &_shadow_matrix, sizeof(ShadowMatrix));
-    vkUnmapMemory(*device(), _shadow_buf->memory());
+  cull();
+}
+
+void ShadowView::cull()
+{
+  if (!_frustum_cull)
+    return;
+
+  // the depth pass projects through pers before mvp; pers is projective, so its planes stay
+  // planes in world space, and the scene box it is fitted to lies in front of its eye
+  Frustum camera(_matrix.prj * _matrix.view);
+  Frustum shadow(_shadow_matrix.mvp * _shadow_matrix.pers);
+
+  bool changed = false;
+  for (auto &mesh : {_tree, _deer}) {
+    changed |= mesh->cull(camera, MeshInstance::camera_view);
+    changed |= mesh->cull(shadow, MeshInstance::shadow_view);
   }
+
+  // each buffer is recorded again once its image is idle
+  if (changed)
+    build_command_buffers();
+}
+
+void ShadowView::set_frustum_cull(bool enable)
+{
+  _frustum_cull = enable;
+  if (enable) {
+    cull();
+    return;
+  }
+
+  for (auto &mesh : {_tree, _deer}) {
+    mesh->uncull(MeshInstance::camera_view);
+    mesh->uncull(MeshInstance::shadow_view);
+  }
+  build_command_buffers();
+}
+
+const char *ShadowView::mesh_path_name(MeshPath path)
+{
+  switch (path) {
+    case texture_path:
+      return "texture";
+    case bindless_path:
+      return "bindless";
+    case pulled_path:
+      return "pulled";
+    case indirect_path:
+      return "indirect";
+    default:
+      return "unknown";
+  }
+}
+
+bool ShadowView::parse_mesh_path(const char *name, MeshPath &path)
+{
+  for (int i = 0; i < mesh_path_count; i++) {
+    if (strcmp(name, mesh_path_name(MeshPath(i))) == 0) {
+      path = MeshPath(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ShadowView::mesh_path_supported(MeshPath path)
+{
+  switch (path) {
+    case texture_path:
+      return true;
+    case bindless_path:
+      return _bindless_pipeline != nullptr;
+    case pulled_path:
+      return _pulled_pipeline != nullptr;
+    case indirect_path:
+      return _indirect_pipeline != nullptr;
+    default:
+      return false;
+  }
+}
+
+void ShadowView::set_mesh_path(MeshPath path)
+{
+  if (!mesh_path_supported(path))
+    path = texture_path;
+  if (path == _mesh_path)
+    return;
+
+  _mesh_path = path;
+  build_command_buffers();
 }
 
 void ShadowView::update_light()
 {
   _shadow_matrix.light = light.light_dir;
+}
 
-  uint8_t *data = 0;
-  {
-    VK_CHECK_RESULT(vkMapMemory(*device(), _light->memory(), 0, sizeof(light), 0, (void **)&data));
-    memcpy(data, &light, sizeof(light));
-  vkUnmapMemory(*device(), _light->memory());
+void ShadowView::update_uniforms(uint32_t frame)
+{
+  // the profiler has just read back the frame that used this slot before; the command
+  // buffers are recorded again for a new scale, each once its image is idle
+  if (_dynamic_resolution && _resolution.update(gpu_frame_ms())) {
+    _render_extent = _resolution.extent({uint32_t(_w), uint32_t(_h)});
+    _graph->set_render_area("main pass", _render_extent);
+    _upscaler->set_input_extent(_render_extent);
+    build_command_buffers();
+  }
+
+  if (!_uniforms)
+    return;
+
+  // same sizes in the same order every frame, so the offsets match the ones recorded for this frame
+  _uniforms->begin_frame(frame);
+  _offsets.matrix = _uniforms->push(_matrix);
+  _offsets.light = _uniforms->push(light);
+  _offsets.shadow = _uniforms->push(_shadow_matrix);
+  if (_indirect_scene) {
+    _indirect_scene->update(frame);
+    _offsets.cull = _uniforms->push(VulkanIndirectScene::frustum(_matrix.prj * _matrix.view));
   }
 }
 
+void ShadowView::update_uniform_sets()
+{
+  if (!_uniforms)
+    return;
+
+  VkDescriptorBufferInfo descriptors[3] = {_uniforms->descriptor(sizeof(_matrix)), _uniforms->descriptor(sizeof(light)),
+                                           _uniforms->descriptor(sizeof(ShadowMatrix))};
+  VkDescriptorSet sets[3] = {_matrix_set, _light_set, _shadow_matrix_set};
+
+  for (int i = 0; i < 3; i++) {
+    if (!sets[i])
+      continue;
+
+    VkWriteDescriptorSet writeDescriptorSet = {};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.dstSet = sets[i];
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    writeDescriptorSet.pBufferInfo = &descriptors[i];
+    writeDescriptorSet.dstBinding = 0;
+    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+  }
+
+  if (_indirect_scene)
+    _indirect_scene->set_frustum_buffer(_uniforms->descriptor(sizeof(CullFrustum)));
+}
+
 void ShadowView::resize(int w, int h)
 {
   update_ubo();
@@ -419,7 +572,81 @@ void ShadowView::update_scene()
       fun();
     }
 
+    int frames = frames_in_flight();
+    if (ImGui::SliderInt("frames in flight", &frames, 1, 3))
+      set_frames_in_flight(frames);
+
+    // switching recreates the swapchain at the next frame
+    if (!_swapchain->headless()) {
+      auto mode = _swapchain->present_mode();
+      if (ImGui::BeginCombo("present mode", VulkanSwapChain::present_mode_name(mode))) {
+        for (auto candidate : _swapchain->present_modes()) {
+          if (ImGui::Selectable(VulkanSwapChain::present_mode_name(candidate), candidate == mode))
+            set_present_mode(candidate);
+        }
+        ImGui::EndCombo();
+      }
+
+      int images = _swapchain->image_count();
+      int max_images = _swapchain->max_image_count() ? _swapchain->max_image_count() : 8;
+      if (ImGui::SliderInt("swapchain images", &images, _swapchain->min_image_count(), max_images))
+        set_image_count(images);
+
+      if (device()->present_wait()) {
+        int latency = present_latency();
+        if (ImGui::SliderInt("queued presents", &latency, 0, 3))
+          set_present_latency(latency);
+      }
+    }
+
     ImGui::End();
+
+    int path = _mesh_path;
+    if (ImGui::BeginCombo("meshes", mesh_path_name(_mesh_path))) {
+      for (int i = 0; i < mesh_path_count; i++) {
+        if (mesh_path_supported(MeshPath(i)) && ImGui::Selectable(mesh_path_name(MeshPath(i)), i == path))
+          set_mesh_path(MeshPath(i));
+      }
+      ImGui::EndCombo();
+    }
+
+    bool culled = _frustum_cull;
+    if (ImGui::Checkbox("frustum culling", &culled))
+      set_frustum_cull(culled);
+
+    bool scaled = _dynamic_resolution;
+    if (ImGui::Checkbox("dynamic resolution", &scaled))
+      set_dynamic_resolution(scaled);
+    if (_dynamic_resolution) {
+      ImGui::SliderFloat("gpu budget ms", &_resolution.config().budget_ms, 2, 50);
+      ImGui::Text("scale %.2f, %ux%u, gpu %.2f ms", _resolution.scale(), _render_extent.width, _render_extent.height, gpu_frame_ms());
+
+      // the blit filters linearly, the graph's profiler scopes time each upscaler pass
+      int upscale = _compute_upscale ? _upscaler->mode() + 1 : 0;
+      const char *names[] = {"blit", VulkanUpscaler::mode_name(VulkanUpscaler::bilinear), VulkanUpscaler::mode_name(VulkanUpscaler::easu),
+                             VulkanUpscaler::mode_name(VulkanUpscaler::easu_rcas)};
+      if (ImGui::Combo("upscale", &upscale, names, 4))
+        set_upscale(upscale != 0, upscale ? VulkanUpscaler::Mode(upscale - 1) : _upscaler->mode());
+      if (_compute_upscale && _upscaler->mode() == VulkanUpscaler::easu_rcas) {
+        float sharpness = _upscaler->sharpness();
+        if (ImGui::SliderFloat("sharpness stops", &sharpness, 0, 2)) {
+          // pushed when recorded
+          _upscaler->set_sharpness(sharpness);
+          build_command_buffers();
+        }
+      }
+    }
+
+    if (_graph) {
+      auto &stats = _graph->stats();
+      ImGui::Text("render graph: %u passes, %u culled, %u barriers", stats.passes, stats.culled, stats.barriers);
+      ImGui::Text("transient: %.1f MB, %.1f MB unaliased", stats.transient_size / 1048576.0, stats.unaliased_size / 1048576.0);
+    }
+
+    device()->profiler()->draw_imgui();
+    frame_stats()->draw_imgui();
+    device()->memory()->draw_imgui();
+
     ImGui::EndFrame();
     ImGui::Render();
   }
@@ -441,9 +668,16 @@ void ShadowView::key_up(int key)
 
 void ShadowView::create_command_buffers()
 {
-  int count = _swapchain->image_count();
-  if (count != _cmd_bufs.size()) {
-    _cmd_bufs = _device->create_command_buffers(count);
+  VulkanView::create_command_buffers();
+
+  // the descriptor sets point into the ring, they can not be rewritten while in flight;
+  // only the submitted frames read the old ring, the device need not go idle
+  uint32_t count = _swapchain->image_count();
+  if (!_uniforms || _uniforms->frames() < count) {
+    if (_uniforms)
+      wait_frames();
+    _uniforms = std::make_shared<VulkanUniformRing>(_device, count, 4096);
+    update_uniform_sets();
   }
 }
 
@@ -453,7 +687,7 @@ void ShadowView::build_depth_command_buffer(VkCommandBuffer cmd_buf)
   mt.identity();
   if (_depth_pipeline && _depth_pipeline->valid()) {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_depth_pipeline);
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _depth_pipeline->pipe_layout(), 0, 1, &_shadow_matrix_set, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _depth_pipeline->pipe_layout(), 0, 1, &_shadow_matrix_set, 1, &_offsets.shadow);
 
     vkCmdPushConstants(cmd_buf, _depth_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
 
@@ -490,107 +724,142 @@ void ShadowView::build_command_buffers()
   if (!_depth_pipeline->valid() || !_shadow_pipeline->valid())
     return;
 
-  vkDeviceWaitIdle(*_device);
-
-  auto &framebuffers = frame_buffers();
-  auto &renderPass = *render_pass();
-  assert(framebuffers.size() == _cmd_bufs.size());
+  VulkanView::build_command_buffers();
+}
 
+void ShadowView::record_command_buffer(uint32_t i)
+{
   VkCommandBufferBeginInfo buf_info = {};
   buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   buf_info.pNext = nullptr;
 
-  VkClearValue clearValues[2];
+  auto &cmd_buf = _cmd_bufs[i];
+  _recording = i;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
+
+  auto profiler = device()->profiler();
+  profiler->record(cmd_buf, i, VulkanProfiler::view_pass);
+  profiler->begin(cmd_buf, "frame");
+
+  // the view bound to the shadow map when this frame is recorded, the set lives until the
+  // command buffer is recorded again
+  {
+    _shadow_texture_set = device()->descriptors()->allocate_frame(_shadow_pipeline->shadow_texture_layout());
+
+    VkDescriptorImageInfo depthDescriptor = _shadow_texture->descriptor();
+    depthDescriptor.imageView = _graph->image_view(_shadow_map);
+
+    VkWriteDescriptorSet writeDescriptorSet = {};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.dstSet = _shadow_texture_set;
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writeDescriptorSet.dstBinding = 0;
+    writeDescriptorSet.pImageInfo = &depthDescriptor;
+    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+  }
 
-  VkRenderPassBeginInfo renderPassBeginInfo = {};
-  renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderPassBeginInfo.pNext = nullptr;
-  renderPassBeginInfo.renderArea.offset.x = 0;
-  renderPassBeginInfo.renderArea.offset.y = 0;
-  renderPassBeginInfo.renderArea.extent.width = _w;
-  renderPassBeginInfo.renderArea.extent.height = _h;
-  renderPassBeginInfo.clearValueCount = 1;
-  renderPassBeginInfo.pClearValues = clearValues;
+  // passes, barriers and layout transitions come from the graph
+  _graph->bind_image(_backbuffer, _swapchain->image(i), _swapchain->image_view(i));
+  _graph->execute(cmd_buf);
 
-  for (int i = 0; i < _cmd_bufs.size(); i++) {
-    renderPassBeginInfo.renderPass = *_depth_pass;
-    renderPassBeginInfo.framebuffer = _depth_frames[i];
-    renderPassBeginInfo.renderArea.extent.width = _depth_image->width();
-    renderPassBeginInfo.renderArea.extent.height = _depth_image->height();
-    auto &cmd_buf = _cmd_bufs[i];
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
+  profiler->end(cmd_buf);
+  VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
+}
 
-    clearValues[0].depthStencil = {1.f, 0};
-    renderPassBeginInfo.clearValueCount = 1;
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+void ShadowView::draw_hud(VkCommandBuffer cmd_buf)
+{
+  {
+    VkViewport viewport = {};
+    viewport.width = _w;
+    viewport.height = _h;
+    viewport.minDepth = 0;
+    viewport.maxDepth = 1;
+    vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+  }
 
-    build_depth_command_buffer(cmd_buf);
+  {
+    VkRect2D scissor = {};
+    scissor.extent.width = _w;
+    scissor.extent.height = _h;
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+  }
 
-    vkCmdEndRenderPass(cmd_buf);
+  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_hud_pipeline);
+  tg::mat4 mat;
+  mat.identity();
+  mat[0][0] = 2.0 / width();
+  mat[1][1] = 2.0 / height();
+  mat = tg::translate(-1.f, -1.f, 0.f) * mat;
+  vkCmdPushConstants(cmd_buf, _hud_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat), &mat);
+  _hud_rect->fill_command(cmd_buf, _hud_pipeline.get());
+}
 
-    clearValues[0].color = {{0.0, 0.0, 0.2, 1.0}};
-    clearValues[1].depthStencil = {1.f, 0};
-    renderPassBeginInfo.clearValueCount = 2;
+void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf) 
+{
+  bind_main_state(cmd_buf);
 
-    renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.framebuffer = framebuffers[i];
-    renderPassBeginInfo.renderArea.extent.width = width();
-    renderPassBeginInfo.renderArea.extent.height = height();
+  if (_shadow_pipeline && _shadow_pipeline->valid())
+    draw_ground(cmd_buf);
 
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  if (_mesh_path == texture_path) {
+    _tree->build_command_buffer(cmd_buf, std::static_pointer_cast<TexturePipeline>(_shadow_pipeline));
+    _deer->build_command_buffer(cmd_buf, std::static_pointer_cast<TexturePipeline>(_shadow_pipeline));
+    return;
+  }
 
-    build_command_buffer(cmd_buf);
+  bind_mesh_state(cmd_buf);
+  if (_mesh_path == indirect_path) {
+    _indirect_scene->draw(cmd_buf, _indirect_pipeline, _recording);
+    return;
+  }
 
-    vkCmdEndRenderPass(cmd_buf);
+  _tree->build_command_buffer(cmd_buf, mesh_pipeline());
+  _deer->build_command_buffer(cmd_buf, mesh_pipeline());
+}
 
-    {
-      renderPassBeginInfo.renderPass = *_hud_pass;
-      renderPassBeginInfo.framebuffer = _hud_frames[i];
-      renderPassBeginInfo.clearValueCount = 0;
-      vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-      {
-        VkViewport viewport = {};
-        viewport.width = _w;
-        viewport.height = _h;
-        viewport.minDepth = 0;
-        viewport.maxDepth = 1;
-        vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-      }
+void ShadowView::build_main_secondaries(VkCommandBuffer cmd_buf, const VkCommandBufferInheritanceInfo &inheritance)
+{
+  auto setup = [this](VkCommandBuffer cmd) { bind_main_state(cmd); };
 
-      {
-        VkRect2D scissor = {};
-        scissor.extent.width = _w;
-        scissor.extent.height = _h;
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-        vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-      }
+  if (_shadow_pipeline && _shadow_pipeline->valid()) {
+    auto ground = _device->commands()->record_secondary(_recording, inheritance, 1, [this](VkCommandBuffer cmd, uint32_t, uint32_t) {
+      bind_main_state(cmd);
+      draw_ground(cmd);
+    });
+    vkCmdExecuteCommands(cmd_buf, static_cast<uint32_t>(ground.size()), ground.data());
+  }
 
-      vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_hud_pipeline);
-      tg::mat4 mat;
-      mat.identity();
-      mat[0][0] = 2.0 / width();
-      mat[1][1] = 2.0 / height();
-      mat = tg::translate(-1.f, -1.f, 0.f) * mat;
-      vkCmdPushConstants(cmd_buf, _hud_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat), &mat);
-      _hud_rect->fill_command(cmd_buf, _hud_pipeline.get());
-      vkCmdEndRenderPass(cmd_buf);
-    }
+  if (_mesh_path == texture_path) {
+    auto pipeline = std::static_pointer_cast<TexturePipeline>(_shadow_pipeline);
+    _tree->record_parallel(cmd_buf, _recording, pipeline, inheritance, setup);
+    _deer->record_parallel(cmd_buf, _recording, pipeline, inheritance, setup);
+    return;
+  }
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
+  if (_mesh_path == indirect_path) {
+    auto meshes = _device->commands()->record_secondary(_recording, inheritance, 1, [this](VkCommandBuffer cmd, uint32_t, uint32_t) {
+      bind_mesh_state(cmd);
+      _indirect_scene->draw(cmd, _indirect_pipeline, _recording);
+    });
+    vkCmdExecuteCommands(cmd_buf, static_cast<uint32_t>(meshes.size()), meshes.data());
+    return;
   }
+
+  auto mesh_setup = [this](VkCommandBuffer cmd) { bind_mesh_state(cmd); };
+  _tree->record_parallel(cmd_buf, _recording, mesh_pipeline(), inheritance, mesh_setup);
+  _deer->record_parallel(cmd_buf, _recording, mesh_pipeline(), inheritance, mesh_setup);
 }
 
-void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf) 
+void ShadowView::bind_main_state(VkCommandBuffer cmd_buf)
 {
-  tg::mat4 mt;
-  mt.identity();
   {
     VkViewport viewport = {};
-    viewport.y = _h;
-    viewport.width = _w;
-    viewport.height = -_h;
+    viewport.y = _render_extent.height;
+    viewport.width = _render_extent.width;
+    viewport.height = -float(_render_extent.height);
     viewport.minDepth = 0;
     viewport.maxDepth = 1;
     vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
@@ -598,8 +867,7 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
 
   {
     VkRect2D scissor = {};
-    scissor.extent.width = _w;
-    scissor.extent.height = _h;
+    scissor.extent = _render_extent;
     scissor.offset.x = 0;
     scissor.offset.y = 0;
     vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
@@ -608,9 +876,9 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
   if (_shadow_pipeline && _shadow_pipeline->valid()) {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_shadow_pipeline);
 
-    uint32_t offset[1] = {};
+    uint32_t offset[3] = {_offsets.matrix, _offsets.light, 0};
     VkDescriptorSet dessets[3] = {_matrix_set, _light_set, _pbr_set};
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 0, 3, dessets, 1, offset);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 0, 3, dessets, 3, offset);
 
     VkWriteDescriptorSet texture_set = {};
     texture_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -622,80 +890,54 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
     texture_set.pImageInfo = &descriptor;
     _device->vkCmdPushDescriptorSetKHR(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 3, 1, &texture_set);
 
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 4, 1, &_shadow_matrix_set, 0, 0);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 4, 1, &_shadow_matrix_set, 1, &_offsets.shadow);
     vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 5, 1, &_shadow_texture_set, 0, 0);
+  }
+}
 
-    vkCmdPushConstants(cmd_buf, _shadow_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
+void ShadowView::bind_mesh_state(VkCommandBuffer cmd_buf)
+{
+  bind_main_state(cmd_buf);
 
-    {
-      VkDeviceSize offset[3] = {0, _vert_count * sizeof(vec3), _vert_count * (sizeof(vec3) + sizeof(vec2))};
-      VkBuffer bufs[3] = {};
-      bufs[0] = _vert_buf;
-      bufs[1] = _vert_buf;
-      bufs[2] = _vert_buf;
+  // the push constants of the layouts differ, so nothing bound above carries over
+  uint32_t offset[2] = {_offsets.matrix, _offsets.light};
+  VkDescriptorSet dessets[2] = {_matrix_set, _light_set};
+  auto layout = _mesh_path == indirect_path ? _indirect_pipeline->pipe_layout() : mesh_pipeline()->pipe_layout();
+  vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 2, dessets, 2, offset);
+}
 
-      vkCmdBindVertexBuffers(cmd_buf, 0, 3, bufs, offset);
-      vkCmdBindIndexBuffer(cmd_buf, _index_buf, 0, VK_INDEX_TYPE_UINT16);
-      vkCmdDrawIndexed(cmd_buf, _index_count, 1, 0, 0, 0);
-    }
-  }
+const std::shared_ptr<BindlessPipeline> &ShadowView::mesh_pipeline()
+{
+  return _mesh_path == pulled_path ? _pulled_pipeline : _bindless_pipeline;
+}
+
+void ShadowView::draw_ground(VkCommandBuffer cmd_buf)
+{
+  tg::mat4 mt;
+  mt.identity();
+  vkCmdPushConstants(cmd_buf, _shadow_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
 
-  _tree->build_command_buffer(cmd_buf, std::static_pointer_cast<TexturePipeline>(_shadow_pipeline));
+  VkDeviceSize offset[3] = {0, _vert_count * sizeof(vec3), _vert_count * (sizeof(vec3) + sizeof(vec2))};
+  VkBuffer bufs[3] = {};
+  bufs[0] = _vert_buf;
+  bufs[1] = _vert_buf;
+  bufs[2] = _vert_buf;
 
-  _deer->build_command_buffer(cmd_buf, std::static_pointer_cast<TexturePipeline>(_shadow_pipeline));
+  vkCmdBindVertexBuffers(cmd_buf, 0, 3, bufs, offset);
+  vkCmdBindIndexBuffer(cmd_buf, _index_buf, 0, VK_INDEX_TYPE_UINT16);
+  vkCmdDrawIndexed(cmd_buf, _index_count, 1, 0, 0, 0);
 }
 
 void ShadowView::create_pipe_layout()
 {
-  VkDescriptorPoolSize typeCounts[1];
-  typeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  typeCounts[0].descriptorCount = 10;
-
-  VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
-  descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  descriptorPoolInfo.pNext = nullptr;
-  descriptorPoolInfo.poolSizeCount = 1;
-  descriptorPoolInfo.pPoolSizes = typeCounts;
-  descriptorPoolInfo.maxSets = 10;
+  auto descriptors = device()->descriptors();
+  _matrix_set = descriptors->allocate(_shadow_pipeline->matrix_layout());
+  _light_set = descriptors->allocate(_shadow_pipeline->light_layout());
+  _pbr_set = descriptors->allocate(_shadow_pipeline->pbr_layout());
 
-  VkDescriptorPool desPool;
-  VK_CHECK_RESULT(vkCreateDescriptorPool(*device(), &descriptorPoolInfo, nullptr, &desPool));
-  _descript_pool = desPool;
+  update_uniform_sets();
 
-  //----------------------------------------------------------------------------------------------------
-  auto mlayout = _shadow_pipeline->matrix_layout();
-  auto llayout = _shadow_pipeline->light_layout();
-  auto playout = _shadow_pipeline->pbr_layout();
-
-  VkDescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.descriptorPool = desPool;
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &mlayout;
-
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_matrix_set));
-
-  allocInfo.pSetLayouts = &llayout;
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_light_set));
-
-  allocInfo.pSetLayouts = &playout;
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_pbr_set));
-
-  VkDescriptorBufferInfo descriptor = {};
-  int sz = sizeof(_matrix);
-  _ubo_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  descriptor.buffer = *_ubo_buf;
-  descriptor.offset = 0;
-  descriptor.range = sizeof(_matrix);
-
-  sz = sizeof(light);
-  VkDescriptorBufferInfo ldescriptor = {};
-  _light = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  ldescriptor.buffer = *_light;
-  ldescriptor.offset = 0;
-  ldescriptor.range = sz;
-
-  sz = sizeof(pbr);
+  int sz = sizeof(pbr);
   VkDescriptorBufferInfo mdescriptor = {};
   _material = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
   mdescriptor.buffer = *_material;
@@ -704,18 +946,7 @@ void ShadowView::create_pipe_layout()
 
   VkWriteDescriptorSet writeDescriptorSet = {};
   writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  writeDescriptorSet.dstSet = _matrix_set;
   writeDescriptorSet.descriptorCount = 1;
-  writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  writeDescriptorSet.pBufferInfo = &descriptor;
-  writeDescriptorSet.dstBinding = 0;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
-  writeDescriptorSet.dstSet = _light_set;
-  writeDescriptorSet.pBufferInfo = &ldescriptor;
-  writeDescriptorSet.dstBinding = 0;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
   writeDescriptorSet.dstSet = _pbr_set;
   writeDescriptorSet.pBufferInfo = &mdescriptor;
   writeDescriptorSet.dstBinding = 0;
@@ -754,137 +985,197 @@ void ShadowView::create_pipe_layout()
 
 void ShadowView::create_frame_buffers()
 {
-  {
-    auto view = _depth_image->image_view();
-    VkFramebufferCreateInfo frameBufferCreateInfo = {};
-    frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    frameBufferCreateInfo.pNext = NULL;
-    frameBufferCreateInfo.renderPass = *_depth_pass;
-    frameBufferCreateInfo.attachmentCount = 1;
-    frameBufferCreateInfo.pAttachments = &view;
-    frameBufferCreateInfo.width = _depth_image->width();
-    frameBufferCreateInfo.height = _depth_image->height();
-    frameBufferCreateInfo.layers = 1;
-
-    for (int i = 0; i < _depth_frames.size(); i++)
-      vkDestroyFramebuffer(*device(), _depth_frames[i], 0);
-
-    _depth_frames.resize(_swapchain->image_count());
-    for (int i = 0; i < _depth_frames.size(); i++) {
-      VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &_depth_frames[i]));
+  // the transient depth and the framebuffers follow the window size, so the graph is built
+  // again with it while frames in flight keep the old one. Without dynamic rendering the
+  // pipelines stay realized against DepthPass, HUDPass and the view's render pass, the
+  // graph's render passes have the same formats
+  if (_graph)
+    defer_destroy([graph = _graph]() {});
+  _graph = std::make_shared<VulkanRenderGraph>(_device);
+  _graph->set_dynamic_rendering(_dynamic_rendering);
+
+  using Usage = VulkanRenderGraph::Usage;
+  using Target = VulkanRenderGraph::Target;
+
+  _backbuffer = _graph->import_image("backbuffer", {uint32_t(_w), uint32_t(_h), _swapchain->color_format()},
+                                     VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+  _shadow_map = _graph->import_image("shadow map", {_depth_image->width(), _depth_image->height(), _depth_image->format()});
+  _graph->bind_image(_shadow_map, _depth_image->image(), _depth_image->image_view());
+
+  auto depth = _graph->create_image("depth", {uint32_t(_w), uint32_t(_h), _depth_format});
+
+  // a scaled main pass renders into part of a window sized target, so a new scale does
+  // not reallocate anything, and is blitted or upscaled to the swapchain image
+  auto color = _backbuffer;
+  _render_extent = {uint32_t(_w), uint32_t(_h)};
+  if (_dynamic_resolution) {
+    _scene = _graph->create_image("scene", {uint32_t(_w), uint32_t(_h), _swapchain->color_format()});
+    _render_extent = _resolution.extent(_render_extent);
+    color = _scene;
+  }
+
+  VkClearValue clear_depth = {};
+  clear_depth.depthStencil = {1.f, 0};
+  VkClearValue clear_color = {};
+  clear_color.color = {{0.0, 0.0, 0.2, 1.0}};
+
+  _graph->add_pass("shadow pass", [this](VkCommandBuffer cmd_buf, const Target &) { build_depth_command_buffer(cmd_buf); })
+      .write(_shadow_map, Usage::depth_attachment)
+      .clear(_shadow_map, clear_depth);
+
+  // cull() puts the barriers around its commands itself, nothing is declared for them
+  if (_indirect_scene) {
+    _graph->add_pass("gpu cull", [this](VkCommandBuffer cmd_buf, const Target &) {
+      if (_mesh_path == indirect_path)
+        _indirect_scene->cull(cmd_buf, _recording, _offsets.cull);
+    })
+        .side_effect();
+  }
+
+  // the main pass is recorded by the workers, the primary only executes it
+  _graph->add_pass("main pass", [this](VkCommandBuffer cmd_buf, const Target &target) { build_main_secondaries(cmd_buf, target.inheritance()); })
+      .read(_shadow_map, Usage::sampled)
+      .write(color, Usage::color_attachment)
+      .write(depth, Usage::depth_attachment)
+      .clear(color, clear_color)
+      .clear(depth, clear_depth)
+      .secondary();
+
+  if (_dynamic_resolution) {
+    _graph->set_render_area("main pass", _render_extent);
+
+    // the compute upscaler cannot store into the swapchain image, its result is copied
+    auto src = _scene;
+    if (_compute_upscale) {
+      _upscaler->set_input_extent(_render_extent);
+      src = _upscaler->add_passes(*_graph, _scene, {uint32_t(_w), uint32_t(_h)});
     }
+    _graph->add_pass("upscale blit", [this, src](VkCommandBuffer cmd_buf, const Target &) {
+      blit(cmd_buf, src, src == _scene ? _render_extent : VkExtent2D{uint32_t(_w), uint32_t(_h)});
+    })
+        .read(src, Usage::transfer_src)
+        .write(_backbuffer, Usage::transfer_dst);
   }
 
-  VkImageView attachments[2];
-  attachments[1] = _depth->image_view();
+  _graph->add_pass("hud", [this](VkCommandBuffer cmd_buf, const Target &) { draw_hud(cmd_buf); })
+      .read(_shadow_map, Usage::sampled)
+      .write(_backbuffer, Usage::color_attachment);
+
+  _graph->compile();
+}
+
+void ShadowView::set_dynamic_rendering(bool enable)
+{
+  _dynamic_rendering = enable && device()->dynamic_rendering();
+}
+
+void ShadowView::set_dynamic_resolution(bool enable)
+{
+  enable = enable && (_swapchain->image_usage() & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  if (enable == _dynamic_resolution)
+    return;
 
-  VkFramebufferCreateInfo frameBufferCreateInfo = {};
-  frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-  frameBufferCreateInfo.pNext = NULL;
-  frameBufferCreateInfo.renderPass = *render_pass();
-  frameBufferCreateInfo.attachmentCount = 2;
-  frameBufferCreateInfo.pAttachments = attachments;
-  frameBufferCreateInfo.width = _w;
-  frameBufferCreateInfo.height = _h;
-  frameBufferCreateInfo.layers = 1;
+  _dynamic_resolution = enable;
+  _resolution.reset(_resolution.config().max_scale);
 
-  std::vector<VkFramebuffer> frameBuffers;
-  frameBuffers.resize(_swapchain->image_count());
-  for (uint32_t i = 0; i < frameBuffers.size(); i++) {
-    attachments[0] = _swapchain->image_view(i);
-    VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &frameBuffers[i]));
+  // the scene target and the upscale pass come and go with it
+  if (_graph) {
+    create_frame_buffers();
+    build_command_buffers();
   }
+}
 
-  set_frame_buffers(frameBuffers);
+void ShadowView::set_upscale(bool compute, VulkanUpscaler::Mode mode)
+{
+  if (compute == _compute_upscale && mode == _upscaler->mode())
+    return;
 
-  {
-    for (int i = 0; i < _hud_frames.size(); i++)
-      vkDestroyFramebuffer(*device(), _hud_frames[i], 0);
-
-    VkFramebufferCreateInfo frameBufferCreateInfo = {};
-    frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    frameBufferCreateInfo.pNext = NULL;
-    frameBufferCreateInfo.renderPass = *_hud_pass;
-    frameBufferCreateInfo.attachmentCount = 1;
-    frameBufferCreateInfo.width = _w;
-    frameBufferCreateInfo.height = _h;
-    frameBufferCreateInfo.layers = 1;
-
-    std::vector<VkFramebuffer> frameBuffers;
-    frameBuffers.resize(_swapchain->image_count());
-    for (uint32_t i = 0; i < frameBuffers.size(); i++) {
-      VkImageView img = _swapchain->image_view(i);
-      frameBufferCreateInfo.pAttachments = &img; 
-      VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &frameBuffers[i]));
-    }
-    _hud_frames = std::move(frameBuffers);
+  _compute_upscale = compute;
+  _upscaler->set_mode(mode);
+  if (_graph && _dynamic_resolution) {
+    create_frame_buffers();
+    build_command_buffers();
   }
 }
 
-void ShadowView::create_pipeline()
+float ShadowView::gpu_frame_ms()
 {
-  if (_depth_pipeline) {
-    _depth_pipeline->realize(_depth_pass.get());
+  for (auto &scope : device()->profiler()->frame()) {
+    if (scope.name == "frame")
+      return static_cast<float>(scope.ms);
+  }
+  return 0;
+}
 
-    auto des_layout = _depth_pipeline->matrix_layout();
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descript_pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &des_layout;
+void ShadowView::blit(VkCommandBuffer cmd_buf, VulkanRenderGraph::Resource src, VkExtent2D extent)
+{
+  VkImageBlit blit = {};
+  blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  blit.srcOffsets[1] = {int32_t(extent.width), int32_t(extent.height), 1};
+  blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  blit.dstOffsets[1] = {_w, _h, 1};
+  vkCmdBlitImage(cmd_buf, _graph->image(src), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _graph->image(_backbuffer),
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+}
 
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_shadow_matrix_set));
+void ShadowView::create_pipeline()
+{
+  // with dynamic rendering the pipelines only know the formats of the graph's passes
+  if (_dynamic_rendering) {
+    _depth_pipeline->set_rendering({}, _depth_image->format());
+    _shadow_pipeline->set_rendering({_swapchain->color_format()}, _depth_format);
+    if (_bindless_pipeline)
+      _bindless_pipeline->set_rendering({_swapchain->color_format()}, _depth_format);
+    if (_pulled_pipeline)
+      _pulled_pipeline->set_rendering({_swapchain->color_format()}, _depth_format);
+    if (_indirect_pipeline)
+      _indirect_pipeline->set_rendering({_swapchain->color_format()}, _depth_format);
+    _hud_pipeline->set_rendering({_swapchain->color_format()});
+  }
+  VulkanPass *depth_pass = _dynamic_rendering ? nullptr : _depth_pass.get();
+  VulkanPass *main_pass = _dynamic_rendering ? nullptr : render_pass();
+  VulkanPass *hud_pass = _dynamic_rendering ? nullptr : _hud_pass.get();
 
-    int sz = sizeof(_shadow_matrix);
-    VkDescriptorBufferInfo descriptor = {};
-    descriptor.buffer = *_shadow_buf;
-    descriptor.offset = 0;
-    descriptor.range = sz;
+  if (_depth_pipeline) {
+    _depth_pipeline->realize(depth_pass);
 
-    VkWriteDescriptorSet writeDescriptorSet = {};
-    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSet.dstSet = _shadow_matrix_set;
-    writeDescriptorSet.descriptorCount = 1;
-    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    writeDescriptorSet.pBufferInfo = &descriptor;
-    writeDescriptorSet.dstBinding = 0;
-    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+    _shadow_matrix_set = device()->descriptors()->allocate(_depth_pipeline->matrix_layout());
+    update_uniform_sets();
   }
 
-  _shadow_pipeline->realize(render_pass());
+  _shadow_pipeline->realize(main_pass);
 
   _tree->realize(_device, _shadow_pipeline);
 
   _deer->realize(_device, _shadow_pipeline);
 
-  {
-    auto slayout = _shadow_pipeline->shadow_texture_layout();
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descript_pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &slayout;
+  // the depth pass keeps drawing the textured primitives, the bindless draws share their buffers
+  if (_bindless_pipeline) {
+    _bindless_pipeline->realize(main_pass);
+    _tree->realize(_device, _bindless_pipeline);
+    _deer->realize(_device, _bindless_pipeline);
+  }
 
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_shadow_texture_set));
+  // the primitives' buffers have device addresses whenever pulling is supported
+  if (_pulled_pipeline)
+    _pulled_pipeline->realize(main_pass);
 
-    _shadow_texture = std::make_shared<VulkanTexture>();
-    _shadow_texture->realize(_depth_image);
-    VkDescriptorImageInfo depthDescriptor = _shadow_texture->descriptor();
-
-    VkWriteDescriptorSet writeDescriptorSet = {};
-    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSet.dstSet = _shadow_texture_set;
-    writeDescriptorSet.descriptorCount = 1;
-    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    writeDescriptorSet.pBufferInfo = 0;
-    writeDescriptorSet.dstBinding = 0;
-    writeDescriptorSet.pImageInfo = &depthDescriptor;
-    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+  // the scene copies the geometry of the primitives once, their materials are added again
+  if (_indirect_pipeline) {
+    _indirect_pipeline->realize(main_pass);
+    _tree->realize(_device, _indirect_pipeline);
+    _deer->realize(_device, _indirect_pipeline);
+    _indirect_scene->realize(frame_count());
   }
 
+  // the set sampling it is a frame set, written whenever a command buffer is recorded
+  _shadow_texture = std::make_shared<VulkanTexture>();
+  _shadow_texture->realize(_depth_image);
+
   {
-    _hud_pipeline->realize(_hud_pass.get());
-    _hud_rect->setTexture(_hud_pipeline.get(), _shadow_texture.get(), _descript_pool);
+    _hud_pipeline->realize(hud_pass);
+    _hud_rect->setTexture(_hud_pipeline.get(), _shadow_texture.get());
   }
 
   build_command_buffers();
@@ -2,6 +2,8 @@
 
 #include "VulkanView.h"
 #include "ShadowPipeline.h"
+#include "BindlessPipeline.h"
+#include "IndirectPipeline.h"
 #include "RenderData.h"
 #include "MeshInstance.h"
 #include "DepthPersPipeline.h"
@@ -9,9 +11,30 @@
 #include "HUDPass.h"
 #include "HUDPipeline.h"
 #include "HUDRect.h"
+#include "VulkanRenderGraph.h"
+#include "VulkanResolutionScale.h"
+#include "VulkanUpscaler.h"
+
+class VulkanUniformRing;
+class VulkanIndirectScene;
 
 class ShadowView : public VulkanView {
 public:
+  // how the main pass draws the loaded meshes; the bindless paths do not receive the
+  // shadow, the ground always does, so the texture path stays the default
+  enum MeshPath {
+    texture_path,
+    bindless_path,
+    // bindless with the attributes read through buffer device addresses
+    pulled_path,
+    // culled on the GPU against the camera and drawn with one indirect count draw
+    indirect_path,
+    mesh_path_count,
+  };
+
+  static const char *mesh_path_name(MeshPath path);
+  static bool parse_mesh_path(const char *name, MeshPath &path);
+
   ShadowView(const std::shared_ptr<VulkanDevice> &dev);
   ~ShadowView();
 
@@ -20,6 +43,8 @@ public:
   void set_uniforms();
   void update_ubo();
   void update_light();
+  void update_uniforms(uint32_t frame) override;
+  void update_uniform_sets();
 
   void resize(int w, int h);
   void update_scene();
@@ -33,25 +58,72 @@ public:
   void create_command_buffers();
   void build_depth_command_buffer(VkCommandBuffer cmd_buf);
 
-  void build_command_buffers();
+  void build_command_buffers() override;
+  void record_command_buffer(uint32_t index) override;
   void build_command_buffer(VkCommandBuffer cmd_buf) override;
+  void build_main_secondaries(VkCommandBuffer cmd_buf, const VkCommandBufferInheritanceInfo &inheritance);
   void create_pipe_layout();
   void create_frame_buffers();
   void create_pipeline();
 
+  // before the surface is set, falls back to render passes without device support
+  void set_dynamic_rendering(bool enable);
+
+  // main pass at a scale that follows the GPU frame time, upscaled into the swapchain
+  // image; needs transfer dst swapchain images
+  void set_dynamic_resolution(bool enable);
+  VulkanResolutionScale &resolution() { return _resolution; }
+
+  // the scaled main pass goes through the compute upscaler in this mode instead of a
+  // linear blit
+  void set_upscale(bool compute, VulkanUpscaler::Mode mode);
+  VulkanUpscaler *upscaler() { return _upscaler.get(); }
+
+  // the meshes skip the primitives outside the camera and the shadow frustum
+  void set_frustum_cull(bool enable);
+
+  // a path the device does not support falls back to texture_path; the best supported
+  // one is used by default
+  bool mesh_path_supported(MeshPath path);
+  void set_mesh_path(MeshPath path);
+  MeshPath mesh_path() { return _mesh_path; }
+
+private:
+  void bind_main_state(VkCommandBuffer cmd_buf);
+  // bind_main_state and sets 0 and 1 again for the pipeline of the mesh path
+  void bind_mesh_state(VkCommandBuffer cmd_buf);
+
+  // the pipeline of a bindless mesh path
+  const std::shared_ptr<BindlessPipeline> &mesh_pipeline();
+  void draw_ground(VkCommandBuffer cmd_buf);
+  void draw_hud(VkCommandBuffer cmd_buf);
+  // src's top left extent scaled to the whole swapchain image
+  void blit(VkCommandBuffer cmd_buf, VulkanRenderGraph::Resource src, VkExtent2D extent);
+
+  // the frame scope of the last profiled frame, 0 without timestamps
+  float gpu_frame_ms();
+
+  // against the matrices of update_ubo, records again when a primitive changes sides
+  void cull();
+
 private:
   VkBuffer _vert_buf;
   VkDeviceMemory _vert_mem;
   VkBuffer _index_buf;
   VkDeviceMemory _index_mem;
 
-  VkDescriptorPool _descript_pool = VK_NULL_HANDLE;
-
-  std::vector<VkFramebuffer> _depth_frames;
   std::shared_ptr<DepthPass> _depth_pass;
 
   std::shared_ptr<ShadowPipeline> _shadow_pipeline;
   std::shared_ptr<DepthPersPipeline> _depth_pipeline;
+  // only with a material table, the meshes are realized for both
+  std::shared_ptr<BindlessPipeline> _bindless_pipeline;
+  // shares the material table, and so the material ids of the meshes
+  std::shared_ptr<BindlessPipeline> _pulled_pipeline;
+  // also on the material table, only with indirect count draws
+  std::shared_ptr<VulkanIndirectScene> _indirect_scene;
+  std::shared_ptr<IndirectPipeline> _indirect_pipeline;
+  MeshPath _mesh_path = texture_path;
 
   std::shared_ptr<VulkanImage> _depth_image;
 
@@ -62,11 +134,20 @@ private:
 
   ShadowMatrix _shadow_matrix;
   VkDescriptorSet _shadow_matrix_set = VK_NULL_HANDLE;
+  // a frame set of the command buffer being recorded
   VkDescriptorSet _shadow_texture_set = VK_NULL_HANDLE;
-  std::shared_ptr<VulkanBuffer> _shadow_buf;
   std::shared_ptr<VulkanTexture> _shadow_texture;
 
-  std::shared_ptr<VulkanBuffer> _ubo_buf, _light, _material;
+  std::shared_ptr<VulkanBuffer> _material;
+
+  std::shared_ptr<VulkanUniformRing> _uniforms;
+  struct {
+    uint32_t matrix = 0;
+    uint32_t light = 0;
+    uint32_t shadow = 0;
+    // the camera frustum of the indirect scene
+    uint32_t cull = 0;
+  } _offsets;
 
   MVP _matrix;
 
@@ -74,13 +155,30 @@ private:
   uint32_t _index_count = 0;
 
   std::shared_ptr<MeshInstance> _tree, _deer;
+  bool _frustum_cull = true;
 
   std::shared_ptr<VulkanTexture> _basic_texture;
 
-  std::vector<VkFramebuffer> _hud_frames;
   std::shared_ptr<HUDPass> _hud_pass;
   std::shared_ptr<HUDPipeline> _hud_pipeline;
   std::shared_ptr<HUDRect> _hud_rect;
 
+  // before the graph, whose upscale passes hold descriptor sets of its layout
+  std::shared_ptr<VulkanUpscaler> _upscaler;
+  bool _compute_upscale = false;
+
+  std::shared_ptr<VulkanRenderGraph> _graph;
+  VulkanRenderGraph::Resource _backbuffer = VulkanRenderGraph::invalid;
+  VulkanRenderGraph::Resource _shadow_map = VulkanRenderGraph::invalid;
+  bool _dynamic_rendering = false;
+  // swapchain image whose command buffer the graph records, owns the pass secondaries
+  uint32_t _recording = 0;
+
+  bool _dynamic_resolution = false;
+  VulkanResolutionScale _resolution;
+  VulkanRenderGraph::Resource _scene = VulkanRenderGraph::invalid;
+  // what the main pass renders to, the top left of the scene target when scaled
+  VkExtent2D _render_extent = {};
+
   tg::vec2 _light_dir = tg::vec2(90, 45);
 };
\ No newline at end of file
@@ -1,3 +1,5 @@
+#include <cstdio>
+#include <cstdlib>
 #include <exception>
 #include <stdexcept>
 
@@ -8,36 +10,109 @@
 
 #include "ShadowView.h"
 #include "VulkanInstance.h"
+#include "VulkanSwapChain.h"
 
 int main(int argc, char **argv)
 {
   SDL_Window *win = 0;
   VkSurfaceKHR surface = 0;
   std::shared_ptr<ShadowView> view = 0;
+
+  // --headless WxH renders offscreen without SDL, e.g. on lavapipe
+  auto headless = VulkanView::arg_value(argc, argv, "--headless");
+  // --capture file.png|file.ppm keeps the last frame, only offscreen ones: a presented
+  // image belongs to the presentation engine
+  auto capture = VulkanView::arg_value(argc, argv, "--capture");
+  auto device = VulkanView::arg_value(argc, argv, "--device");
   try {
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
-      throw std::runtime_error("sdl init error.");
-    win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
-    if (win == nullptr)
-      throw std::runtime_error("could not create sdl window.");
+    if (capture && !headless)
+      throw std::runtime_error("--capture needs --headless.");
+    int w = 800, h = 600;
+    auto &inst = VulkanInstance::instance();
+    if (headless) {
+      if (sscanf(headless, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+        throw std::runtime_error("headless size must be WxH.");
+    } else {
+      if (SDL_Init(SDL_INIT_VIDEO) != 0)
+        throw std::runtime_error("sdl init error.");
+      win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, w, h, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+      if (win == nullptr)
+        throw std::runtime_error("could not create sdl window.");
 
-    int w = 0, h = 0;
-    SDL_GetWindowSize(win, &w, &h);
+      SDL_GetWindowSize(win, &w, &h);
 
-    auto &inst = VulkanInstance::instance();
-    if (!SDL_Vulkan_CreateSurface(win, inst, &surface))
-      throw std::runtime_error("could not create vk surface.");
+      if (!SDL_Vulkan_CreateSurface(win, inst, &surface))
+        throw std::runtime_error("could not create vk surface.");
+    }
 
     inst.enable_debug();
-    auto dev = inst.create_device("NVIDIA");
+    auto dev = inst.create_device(device ? device : "NVIDIA");
 
     view = std::make_shared<ShadowView>(dev);
-    view->set_surface(surface, w, h);
+    // --dynamic-rendering begins the graph's passes without render pass objects
+    view->set_dynamic_rendering(VulkanView::has_arg(argc, argv, "--dynamic-rendering"));
+
+    // --present-mode fifo|fifo_relaxed|mailbox|immediate, --images n, --present-latency n
+    if (auto name = VulkanView::arg_value(argc, argv, "--present-mode")) {
+      VkPresentModeKHR mode;
+      if (!VulkanSwapChain::parse_present_mode(name, mode))
+        throw std::runtime_error("unknown present mode.");
+      view->swapchain()->set_present_mode(mode);
+    }
+    if (auto images = VulkanView::arg_value(argc, argv, "--images"))
+      view->swapchain()->set_image_count(atoi(images));
+    if (auto latency = VulkanView::arg_value(argc, argv, "--present-latency"))
+      view->set_present_latency(atoi(latency));
+
+    // --frame-stats file.csv keeps the pacing of the last frames on exit
+    if (auto stats = VulkanView::arg_value(argc, argv, "--frame-stats"))
+      view->set_frame_stats_file(stats);
+    if (headless)
+      view->set_offscreen(w, h);
+    else
+      view->set_surface(surface, w, h);
+
+    // --dynamic-resolution [--gpu-budget ms] scales the main pass to keep the GPU time
+    if (auto budget = VulkanView::arg_value(argc, argv, "--gpu-budget"))
+      view->resolution().config().budget_ms = static_cast<float>(atof(budget));
+    view->set_dynamic_resolution(VulkanView::has_arg(argc, argv, "--dynamic-resolution"));
+
+    // --upscale bilinear|easu|easu_rcas replaces the blit of the scaled main pass
+    if (auto name = VulkanView::arg_value(argc, argv, "--upscale")) {
+      VulkanUpscaler::Mode mode;
+      if (!VulkanUpscaler::parse_mode(name, mode))
+        throw std::runtime_error("unknown upscale mode.");
+      view->set_upscale(true, mode);
+    }
+
+    // --mesh-path texture|bindless|pulled|indirect draws the meshes of the main pass another way
+    if (auto name = VulkanView::arg_value(argc, argv, "--mesh-path")) {
+      ShadowView::MeshPath path;
+      if (!ShadowView::parse_mesh_path(name, path))
+        throw std::runtime_error("unknown mesh path.");
+      view->set_mesh_path(path);
+    }
+
+    // --no-frustum-cull draws every primitive, to compare against
+    if (VulkanView::has_arg(argc, argv, "--no-frustum-cull"))
+      view->set_frustum_cull(false);
+
     view->create_pipeline();
   } catch (std::runtime_error &e) {
     printf("%s", e.what());
     return -1;
   }
-  view->frame();
-  return 0;
+
+  int result = 0;
+  VulkanView::Benchmark bench;
+  if (VulkanView::benchmark_args(argc, argv, bench))
+    result = view->benchmark(bench);
+  else if (headless)
+    view->render_frames(1);
+  else
+    view->frame(VulkanView::has_arg(argc, argv, "--continuous"));
+
+  if (capture && !view->save_image(capture))
+    result = 1;
+  return result;
 }
\ No newline at end of file